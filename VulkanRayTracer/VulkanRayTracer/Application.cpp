@@ -2,71 +2,123 @@
 #include "VulkanInitializers.h"
 #include "QueueFamilyIndices.h"
 #include "SwapChainSupportInfo.h"
+#include "ImageWriter.h"
+#include "Scene/Bvh.h"
+#include "Scene/ObjLoader.h"
 
 #include <iostream>
 #include <set>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <limits>
 #include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cmath>
+#include <random>
 
 
+Application::Application(const RenderSettings& settings) : settings(settings) {}
+
 void Application::Run()
 {
-	SetWindow();
+	if (settings.cpu)
+	{
+		RenderCpu();
+		return;
+	}
 
+	if (!settings.headless)
+		SetWindow();
+
+	auto initStart = std::chrono::steady_clock::now();
 	InitVulkan();
+	ReportStartup(std::chrono::duration<double>(std::chrono::steady_clock::now() - initStart).count());
+	// Workgroup tuning traced paths as well.
+	CollectPathStats();
+	pathStats = PathStats();
+
+	if (settings.posterWidth > 0)
+		RenderPoster();
+	else if (settings.headless)
+		RenderHeadless();
+	else
+		Update();
+
+	if (settings.pathStats)
+	{
+		vkDeviceWaitIdle(logicalDevice);
+		CollectPathStats();
+		pathStats.Print(settings.maxBounces);
+	}
 
-	Update();
+	StorePipelineCache();
 }
 
 void Application::SetWindow()
 {
+#ifdef VKRT_NO_GLFW
+	throw std::runtime_error("This build has no GLFW support, run it with --headless !");
+#else
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
 	window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+#endif
 }
 
 void Application::InitVulkan()
 {
 	CreateVulkanInstance();
 	SetupDebugCallback();
-	CreateSurface();
+	if (!settings.headless)
+		CreateSurface();
 
 	GetPhysicalDevice();
 	CreateLogicalDevice();
 
-	CreateSwapChain();
-	CreateImageViews();
+	if (!settings.headless)
+	{
+		CreateSwapChain();
+		CreateImageViews();
+	}
 
-	CreateComputeImage(computeImage, computeImageView, computeImgDeviceMemory);
+	CreateComputeImage(computeImage, computeImageView, computeImgDeviceMemory, { WIDTH, HEIGHT });
+	// Every binding needs an image, even without dynamic resolution.
+	CreateComputeImage(upscaledImage, upscaledImageView, upscaledDeviceMemory, DynamicResolution() ? VkExtent2D{ WIDTH, HEIGHT } : VkExtent2D{ 1, 1 });
+	CreateAccumulationImage();
 	PrepareStorageBuffers();
 
 	CreateDescriptorPool();
 	PrepareComputeForPipelineCreation();
-	CreateComputePipeline();
-
 
+	// The command buffer is needed earlier to time workgroup sizes during pipeline creation.
 	CreateComputeCommandPool();
 	CreateComputeCommandBuffer();
+	PrepareAccumulationImage();
+	CreatePipelineCache();
+	CreateComputePipeline();
+
+	CreateTimestampQueries();
+	sortRays = settings.sortRays;
 	RecordComputeCommandBuffer();
 	CreateComputeFence();
 
-	CreateSemaphores();
+	if (!settings.headless)
+		CreateSemaphores();
 }
 
 void Application::Update()
 {
+#ifndef VKRT_NO_GLFW
 	while (!glfwWindowShouldClose(window))
 	{
 		glfwPollEvents();
 
-		DebugFrameTime();
-
-		UpdateUniformBuffer();
+		PrintFrameTimings();
 
 		Draw();
 	}
@@ -74,7 +126,10 @@ void Application::Update()
 	// Wait for all queues to finish work.
 	vkDeviceWaitIdle(logicalDevice);
 
+	ReportTimings();
+
 	glfwDestroyWindow(window);
+#endif
 }
 
 void Application::Draw()
@@ -101,11 +156,26 @@ void Application::Draw()
 	vkWaitForFences(logicalDevice, 1, &computeFence, VK_TRUE, UINT64_MAX);
 	vkResetFences(logicalDevice, 1, &computeFence);
 
+	// The previous frame is done, read its timestamps before the command buffer gets recorded again.
+	if (timestampsPending)
+	{
+		gpuTimer.Collect();
+		UpdateRenderScale();
+	}
+	CollectPathStats();
+
+	// Recorded again below anyway.
+	ReloadShader();
+
+	UpdateInstances();
+	UpdateCamera();
+	UpdateUniformBuffer();
 	RecordComputeCommandBuffer();
 
 	auto resultSubmit = vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, computeFence);
 	if (resultSubmit != VK_SUCCESS)
 		throw std::runtime_error("Failed to submit Compute Command Buffers to Compute Queue !");
+	timestampsPending = true;
 	
 
 	VkPresentInfoKHR presentInfo = {};
@@ -118,7 +188,10 @@ void Application::Draw()
 	presentInfo.pSwapchains = swapChains;
 	presentInfo.pImageIndices = &curImageIndex;
 
+	// Presentation isn't part of any command buffer, so it's timed on the CPU.
+	auto presentBegin = GetTime();
 	auto result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	gpuTimer.AddSample(TimingPresent, 1000.0 * (GetTime() - presentBegin));
 
 	// ToDo: Recreate Swap Chain
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
@@ -128,20 +201,587 @@ void Application::Draw()
 }
 
 
-void Application::DebugFrameTime()
+double Application::GetTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+#pragma region Timings
+void Application::CreateTimestampQueries()
+{
+	std::vector<std::string> stages = { "dispatch", "reconstruct", "converge", "temporal", "denoise", "upscale" };
+	if (!settings.headless)
+		stages.insert(stages.end(), { "image barriers", "copy to swap chain", "present barrier", "present (cpu)" });
+
+	auto indices = FindQueueFamilies(physicalDevice, surface);
+	gpuTimer.Create(physicalDevice, indices.computeFamily, stages);
+
+	if (!gpuTimer.Enabled())
+		std::cout << "The compute queue doesn't support timestamps, GPU timings are disabled." << std::endl;
+	if (!gpuTimer.Enabled() && renderScaleGovernor)
+		std::cout << "The render scale stays at " << renderScaleGovernor->GetScale() << " without GPU timings." << std::endl;
+}
+
+void Application::PrintFrameTimings()
 {
-	double currentTime = glfwGetTime();
+	double currentTime = GetTime();
 	frames++;
 
 	if (currentTime - lastTime >= 1.0)
 	{
-		fprintf(stdout, "\rms/frame: %8.2f%", 1000.0 / double(frames));
+		fprintf(stdout, "\rms/frame: %8.2f", 1000.0 / double(frames));
+		for (const auto& timing : gpuTimer.GetStageTimings())
+			fprintf(stdout, " | %s: %.3f", timing.name.c_str(), timing.avgMs);
+		if (DynamicResolution())
+			fprintf(stdout, " | scale: %.2f", float(renderExtent.width) / WIDTH);
+		fflush(stdout);
 
 		frames = 0;
 		lastTime += 1.0;
 	}
 }
 
+void Application::ReportTimings()
+{
+	fprintf(stdout, "\n%-20s %9s %10s %10s %10s\n", "stage", "samples", "min ms", "avg ms", "p99 ms");
+	for (const auto& t : gpuTimer.GetStageTimings())
+		fprintf(stdout, "%-20s %9llu %10.3f %10.3f %10.3f\n", t.name.c_str(), (unsigned long long)t.samples, t.minMs, t.avgMs, t.p99Ms);
+
+	if (!settings.timingsPath.empty())
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		gpuTimer.WriteJson(settings.timingsPath, properties.deviceName);
+		std::cout << "Wrote " << settings.timingsPath << std::endl;
+	}
+}
+#pragma endregion
+
+
+#pragma region Headless
+void Application::RenderHeadless()
+{
+	double unsortedSeconds = 0.0;
+	if (settings.sortCompare)
+	{
+		// The same frames without ray sorting first, the sorted run below renders the image.
+		sortRays = false;
+		RecordComputeCommandBuffer();
+		unsortedSeconds = RenderFrames(settings.frames);
+
+		ReportTimings();
+		gpuTimer.ClearSamples();
+
+		sortRays = true;
+		RecordComputeCommandBuffer();
+		ResetAccumulation();
+	}
+
+	adaptiveSamples = 0;
+	auto seconds = RenderFrames(settings.frames);
+
+	// Adaptive sampling stops early once every tile converged, dynamic resolution & interleaving trace fewer pixels than the
+	// output has.
+	double pixels = renderedPixels;
+	fprintf(stdout, "Rendered %u frames (%s) in %.3f s (%.2f ms/frame, %.2f MPixel/s)\n", renderedFrames,
+		settings.wavefront ? (sortRays ? "wavefront, sorted rays" : "wavefront") : "megakernel", seconds,
+		1000.0 * seconds / renderedFrames, pixels / seconds * 1e-6);
+
+	ReportTimings();
+
+	if (settings.sortCompare)
+	{
+		double samples = pixels * app.samplesPerPixel;
+		fprintf(stdout, "Ray sorting: %.2f MSample/s unsorted, %.2f MSample/s sorted (%.2fx)\n",
+			samples / unsortedSeconds * 1e-6, samples / seconds * 1e-6, unsortedSeconds / seconds);
+	}
+
+	if (settings.adaptiveThreshold > 0.0f)
+	{
+		// Against tracing every pixel in every frame rendered.
+		double uniformSamples = pixels * app.samplesPerPixel;
+		fprintf(stdout, "Adaptive sampling: %s after %u frames, traced %.2f MSamples (%.1f%% of uniform sampling), %u of %u tiles "
+			"above an error of %g\n", adaptiveTileCount == 0 ? "converged" : "stopped", renderedFrames, double(adaptiveSamples) * 1e-6,
+			100.0 * double(adaptiveSamples) / uniformSamples, adaptiveTileCount, GetAdaptiveTileTotal(), settings.adaptiveThreshold);
+	}
+	else if (settings.interleave > 1)
+		fprintf(stdout, "Accumulated about %u samples per pixel, %u per frame on 1 of every %u pixels\n", app.sampleCount / settings.interleave,
+			app.samplesPerPixel, settings.interleave);
+	else
+		fprintf(stdout, "Accumulated %u samples per pixel, %u per frame\n", app.sampleCount, app.samplesPerPixel);
+
+	if (DynamicResolution())
+	{
+		fprintf(stdout, "Dynamic resolution: traced %ux%u of %dx%d (scale %.2f), %s upscaling", renderExtent.width, renderExtent.height,
+			WIDTH, HEIGHT, float(renderExtent.width) / WIDTH, settings.upscaleFilter == UpscaleEdge ? "edge-aware" : "bilinear");
+		if (renderScaleGovernor)
+			fprintf(stdout, ", %u scale changes to hold %.2f ms (%.2f ms at the last scale)", renderScaleGovernor->GetChanges(),
+				settings.targetMs, renderScaleGovernor->GetAverageMs());
+		fprintf(stdout, "\n");
+	}
+
+	SaveComputeImage(settings.outputPath);
+	CompareOutput();
+
+	vkDeviceWaitIdle(logicalDevice);
+}
+
+// Submits the recorded command buffer frames times & returns the seconds until the last one is done.
+double Application::RenderFrames(uint32_t frames)
+{
+	auto begin = GetTime();
+
+	renderedFrames = 0;
+	renderedPixels = 0.0;
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		vkWaitForFences(logicalDevice, 1, &computeFence, VK_TRUE, UINT64_MAX);
+		bool resized = false;
+		if (timestampsPending)
+		{
+			gpuTimer.Collect();
+			resized = UpdateRenderScale();
+		}
+		timestampsPending = false;
+		CollectPathStats();
+
+		// The dispatches are recorded for the render size.
+		if (ReloadShader() || resized)
+			RecordComputeCommandBuffer();
+
+		// The previous frame is done reading the instances & the uniform buffer.
+		UpdateInstances();
+		UpdateCamera();
+		UpdateUniformBuffer();
+
+		// Every tile converged, another frame wouldn't trace anything.
+		if (settings.adaptiveThreshold > 0.0f && adaptiveTileCount == 0)
+			break;
+
+		vkResetFences(logicalDevice, 1, &computeFence);
+		auto submitInfo = Initializers::SubmitInfo(&computeCommandBuffer);
+
+		auto result = vkQueueSubmit(computeQueue, 1, &submitInfo, computeFence);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit Compute Command Buffers to Compute Queue !");
+		timestampsPending = true;
+		renderedFrames++;
+		renderedPixels += double(renderExtent.width) * renderExtent.height / settings.interleave;
+		adaptiveSamples += uint64_t(adaptiveTileCount) * workgroupSize.x * workgroupSize.y * app.samplesPerPixel;
+	}
+
+	vkWaitForFences(logicalDevice, 1, &computeFence, VK_TRUE, UINT64_MAX);
+	auto seconds = GetTime() - begin;
+	if (timestampsPending)
+		gpuTimer.Collect();
+	timestampsPending = false;
+	CollectPathStats();
+	// The tiles the last frame left above the threshold.
+	if (renderedFrames == frames)
+		UpdateAdaptiveTiles();
+
+	return seconds;
+}
+
+void Application::SaveComputeImage(const std::string& path)
+{
+	std::vector<uint8_t> pixels;
+	ReadOutputImage({ WIDTH, HEIGHT }, pixels);
+
+	bool swapRedBlue = computeImageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+	WritePPM(path, WIDTH, HEIGHT, pixels.data(), swapRedBlue);
+
+	std::cout << "Wrote " << path << std::endl;
+}
+
+// Copies the top left extent of the image shown, tightly packed, once the queue is done with it.
+void Application::ReadOutputImage(VkExtent2D extent, std::vector<uint8_t>& pixels)
+{
+	VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	VKDeleter<VkBuffer> readbackBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkDeviceMemory> readbackMemory{ logicalDevice, vkFreeMemory };
+	CreateStorageBuffer(nullptr, size, readbackBuffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackMemory, memTypeIndex);
+
+	VkCommandBuffer copyBuffer;
+	auto allocateInfo = Initializers::CommandBufferAllocateInfo(computeCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	auto result = vkAllocateCommandBuffers(logicalDevice, &allocateInfo, &copyBuffer);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate readback Command Buffer !");
+
+	auto beginInfo = Initializers::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	vkBeginCommandBuffer(copyBuffer, &beginInfo);
+
+	auto compTransfer = Initializers::ImageMemoryBarrier(GetOutputImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	compTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	compTransfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	compTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(copyBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &compTransfer);
+
+	VkBufferImageCopy copy = {};
+	copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copy.imageExtent = { extent.width, extent.height, 1 };
+
+	vkCmdCopyImageToBuffer(copyBuffer, GetOutputImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &copy);
+
+	auto hostRead = Initializers::BufferMemoryBarrier(readbackBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+	vkCmdPipelineBarrier(copyBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, nullptr, 1, &hostRead, 0, nullptr);
+
+	vkEndCommandBuffer(copyBuffer);
+
+	auto submitInfo = Initializers::SubmitInfo(&copyBuffer);
+	vkResetFences(logicalDevice, 1, &computeFence);
+	result = vkQueueSubmit(computeQueue, 1, &submitInfo, computeFence);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit readback Command Buffer !");
+	vkWaitForFences(logicalDevice, 1, &computeFence, VK_TRUE, UINT64_MAX);
+	vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &copyBuffer);
+
+	void* mapped = nullptr;
+	result = vkMapMemory(logicalDevice, readbackMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to map readback memory !");
+
+	auto data = static_cast<const uint8_t*>(mapped);
+	pixels.assign(data, data + size);
+
+	vkUnmapMemory(logicalDevice, readbackMemory);
+}
+
+void Application::CompareOutput()
+{
+	if (settings.comparePath.empty())
+		return;
+
+	auto diff = ComparePPM(settings.outputPath, settings.comparePath);
+	fprintf(stdout, "Compared against %s: %llu of %llu pixels differ, max difference %u, mean difference %.4f\n",
+		settings.comparePath.c_str(), (unsigned long long)diff.differingPixels, (unsigned long long)diff.pixelCount,
+		diff.maxDifference, diff.meanDifference);
+	if (settings.compareTolerance >= 0.0f && diff.meanDifference > settings.compareTolerance)
+		throw std::runtime_error("The output differs from " + settings.comparePath + " by more than --compare-tolerance !");
+}
+#pragma endregion
+
+
+#pragma region Poster
+// Renders the poster tile by tile into the top left of the compute image & streams the finished tiles to the output, the
+// poster as a whole is never on the GPU or in memory.
+void Application::RenderPoster()
+{
+	uint32_t tileWidth = settings.posterTile ? settings.posterTile : WIDTH;
+	uint32_t tileHeight = settings.posterTile ? settings.posterTile : HEIGHT;
+	if (tileWidth > uint32_t(WIDTH) || tileHeight > uint32_t(HEIGHT))
+		throw std::runtime_error("Poster tiles can't be larger than the compute image, use a --poster-tile of at most "
+			+ std::to_string(std::min(WIDTH, HEIGHT)) + " !");
+
+	PosterWriter writer(settings.outputPath, settings.posterWidth, settings.posterHeight, tileWidth, tileHeight);
+	uint32_t samplesPerTile = settings.frames * settings.samplesPerPixel;
+	DispatchBudget budget(settings.dispatchMs, samplesPerTile);
+	bool swapRedBlue = computeImageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+
+	app.imageSize[0] = int32_t(settings.posterWidth);
+	app.imageSize[1] = int32_t(settings.posterHeight);
+
+	std::vector<uint8_t> pixels;
+	uint32_t dispatches = 0;
+	auto begin = GetTime();
+	for (uint32_t i = 0; i < writer.GetTileCount(); i++)
+	{
+		PosterTile tile = writer.GetTile(i);
+		SetPosterTile(tile);
+
+		// The dispatches are recorded for the tile size, the wavefront passes for the samples per pixel as well.
+		bool record = true;
+		for (uint32_t traced = 0; traced < samplesPerTile;)
+		{
+			uint32_t samples = budget.Next(samplesPerTile - traced);
+			record = record || samples != app.samplesPerPixel;
+			app.samplesPerPixel = samples;
+			if (record)
+				RecordComputeCommandBuffer();
+			record = false;
+
+			// The new tile origin restarts the accumulation.
+			UpdateUniformBuffer();
+
+			vkResetFences(logicalDevice, 1, &computeFence);
+			auto submitInfo = Initializers::SubmitInfo(&computeCommandBuffer);
+			auto dispatchBegin = GetTime();
+			auto result = vkQueueSubmit(computeQueue, 1, &submitInfo, computeFence);
+			if (result != VK_SUCCESS)
+				throw std::runtime_error("Failed to submit Compute Command Buffers to Compute Queue !");
+			vkWaitForFences(logicalDevice, 1, &computeFence, VK_TRUE, UINT64_MAX);
+			double ms = 1000.0 * (GetTime() - dispatchBegin);
+
+			// The GPU time where there are timestamps, the submission & wait otherwise.
+			gpuTimer.Collect();
+			if (gpuTimer.Enabled())
+				ms = gpuTimer.GetLastMs();
+			CollectPathStats();
+			budget.Update(samples, ms);
+
+			traced += samples;
+			dispatches++;
+		}
+
+		ReadOutputImage({ tile.width, tile.height }, pixels);
+		writer.AddTile(pixels.data(), tile.width, swapRedBlue);
+		fprintf(stdout, "\rPoster tile %u of %u", i + 1, writer.GetTileCount());
+		fflush(stdout);
+	}
+	writer.Finish();
+	auto seconds = GetTime() - begin;
+
+	double pixelCount = double(settings.posterWidth) * settings.posterHeight;
+	fprintf(stdout, "\nRendered a %ux%u poster in %u tiles of up to %ux%u, %u samples per pixel, in %.3f s (%.2f MPixel/s)\n",
+		settings.posterWidth, settings.posterHeight, writer.GetTileCount(), tileWidth, tileHeight, samplesPerTile, seconds,
+		pixelCount / seconds * 1e-6);
+	fprintf(stdout, "%u dispatches, the longest took %.2f ms", dispatches, budget.GetLongestMs());
+	if (settings.dispatchMs > 0.0f)
+		fprintf(stdout, " of a %.2f ms budget", settings.dispatchMs);
+	fprintf(stdout, "\n");
+	if (budget.OverBudget())
+		fprintf(stdout, "A single sample over a tile took longer than the budget, a smaller --poster-tile would stay within it\n");
+	fprintf(stdout, "Wrote %s through a band of %.1f MB\n", settings.outputPath.c_str(), writer.GetBandBytes() / (1024.0 * 1024.0));
+
+	ReportTimings();
+	CompareOutput();
+
+	vkDeviceWaitIdle(logicalDevice);
+}
+
+// Traced into the top left of the compute image, like a frame at a lower render scale.
+void Application::SetPosterTile(const PosterTile& tile)
+{
+	renderExtent = { tile.width, tile.height };
+	app.renderSize[0] = int32_t(tile.width);
+	app.renderSize[1] = int32_t(tile.height);
+	app.tileOrigin[0] = int32_t(tile.x);
+	app.tileOrigin[1] = int32_t(tile.y);
+}
+
+// The renderer traces tileWidth x tileHeight pixels, the tiles along the right & bottom edge keep their part of them.
+void Application::RenderPosterCpu(CpuRenderer& renderer, ThreadPool& pool, uint32_t tileWidth, uint32_t tileHeight)
+{
+	PosterWriter writer(settings.outputPath, settings.posterWidth, settings.posterHeight, tileWidth, tileHeight);
+	std::vector<uint8_t> pixels(size_t(tileWidth) * tileHeight * 4);
+
+	auto begin = GetTime();
+	for (uint32_t i = 0; i < writer.GetTileCount(); i++)
+	{
+		PosterTile tile = writer.GetTile(i);
+		renderer.SetView(tile.x, tile.y, settings.posterWidth, settings.posterHeight);
+		for (uint32_t frame = 0; frame < settings.frames; frame++)
+			renderer.Render(pool, pixels.data());
+
+		writer.AddTile(pixels.data(), tileWidth, false);
+		fprintf(stdout, "\rPoster tile %u of %u", i + 1, writer.GetTileCount());
+		fflush(stdout);
+	}
+	writer.Finish();
+	auto seconds = GetTime() - begin;
+
+	double pixelCount = double(settings.posterWidth) * settings.posterHeight;
+	fprintf(stdout, "\nCPU rendered a %ux%u poster in %u tiles of up to %ux%u, %u samples per pixel, in %.3f s (%.2f MPixel/s)\n",
+		settings.posterWidth, settings.posterHeight, writer.GetTileCount(), tileWidth, tileHeight, renderer.GetSampleCount(), seconds,
+		pixelCount / seconds * 1e-6);
+	fprintf(stdout, "Wrote %s through a band of %.1f MB\n", settings.outputPath.c_str(), writer.GetBandBytes() / (1024.0 * 1024.0));
+	if (settings.pathStats)
+		renderer.GetPathStats().Print(settings.maxBounces);
+
+	CompareOutput();
+}
+#pragma endregion
+
+
+#pragma region CPU Rendering
+void Application::RenderCpu()
+{
+	if (settings.bvhScaling)
+	{
+		ReportBvhScaling();
+		return;
+	}
+
+	std::vector<Planee> planes;
+	std::vector<Sphere> spheres;
+	std::vector<Mesh> meshes;
+	InstanceSet meshInstances;
+	std::vector<Light> lights;
+	InitGameObjects(planes, spheres, meshes, meshInstances, lights);
+
+	// Traced at the render scale & upscaled before writing, like the upscale pass does on the GPU.
+	uint32_t width = ScaledSize(WIDTH, settings.renderScale);
+	uint32_t height = ScaledSize(HEIGHT, settings.renderScale);
+	// Poster tiles are traced one after the other at the tile size, see RenderPosterCpu.
+	if (settings.posterWidth > 0)
+	{
+		width = std::min(settings.posterTile ? settings.posterTile : uint32_t(WIDTH), settings.posterWidth);
+		height = std::min(settings.posterTile ? settings.posterTile : uint32_t(HEIGHT), settings.posterHeight);
+	}
+	CpuRenderer renderer(planes, spheres, std::move(meshes), meshInstances, lights, width, height);
+	renderer.SetSampler(settings.sampler, settings.samplesPerPixel);
+	renderer.SetShading(settings.maxBounces, settings.shadow, settings.epsilon, settings.rouletteDepth);
+	renderer.SetDenoise(settings.denoiseIterations);
+	renderer.SetTemporal(settings.temporal);
+	renderer.SetAdaptive(settings.adaptiveThreshold);
+	renderer.SetInterleave(settings.interleave);
+	ReportPrimitiveLayout(renderer.GetPrimitives());
+	std::vector<uint8_t> pixels(size_t(width) * height * 4);
+
+	unsigned threads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	if (settings.cpuScaling)
+	{
+		ReportCpuScaling(renderer, pixels);
+		renderer.ResetAccumulation();
+	}
+
+	ThreadPool pool(threads);
+	if (settings.posterWidth > 0)
+	{
+		RenderPosterCpu(renderer, pool, width, height);
+		return;
+	}
+
+	double updateSeconds = 0.0;
+	uint32_t rendered = 0;
+	auto begin = GetTime();
+	for (uint32_t i = 0; i < settings.frames; i++)
+	{
+		// Every tile converged, see CpuRenderer::SetAdaptive.
+		if (settings.adaptiveThreshold > 0.0f && renderer.GetActiveTiles() == 0)
+			break;
+
+		if (settings.animate)
+		{
+			auto updateBegin = GetTime();
+			AnimateInstances(meshInstances);
+			renderer.UpdateInstances(meshInstances);
+			updateSeconds += GetTime() - updateBegin;
+		}
+		if (settings.orbit)
+			renderer.SetCamera(CameraPose::Orbit(i));
+
+		renderer.Render(pool, pixels.data());
+		rendered++;
+	}
+	auto seconds = GetTime() - begin;
+
+	if (settings.animate)
+		fprintf(stdout, "Moved & refitted %u instances in %.3f ms/frame\n", meshInstances.Count(), 1000.0 * updateSeconds / rendered);
+
+	// Pixels traced, interleaved frames reconstruct the others.
+	double pixelCount = double(width) * height * rendered / settings.interleave;
+	fprintf(stdout, "CPU rendered %u frames on %u threads (%d wide packets) in %.3f s (%.2f ms/frame, %.2f MPixel/s)\n",
+		rendered, threads, FloatN::Width, seconds, 1000.0 * seconds / rendered, pixelCount / seconds * 1e-6);
+
+	if (settings.adaptiveThreshold > 0.0f)
+	{
+		uint32_t activeTiles = renderer.GetActiveTiles();
+		double uniformSamples = pixelCount * settings.samplesPerPixel;
+		fprintf(stdout, "Adaptive sampling: %s after %u frames, traced %.2f MSamples (%.1f%% of uniform sampling), %u tiles "
+			"above an error of %g\n", activeTiles == 0 ? "converged" : "stopped", rendered, double(renderer.GetTracedSamples()) * 1e-6,
+			100.0 * double(renderer.GetTracedSamples()) / uniformSamples, activeTiles, settings.adaptiveThreshold);
+	}
+	else if (settings.interleave > 1)
+		fprintf(stdout, "Accumulated about %u samples per pixel, %u per frame on 1 of every %u pixels\n",
+			renderer.GetSampleCount() / settings.interleave, settings.samplesPerPixel, settings.interleave);
+	else
+		fprintf(stdout, "Accumulated %u samples per pixel, %u per frame\n", renderer.GetSampleCount(), settings.samplesPerPixel);
+	if (settings.pathStats)
+		renderer.GetPathStats().Print(settings.maxBounces);
+
+	if (settings.renderScale < 1.0f)
+	{
+		std::vector<uint8_t> upscaled(size_t(WIDTH) * HEIGHT * 4);
+		UpscaleImage(pixels.data(), width, height, upscaled.data(), WIDTH, HEIGHT, settings.upscaleFilter);
+		fprintf(stdout, "Dynamic resolution: traced %ux%u of %dx%d (scale %.2f), %s upscaling\n", width, height, WIDTH, HEIGHT,
+			settings.renderScale, settings.upscaleFilter == UpscaleEdge ? "edge-aware" : "bilinear");
+		pixels.swap(upscaled);
+	}
+
+	WritePPM(settings.outputPath, WIDTH, HEIGHT, pixels.data(), false);
+	std::cout << "Wrote " << settings.outputPath << std::endl;
+
+	CompareOutput();
+}
+
+void Application::ReportCpuScaling(CpuRenderer& renderer, std::vector<uint8_t>& pixels)
+{
+	unsigned maxThreads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	fprintf(stdout, "CPU scaling, %d wide packets, %u frames per measurement\n", FloatN::Width, settings.frames);
+	fprintf(stdout, "%8s %12s %12s %9s %11s\n", "threads", "ms/frame", "MPixel/s", "speedup", "efficiency");
+
+	double singleThreaded = 0.0;
+	for (unsigned threads = 1; threads <= maxThreads; threads++)
+	{
+		ThreadPool pool(threads);
+
+		// Warm up caches & wake all workers once before measuring.
+		renderer.Render(pool, pixels.data());
+
+		auto begin = GetTime();
+		for (uint32_t i = 0; i < settings.frames; i++)
+			renderer.Render(pool, pixels.data());
+		double msPerFrame = 1000.0 * (GetTime() - begin) / settings.frames;
+
+		if (threads == 1)
+			singleThreaded = msPerFrame;
+
+		double speedup = singleThreaded / msPerFrame;
+		fprintf(stdout, "%8u %12.2f %12.2f %8.2fx %10.1f%%\n", threads, msPerFrame,
+			double(pixels.size() / 4) / settings.interleave / (msPerFrame * 1000.0), speedup, 100.0 * speedup / threads);
+	}
+}
+
+void Application::ReportBvhScaling()
+{
+	unsigned threads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+	ThreadPool pool(threads);
+	std::vector<uint8_t> pixels(size_t(WIDTH) * HEIGHT * 4);
+
+	fprintf(stdout, "BVH scaling, %u threads, %u frames per measurement\n", threads, settings.frames);
+	fprintf(stdout, "%9s %10s %9s %7s %9s %12s %12s\n", "spheres", "build ms", "nodes", "depth", "geom MB", "ms/frame", "MRays/s");
+
+	for (uint32_t count = 10; count <= 1000000; count *= 10)
+	{
+		std::vector<Planee> planes;
+		std::vector<Sphere> spheres;
+		std::vector<Mesh> meshes;
+		InstanceSet meshInstances;
+		std::vector<Light> lights;
+		InitGameObjects(planes, spheres, meshes, meshInstances, lights);
+		AddRandomSpheres(spheres, count);
+
+		auto begin = GetTime();
+		CpuRenderer renderer(planes, spheres, std::move(meshes), meshInstances, lights, WIDTH, HEIGHT);
+		double buildMs = 1000.0 * (GetTime() - begin);
+
+		renderer.Render(pool, pixels.data());
+
+		begin = GetTime();
+		for (uint32_t i = 0; i < settings.frames; i++)
+			renderer.Render(pool, pixels.data());
+		double msPerFrame = 1000.0 * (GetTime() - begin) / settings.frames;
+
+		// Primary rays only, shadow & reflection rays aren't counted.
+		fprintf(stdout, "%9u %10.2f %9zu %7u %9.2f %12.2f %12.2f\n", uint32_t(spheres.size()), buildMs, renderer.GetNodes().size(),
+			renderer.GetSphereBvhDepth(), renderer.GetPrimitives().GeometryBytes() / 1048576.0, msPerFrame,
+			double(WIDTH) * HEIGHT / (msPerFrame * 1000.0));
+	}
+}
+#pragma endregion
+
 
 
 void Application::CreateVulkanInstance()
@@ -174,9 +814,11 @@ void Application::CreateVulkanInstance()
 
 void Application::CreateSurface()
 {
+#ifndef VKRT_NO_GLFW
 	auto result = glfwCreateWindowSurface(instance, window, nullptr, surface.Replace());
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create window surface!");
+#endif
 }
 
 
@@ -257,12 +899,17 @@ std::vector<const char*> Application::GetRequiredExtensions()
 {
 	std::vector<const char*> extensions;
 
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+#ifndef VKRT_NO_GLFW
+	if (!settings.headless)
+	{
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	for (unsigned int i = 0; i < glfwExtensionCount; i++)
-		extensions.push_back(glfwExtensions[i]);
+		for (unsigned int i = 0; i < glfwExtensionCount; i++)
+			extensions.push_back(glfwExtensions[i]);
+	}
+#endif
 
 	if (enableValidationLayers)
 		extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -315,6 +962,10 @@ bool Application::IsDeviceSuitable(VkPhysicalDevice device)
 	QueueFamilyIndices indices = FindQueueFamilies(device, surface);
 	bool extensionsSupported = CheckDeviceExtensionSupport(device);
 
+	// Headless rendering never presents, any device with a compute queue will do.
+	if (settings.headless)
+		return indices.IsComplete() && extensionsSupported;
+
 	bool swapChainAdequate = false;
 	if (extensionsSupported) 
 	{
@@ -333,13 +984,22 @@ bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device)
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	auto extensions = GetDeviceExtensions();
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	for (const auto& extension : availableExtensions)
 		requiredExtensions.erase(extension.extensionName);
 
 	return requiredExtensions.empty();
 }
+
+std::vector<const char*> Application::GetDeviceExtensions()
+{
+	if (settings.headless)
+		return {};
+
+	return deviceExtensions;
+}
 #pragma endregion
 
 
@@ -348,7 +1008,9 @@ void Application::CreateLogicalDevice()
 	auto indices = FindQueueFamilies(physicalDevice, surface);
 
 	std::vector<VkDeviceQueueCreateInfo> queueInfos;
-	std::set<int> uniqueQueueFamilies = { indices.presentFamily, indices.computeFamily };
+	std::set<int> uniqueQueueFamilies = { indices.computeFamily };
+	if (indices.requiresPresent)
+		uniqueQueueFamilies.insert(indices.presentFamily);
 
 	// Create a Queue Create Info for each of our Queue Families (i.e. present & compute)
 	float queuePriority = 1.0f;
@@ -365,12 +1027,14 @@ void Application::CreateLogicalDevice()
 
 	vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
 
+	auto extensions = GetDeviceExtensions();
+
 	auto deviceInfo = Initializers::DeviceCreateInfo();
 	deviceInfo.pQueueCreateInfos = queueInfos.data();
 	deviceInfo.queueCreateInfoCount = queueInfos.size();
 	deviceInfo.pEnabledFeatures = &deviceFeatures;
-	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
-	deviceInfo.enabledExtensionCount = deviceExtensions.size();
+	deviceInfo.ppEnabledExtensionNames = extensions.data();
+	deviceInfo.enabledExtensionCount = extensions.size();
 
 	if (enableValidationLayers)
 	{
@@ -390,7 +1054,8 @@ void Application::CreateLogicalDevice()
 		throw std::runtime_error(s);
 	}
 
-	vkGetDeviceQueue(logicalDevice, indices.presentFamily, 0, &presentQueue);
+	if (indices.requiresPresent)
+		vkGetDeviceQueue(logicalDevice, indices.presentFamily, 0, &presentQueue);
 	vkGetDeviceQueue(logicalDevice, indices.computeFamily, 0, &computeQueue);
 }
 
@@ -517,14 +1182,21 @@ void Application::CreateImageViews()
 	}
 }
 
-void Application::CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageView> &imgView, VKDeleter<VkDeviceMemory> &memory)
+void Application::CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageView> &imgView, VKDeleter<VkDeviceMemory> &memory, VkExtent2D extent)
 {
-	auto swapChainSupport = QuerySwapChainSupport(physicalDevice, surface);
-	auto surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
+	// The compute image is copied into the swap chain, so both formats have to match.
+	// Headless we're free to pick the format matching the shader's rgba8 layout.
+	if (settings.headless)
+		computeImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	else
+	{
+		auto swapChainSupport = QuerySwapChainSupport(physicalDevice, surface);
+		computeImageFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats).format;
+	}
 
 	auto info = Initializers::ImageCreateInfo(VK_IMAGE_TYPE_2D);
-	info.format = surfaceFormat.format;
-	info.extent = { WIDTH, HEIGHT, 1 };
+	info.format = computeImageFormat;
+	info.extent = { extent.width, extent.height, 1 };
 	info.mipLevels = 1;
 	info.arrayLayers = 1;
 	info.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -552,7 +1224,7 @@ void Application::CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageV
 		throw std::runtime_error("Failed to bind memory to compute image !");
 
 	auto viewInfo = Initializers::ImageViewCreateInfo(img, VK_IMAGE_VIEW_TYPE_2D);
-	viewInfo.format = surfaceFormat.format;
+	viewInfo.format = computeImageFormat;
 	viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
@@ -560,49 +1232,197 @@ void Application::CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageV
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create compute image view !");
 }
-#pragma endregion
-
 
-#pragma region Pipelines
-void Application::CreateDescriptorPool()
+void Application::CreateAccumulationImage()
 {
-	auto storageSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3);
-	auto bufferSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2);
-	auto uniformSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
-
-	std::vector<VkDescriptorPoolSize> poolSizes = { storageSize , bufferSize, uniformSize };
-
-	auto poolInfo = Initializers::DescriptorPoolCreateInfo();
-	poolInfo.maxSets = 1;
-	poolInfo.poolSizeCount = poolSizes.size();
-	poolInfo.pPoolSizes = poolSizes.data();
+	auto info = Initializers::ImageCreateInfo(VK_IMAGE_TYPE_2D);
+	info.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	info.extent = { WIDTH, HEIGHT, 1 };
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = VK_SAMPLE_COUNT_1_BIT;
+	info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	info.usage = VK_IMAGE_USAGE_STORAGE_BIT;
 
-	auto result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, computeDescriptorPool.Replace());
+	auto result = vkCreateImage(logicalDevice, &info, nullptr, accumulationImage.Replace());
 	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to create Compute Descriptor Pool !");
-}
+		throw std::runtime_error("Failed to create accumulation image !");
 
-void Application::PrepareComputeForPipelineCreation()
-{
-	auto computeBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0);
-	auto sphereBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1);
-	auto planeBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2);
-	auto uniformBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3);
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	std::vector<VkDescriptorSetLayoutBinding> bindings{ computeBinding, sphereBinding, planeBinding, uniformBinding };
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(logicalDevice, accumulationImage, &memReqs);
 
-	auto layoutInfo = Initializers::DescriptorSetLayoutCreateInfo();
-	layoutInfo.bindingCount = bindings.size();
-	layoutInfo.pBindings = bindings.data();
+	auto memInfo = Initializers::MemoryAllocateInfo(memReqs.size, memTypeIndex);
 
-	auto result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, computeDescriptorSetLayout.Replace());
+	result = vkAllocateMemory(logicalDevice, &memInfo, nullptr, accumulationDeviceMemory.Replace());
 	if (result != VK_SUCCESS)
-		throw std::runtime_error("Failed to create Compute DescriptorSet Layout !");
+		throw std::runtime_error("Failed to allocate memory for accumulation image !");
+	result = vkBindImageMemory(logicalDevice, accumulationImage, accumulationDeviceMemory, 0);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to bind memory to accumulation image !");
 
+	auto viewInfo = Initializers::ImageViewCreateInfo(accumulationImage, VK_IMAGE_VIEW_TYPE_2D);
+	viewInfo.format = info.format;
+	viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-	auto pipelineLayoutInfo = Initializers::PipelineLayoutCreateInfo();
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
+	result = vkCreateImageView(logicalDevice, &viewInfo, nullptr, accumulationImageView.Replace());
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create accumulation image view !");
+}
+
+void Application::PrepareAccumulationImage()
+{
+	// Moved to the general layout once, frames keep adding to its content from then on.
+	auto beginInfo = Initializers::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	vkBeginCommandBuffer(computeCommandBuffer, &beginInfo);
+
+	auto barrier = Initializers::ImageMemoryBarrier(accumulationImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	auto result = vkEndCommandBuffer(computeCommandBuffer);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Accumulation image Command Buffer Recording couldn't be ended !");
+
+	auto submitInfo = Initializers::SubmitInfo(&computeCommandBuffer);
+	result = vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit the accumulation image Command Buffer !");
+	vkQueueWaitIdle(computeQueue);
+}
+#pragma endregion
+
+
+#pragma region Pipelines
+// Planes come first, then as many top levels of the sphere hierarchy as fit, then the spheres if the whole hierarchy did.
+// Whatever doesn't fit is read from the buffers as before, so large scenes fall back to plain buffer reads.
+void Application::ChooseSharedStaging(const PrimitiveBuffers& primitives, size_t sphereNodeCount)
+{
+	sharedStaging = {};
+	if (!settings.sharedStaging)
+		return;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	size_t limit = properties.limits.maxComputeSharedMemorySize;
+	if (settings.sharedBudget > 0)
+		limit = std::min<size_t>(limit, settings.sharedBudget);
+
+	// The sort scan of the same module takes one entry per invocation & every staged array one unused entry.
+	size_t reserved = properties.limits.maxComputeWorkGroupInvocations * sizeof(uint32_t) + 2 * sizeof(PrimitiveGeometry) + sizeof(BvhNode);
+	size_t budget = (limit > reserved) ? limit - reserved : 0;
+
+	size_t planeBytes = primitives.planes.size() * sizeof(PrimitiveGeometry);
+	if (planeBytes > budget)
+	{
+		std::cout << "The planes don't fit into " << budget << " bytes of shared memory, the scene is read from the buffers." << std::endl;
+		return;
+	}
+
+	sharedStaging.planes = uint32_t(primitives.planes.size());
+	budget -= planeBytes;
+
+	sharedStaging.nodes = uint32_t(std::min(sphereNodeCount, budget / sizeof(BvhNode)));
+	budget -= sharedStaging.nodes * sizeof(BvhNode);
+
+	size_t sphereBytes = primitives.spheres.size() * sizeof(PrimitiveGeometry);
+	if (sharedStaging.nodes == sphereNodeCount && sphereBytes <= budget)
+		sharedStaging.spheres = uint32_t(primitives.spheres.size());
+
+	size_t staged = planeBytes + sharedStaging.nodes * sizeof(BvhNode) + sharedStaging.spheres * sizeof(PrimitiveGeometry);
+	fprintf(stdout, "Shared memory staging: %u planes, %u of %zu BVH nodes, %u of %zu spheres (%zu of %zu bytes per workgroup)\n",
+		sharedStaging.planes, sharedStaging.nodes, sphereNodeCount, sharedStaging.spheres, primitives.spheres.size(), staged, limit);
+}
+
+void Application::CreateDescriptorPool()
+{
+	auto storageSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3);
+	auto bufferSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 25);
+	auto uniformSize = Initializers::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+
+	std::vector<VkDescriptorPoolSize> poolSizes = { storageSize , bufferSize, uniformSize };
+
+	auto poolInfo = Initializers::DescriptorPoolCreateInfo();
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	auto result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, computeDescriptorPool.Replace());
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create Compute Descriptor Pool !");
+}
+
+void Application::PrepareComputeForPipelineCreation()
+{
+	auto computeBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+	auto accumulationBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 14);
+	auto upscaledBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 28);
+	auto sphereBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1);
+	auto planeBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2);
+	auto uniformBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3);
+	auto bvhBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4);
+	auto vertexBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5);
+	auto indexBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6);
+	auto meshBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7);
+	auto instanceBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8);
+	auto instanceNodeBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 9);
+	auto rayBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 10);
+	auto hitBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 11);
+	auto shadowRayBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 12);
+	auto queueBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 13);
+	auto pixelRadianceBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 15);
+	auto blueNoiseBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 16);
+	auto sortBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 17);
+	auto materialBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 18);
+	auto lightBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 19);
+	auto pathStatsBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 20);
+	auto gbufferBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 21);
+	auto denoiseBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 22);
+	auto instanceMotionBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 23);
+	auto motionBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 24);
+	auto historyBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 25);
+	auto momentsBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 26);
+	auto adaptiveTilesBinding = Initializers::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 27);
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings{ computeBinding, sphereBinding, planeBinding, uniformBinding, bvhBinding,
+		vertexBinding, indexBinding, meshBinding, instanceBinding, instanceNodeBinding, rayBinding, hitBinding, shadowRayBinding, queueBinding,
+		accumulationBinding, pixelRadianceBinding, blueNoiseBinding, sortBinding, materialBinding, lightBinding, pathStatsBinding,
+		gbufferBinding, denoiseBinding, instanceMotionBinding, motionBinding, historyBinding, momentsBinding, adaptiveTilesBinding, upscaledBinding };
+
+	// Vulkan only guarantees 4 storage buffers per stage & a layout above the device limit isn't an error it reports.
+	auto storageBuffers = std::count_if(bindings.begin(), bindings.end(),
+		[](const VkDescriptorSetLayoutBinding& binding) { return binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; });
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	if (uint32_t(storageBuffers) > properties.limits.maxPerStageDescriptorStorageBuffers)
+		throw std::runtime_error("The ray tracing shader needs " + std::to_string(storageBuffers) + " storage buffers per stage, " +
+			std::string(properties.deviceName) + " has " + std::to_string(properties.limits.maxPerStageDescriptorStorageBuffers) + " !");
+
+	auto layoutInfo = Initializers::DescriptorSetLayoutCreateInfo();
+	layoutInfo.bindingCount = bindings.size();
+	layoutInfo.pBindings = bindings.data();
+
+	auto result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, computeDescriptorSetLayout.Replace());
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create Compute DescriptorSet Layout !");
+
+
+	// The ray queue, sample & sorting of the wavefront passes.
+	auto pushConstantRange = Initializers::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(WavefrontConstants));
+
+	auto pipelineLayoutInfo = Initializers::PipelineLayoutCreateInfo();
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &computeDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	result = vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, computePipelineLayout.Replace());
 	if (result != VK_SUCCESS)
@@ -621,44 +1441,314 @@ void Application::PrepareComputeForPipelineCreation()
 
 	// Bind resources to the descriptor sets
 	auto computeInfo = Initializers::DescriptorImageInfo(computeImageView, VK_IMAGE_LAYOUT_GENERAL);
+	auto accumulationInfo = Initializers::DescriptorImageInfo(accumulationImageView, VK_IMAGE_LAYOUT_GENERAL);
+	auto upscaledInfo = Initializers::DescriptorImageInfo(upscaledImageView, VK_IMAGE_LAYOUT_GENERAL);
 
 	auto sphereInfo = Initializers::DescriptorBufferInfo(sphereBuffer);
 	auto planeInfo = Initializers::DescriptorBufferInfo(planeBuffer);
 	auto uniformInfo = Initializers::DescriptorBufferInfo(uniformBuffer);
+	auto bvhInfo = Initializers::DescriptorBufferInfo(bvhBuffer);
+	auto vertexInfo = Initializers::DescriptorBufferInfo(vertexBuffer);
+	auto indexInfo = Initializers::DescriptorBufferInfo(indexBuffer);
+	auto meshInfo = Initializers::DescriptorBufferInfo(meshBuffer);
+	auto instanceInfo = Initializers::DescriptorBufferInfo(instanceBuffer);
+	auto instanceNodeInfo = Initializers::DescriptorBufferInfo(instanceNodeBuffer);
+	auto rayInfo = Initializers::DescriptorBufferInfo(rayBuffer);
+	auto hitInfo = Initializers::DescriptorBufferInfo(hitBuffer);
+	auto shadowRayInfo = Initializers::DescriptorBufferInfo(shadowRayBuffer);
+	auto queueInfo = Initializers::DescriptorBufferInfo(queueBuffer);
+	auto pixelRadianceInfo = Initializers::DescriptorBufferInfo(pixelRadianceBuffer);
+	auto blueNoiseInfo = Initializers::DescriptorBufferInfo(blueNoiseBuffer);
+	auto sortInfo = Initializers::DescriptorBufferInfo(sortBuffer);
+	auto materialInfo = Initializers::DescriptorBufferInfo(materialBuffer);
+	auto lightInfo = Initializers::DescriptorBufferInfo(lightBuffer);
+	auto pathStatsInfo = Initializers::DescriptorBufferInfo(pathStatsBuffer);
+	auto gbufferInfo = Initializers::DescriptorBufferInfo(gbufferBuffer);
+	auto denoiseInfo = Initializers::DescriptorBufferInfo(denoiseBuffer);
+	auto instanceMotionInfo = Initializers::DescriptorBufferInfo(instanceMotionBuffer);
+	auto motionInfo = Initializers::DescriptorBufferInfo(motionBuffer);
+	auto historyInfo = Initializers::DescriptorBufferInfo(historyBuffer);
+	auto momentsInfo = Initializers::DescriptorBufferInfo(momentsBuffer);
+	auto adaptiveTilesInfo = Initializers::DescriptorBufferInfo(adaptiveTilesBuffer);
 
 
 	auto computeWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &computeInfo);
+	auto accumulationWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 14, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &accumulationInfo);
+	auto upscaledWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 28, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &upscaledInfo);
 
 	auto sphereWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &sphereInfo);
 	auto planeWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &planeInfo);
 	auto uniformWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformInfo);
-
-	std::vector<VkWriteDescriptorSet> writeSets = { computeWrite, sphereWrite, planeWrite, uniformWrite };
+	auto bvhWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bvhInfo);
+	auto vertexWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &vertexInfo);
+	auto indexWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &indexInfo);
+	auto meshWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &meshInfo);
+	auto instanceWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &instanceInfo);
+	auto instanceNodeWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &instanceNodeInfo);
+	auto rayWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &rayInfo);
+	auto hitWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &hitInfo);
+	auto shadowRayWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &shadowRayInfo);
+	auto queueWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 13, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &queueInfo);
+	auto pixelRadianceWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &pixelRadianceInfo);
+	auto blueNoiseWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 16, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &blueNoiseInfo);
+	auto sortWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 17, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &sortInfo);
+	auto materialWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 18, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &materialInfo);
+	auto lightWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 19, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &lightInfo);
+	auto pathStatsWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 20, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &pathStatsInfo);
+	auto gbufferWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 21, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &gbufferInfo);
+	auto denoiseWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 22, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &denoiseInfo);
+	auto instanceMotionWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 23, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &instanceMotionInfo);
+	auto motionWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 24, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &motionInfo);
+	auto historyWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 25, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &historyInfo);
+	auto momentsWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 26, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &momentsInfo);
+	auto adaptiveTilesWrite = Initializers::WriteDescriptorSet(computeDescriptorSets[0], 27, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &adaptiveTilesInfo);
+
+	std::vector<VkWriteDescriptorSet> writeSets = { computeWrite, sphereWrite, planeWrite, uniformWrite, bvhWrite,
+		vertexWrite, indexWrite, meshWrite, instanceWrite, instanceNodeWrite, rayWrite, hitWrite, shadowRayWrite, queueWrite,
+		accumulationWrite, pixelRadianceWrite, blueNoiseWrite, sortWrite, materialWrite, lightWrite, pathStatsWrite,
+		gbufferWrite, denoiseWrite, instanceMotionWrite, motionWrite, historyWrite, momentsWrite, adaptiveTilesWrite, upscaledWrite };
 	vkUpdateDescriptorSets(logicalDevice, writeSets.size(), writeSets.data(), 0, VK_NULL_HANDLE);
 }
 
 void Application::CreateComputePipeline()
 {
-	auto computeShaderCode = ReadBinaryFile("shaders/comp.spv");
-	VKDeleter<VkShaderModule> computeShaderModule{ logicalDevice, vkDestroyShaderModule };
+	auto computeShaderCode = LoadComputeShader();
 	CreateShaderModule(computeShaderCode, computeShaderModule);
 
+	ChooseWorkgroupSize(computeShaderModule);
+	computePipeline = GetComputePipeline(workgroupSize);
+	CreateFilterPipelines();
+
+	if (settings.wavefront)
+		CreateWavefrontPipelines();
+
+	if (settings.watchShader)
+		shaderWatcher.reset(new ShaderWatcher(ShaderCompiler(settings.shaderCachePath, settings.optimizeShader), settings.shaderPath));
+}
+
+// Compiles settings.shaderPath, or takes the SPIR-V of an earlier run with the same source & options. There is no SPIR-V
+// to fall back to, any other shader wouldn't match the descriptor & pipeline layouts built here.
+std::vector<char> Application::LoadComputeShader()
+{
+	auto begin = GetTime();
+	auto compiled = ShaderCompiler(settings.shaderCachePath, settings.optimizeShader).Compile(settings.shaderPath);
+	if (compiled.spirv.empty())
+		throw std::runtime_error("Failed to compile " + settings.shaderPath + " !\n" + compiled.log);
+
+	fprintf(stdout, "%s %s in %.1f ms\n", compiled.cached ? "Loaded the cached SPIR-V of" : "Compiled", settings.shaderPath.c_str(),
+		1000.0 * (GetTime() - begin));
+	return compiled.spirv;
+}
+
+// Swaps in the pipelines of a shader the watcher compiled, only call this while no submitted frame uses the current ones.
+// The driver still compiles the new pipelines here, on the render thread. Returns true if the command buffer has to be recorded again.
+bool Application::ReloadShader()
+{
+	std::vector<char> code;
+	if (!shaderWatcher || !shaderWatcher->TakeCompiled(code))
+		return false;
+
+	auto begin = GetTime();
+	auto previous = std::move(pipelineVariants);
+	pipelineVariants.clear();
+
+	try
+	{
+		CreateShaderModule(code, computeShaderModule);
+		computePipeline = GetComputePipeline(workgroupSize);
+		CreateFilterPipelines();
+		if (settings.wavefront)
+			CreateWavefrontPipelines();
+	}
+	catch (const std::runtime_error& e)
+	{
+		// The lookups find the previous pipelines again.
+		std::cerr << e.what() << " Keeping the running shader." << std::endl;
+		pipelineVariants = std::move(previous);
+		computePipeline = GetComputePipeline(workgroupSize);
+		CreateFilterPipelines();
+		if (settings.wavefront)
+			CreateWavefrontPipelines();
+		return true;
+	}
+
+	fprintf(stdout, "Reloaded %s, created its pipelines in %.1f ms\n", settings.shaderPath.c_str(), 1000.0 * (GetTime() - begin));
+	ResetAccumulation();
+	return true;
+}
+
+// Builds the pipeline of the current shader variant on first use, later calls return the same one.
+VkPipeline Application::GetComputePipeline(WorkgroupSize size, ShaderPass pass)
+{
+	PipelineKey key = { pass, size.x, size.y, shaderVariant };
+
+	auto& pipeline = pipelineVariants[key];
+	if (!pipeline)
+	{
+		pipeline.reset(new VKDeleter<VkPipeline>(logicalDevice, vkDestroyPipeline));
+		CreateComputePipeline(computeShaderModule, size, *pipeline, pass);
+	}
+
+	return *pipeline;
+}
+
+// Takes the shading constants from the settings & looks which features the scene uses, the shader drops the code of the others.
+void Application::ChooseShaderVariant(const std::vector<Planee>& planes, const std::vector<Sphere>& spheres, const std::vector<Mesh>& meshes)
+{
+	shaderVariant.maxBounces = int32_t(settings.maxBounces);
+	shaderVariant.shadow = settings.shadow;
+	shaderVariant.epsilon = settings.epsilon;
+	shaderVariant.rouletteDepth = int32_t(settings.rouletteDepth);
+	shaderVariant.pathStats = settings.pathStats ? 1 : 0;
+	shaderVariant.denoiseIterations = int32_t(settings.denoiseIterations);
+	shaderVariant.temporal = settings.temporal ? 1 : 0;
+	shaderVariant.adaptiveThreshold = settings.adaptiveThreshold;
+	shaderVariant.adaptive = settings.adaptiveThreshold > 0.0f ? 1 : 0;
+	shaderVariant.upscaleFilter = int32_t(settings.upscaleFilter);
+	shaderVariant.interleave = int32_t(settings.interleave);
+
+	std::set<int> types;
+	for (const auto& plane : planes)
+		types.insert(plane.mat.type);
+	for (const auto& sphere : spheres)
+		types.insert(sphere.mat.type);
+	for (const auto& instance : instances.GetInstances())
+		types.insert(instance.overrideMaterial ? instance.mat.type : meshes[instance.mesh].mat.type);
+
+	shaderVariant.hasPlanes = planes.empty() ? 0 : 1;
+	shaderVariant.hasDiffuse = types.count(1) ? 1 : 0;
+	shaderVariant.hasSpecular = types.count(2) ? 1 : 0;
+
+	// Other types are shaded by neither branch, which only holds while the shader still looks at the type.
+	if (types.size() > size_t(shaderVariant.hasDiffuse + shaderVariant.hasSpecular))
+		shaderVariant.hasDiffuse = shaderVariant.hasSpecular = 1;
+
+	fprintf(stdout, "Shader variant: %d bounces (roulette after %d), shadow %.2f, epsilon %g, %s planes, %s diffuse & %s mirror materials, "
+		"%d denoise iterations, %s temporal reprojection, adaptive threshold %g, %s upscaling, %d interleave phases\n",
+		shaderVariant.maxBounces, shaderVariant.rouletteDepth, shaderVariant.shadow, shaderVariant.epsilon,
+		shaderVariant.hasPlanes ? "with" : "without", shaderVariant.hasDiffuse ? "with" : "without",
+		shaderVariant.hasSpecular ? "with" : "without", shaderVariant.denoiseIterations, shaderVariant.temporal ? "with" : "without",
+		shaderVariant.adaptiveThreshold, shaderVariant.upscaleFilter == UpscaleEdge ? "edge-aware" : "bilinear",
+		shaderVariant.interleave);
+}
+
+void Application::CreateComputePipeline(const VKDeleter<VkShaderModule>& shaderModule, WorkgroupSize size, VKDeleter<VkPipeline>& pipeline,
+	ShaderPass pass)
+{
+	struct Specialization
+	{
+		uint32_t x, y;
+		int32_t pass;
+		int32_t sharedPlanes, sharedSpheres, sharedNodes;
+		ShaderVariant variant;
+	} constants = { size.x, size.y, int32_t(pass), int32_t(sharedStaging.planes), int32_t(sharedStaging.spheres), int32_t(sharedStaging.nodes),
+		shaderVariant };
+
+	// local_size_x_id = 0, local_size_y_id = 1, Pass, the shared memory staging & the shader variant in the shader.
+	std::vector<VkSpecializationMapEntry> specializationEntries =
+	{
+		Initializers::SpecializationMapEntry(0, offsetof(Specialization, x), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(1, offsetof(Specialization, y), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(2, offsetof(Specialization, pass), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(3, offsetof(Specialization, sharedPlanes), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(4, offsetof(Specialization, sharedSpheres), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(5, offsetof(Specialization, sharedNodes), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(6, offsetof(Specialization, variant.maxBounces), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(7, offsetof(Specialization, variant.shadow), sizeof(float)),
+		Initializers::SpecializationMapEntry(8, offsetof(Specialization, variant.epsilon), sizeof(float)),
+		Initializers::SpecializationMapEntry(9, offsetof(Specialization, variant.hasPlanes), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(10, offsetof(Specialization, variant.hasDiffuse), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(11, offsetof(Specialization, variant.hasSpecular), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(12, offsetof(Specialization, variant.rouletteDepth), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(13, offsetof(Specialization, variant.pathStats), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(14, offsetof(Specialization, variant.denoiseIterations), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(15, offsetof(Specialization, variant.temporal), sizeof(uint32_t)),
+		Initializers::SpecializationMapEntry(16, offsetof(Specialization, variant.adaptiveThreshold), sizeof(float)),
+		Initializers::SpecializationMapEntry(17, offsetof(Specialization, variant.upscaleFilter), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(18, offsetof(Specialization, variant.interleave), sizeof(int32_t)),
+		Initializers::SpecializationMapEntry(19, offsetof(Specialization, variant.adaptive), sizeof(uint32_t))
+	};
+	auto specializationInfo = Initializers::SpecializationInfo(specializationEntries, sizeof(constants), &constants);
 
 	auto computeStageInfo = Initializers::PipelineShaderStageCreateInfo();
 	computeStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	computeStageInfo.module = computeShaderModule;
+	computeStageInfo.module = shaderModule;
 	// Entry point of the shader.
 	computeStageInfo.pName = "main";
+	computeStageInfo.pSpecializationInfo = &specializationInfo;
 
 	auto pipelineInfo = Initializers::ComputePipelineCreateInfo();
 	pipelineInfo.stage = computeStageInfo;
 	pipelineInfo.layout = computePipelineLayout;
 
-	// ToDo: Create Pipeline Cache to accelerate pipeline creation.
-	// See "Accelerating Pipeline Creation" in the Vulkan Programming Guide book.
-	auto result = vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, computePipeline.Replace());
+	auto start = std::chrono::steady_clock::now();
+	auto result = vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.Replace());
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create Compute Pipelines !");
+
+	pipelineSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	pipelineCount++;
+}
+
+// Starts from the cache file of the last run if it was written for this device & driver (warm start), empty otherwise (cold start).
+void Application::CreatePipelineCache()
+{
+	if (settings.pipelineCachePath.empty())
+		return;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::string reason;
+	auto data = PipelineCacheFile(settings.pipelineCachePath, properties).Load(reason);
+
+	auto createInfo = Initializers::PipelineCacheCreateInfo(data.size(), data.data());
+
+	pipelineCacheWarm = !data.empty() && vkCreatePipelineCache(logicalDevice, &createInfo, nullptr, pipelineCache.Replace()) == VK_SUCCESS;
+	if (pipelineCacheWarm)
+	{
+		std::cout << "Loaded " << data.size() << " bytes of pipelines from " << settings.pipelineCachePath << std::endl;
+		return;
+	}
+
+	if (!data.empty())
+		reason = "rejected by the driver";
+	std::cout << "Starting with an empty pipeline cache, " << settings.pipelineCachePath << ": " << reason << std::endl;
+
+	createInfo = Initializers::PipelineCacheCreateInfo(0, nullptr);
+	if (vkCreatePipelineCache(logicalDevice, &createInfo, nullptr, pipelineCache.Replace()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create the pipeline cache !");
+}
+
+void Application::StorePipelineCache()
+{
+	if (pipelineCache == VK_NULL_HANDLE)
+		return;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, data.data()) != VK_SUCCESS)
+		return;
+	data.resize(size);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	if (PipelineCacheFile(settings.pipelineCachePath, properties).Store(data))
+		std::cout << "Wrote " << data.size() << " bytes of pipelines to " << settings.pipelineCachePath << std::endl;
+	else
+		std::cerr << "Failed to write the pipeline cache " << settings.pipelineCachePath << std::endl;
+}
+
+// Compare a first run (or one with --no-pipeline-cache) against the next to see what the cache saves.
+void Application::ReportStartup(double seconds)
+{
+	const char* cache = settings.pipelineCachePath.empty() ? "no" : pipelineCacheWarm ? "warm" : "cold";
+	fprintf(stdout, "Startup took %.1f ms, %.1f ms of it creating %u pipelines (%s pipeline cache)\n",
+		1000.0 * seconds, 1000.0 * pipelineSeconds, pipelineCount, cache);
 }
 
 
@@ -713,14 +1803,75 @@ void Application::RecordComputeCommandBuffer()
 	vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout,
 		0, 1, &computeDescriptorSets[0], 0, 0);
 
-	vkCmdDispatch(computeCommandBuffer, swapChainExtent.width, swapChainExtent.height, 1);
+	gpuTimer.Reset(computeCommandBuffer);
 
-	// set a image memory barrier for each image seperatly.
-	SetFirstImageBarriers(computeCommandBuffer, curImageIndex);
+	// The samples of the previous frame have to be written before this one adds to them.
+	auto accumulate = Initializers::ImageMemoryBarrier(accumulationImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+	accumulate.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	accumulate.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	accumulate.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &accumulate);
 
-	CopyImageMemory(computeCommandBuffer, curImageIndex);
+	if (settings.headless)
+	{
+		// Nothing to copy to, simply keep the compute image in the general layout for the next dispatch.
+		auto compWrite = Initializers::ImageMemoryBarrier(computeImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		compWrite.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		compWrite.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		compWrite.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &compWrite);
+
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingDispatch, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		RecordTrace(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingReconstruct, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordReconstruct(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingConverge, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordConverge(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingTemporal, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordTemporal(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingDenoise, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordDenoise(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingUpscale, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordUpscale(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingUpscale + 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+	else
+	{
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingDispatch, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		RecordTrace(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingReconstruct, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordReconstruct(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingConverge, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordConverge(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingTemporal, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordTemporal(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingDenoise, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordDenoise(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingUpscale, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		RecordUpscale(computeCommandBuffer);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingImageBarriers, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		// set a image memory barrier for each image seperatly.
+		SetFirstImageBarriers(computeCommandBuffer, curImageIndex);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingCopy, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		CopyImageMemory(computeCommandBuffer, curImageIndex);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingPresentBarrier, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		SetSecondImageBarriers(computeCommandBuffer, curImageIndex);
+		gpuTimer.WriteTimestamp(computeCommandBuffer, TimingPresentBarrier + 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
 
-	SetSecondImageBarriers(computeCommandBuffer, curImageIndex);
+	// The path counters are read on the host once the fence signals, see CollectPathStats.
+	if (settings.pathStats)
+	{
+		auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+		vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
 
 	result = vkEndCommandBuffer(computeCommandBuffer);
 	if (result != VK_SUCCESS)
@@ -733,6 +1884,585 @@ void Application::CreateComputeFence()
 
 	vkCreateFence(logicalDevice, &info, nullptr, computeFence.Replace());
 }
+
+void Application::RecordDispatch(const VkCommandBuffer buffer, WorkgroupSize size, bool interleaved)
+{
+	// One invocation per pixel traced, rounded up to whole workgroups. Interleaved frames trace every 2nd pixel of a row,
+	// 4 phases also only every 2nd row, see InterleavedPixel in the shader.
+	uint32_t width = renderExtent.width;
+	uint32_t height = renderExtent.height;
+	if (interleaved && settings.interleave > 1)
+		width = (width + 1) / 2;
+	if (interleaved && settings.interleave == 4)
+		height = (height + 1) / 2;
+
+	vkCmdDispatch(buffer, WorkgroupTuner::GroupCount(width, size.x), WorkgroupTuner::GroupCount(height, size.y), 1);
+}
+
+void Application::RecordTrace(const VkCommandBuffer buffer)
+{
+	if (settings.wavefront)
+		RecordWavefront(buffer);
+	// One workgroup per tile the converge pass of the frame before listed.
+	else if (settings.adaptiveThreshold > 0.0f)
+		vkCmdDispatchIndirect(buffer, adaptiveTilesBuffer, 0);
+	else
+		RecordDispatch(buffer, workgroupSize, true);
+}
+#pragma endregion
+
+
+#pragma region Denoising
+// The passes over the finished samples of a frame, see RecordReconstruct, RecordConverge, RecordTemporal, RecordDenoise & RecordUpscale.
+void Application::CreateFilterPipelines()
+{
+	if (settings.temporal)
+		temporalPipeline = GetComputePipeline(workgroupSize, PassTemporal);
+	if (settings.denoiseIterations > 0)
+		denoisePipeline = GetComputePipeline(workgroupSize, PassDenoise);
+	if (settings.adaptiveThreshold > 0.0f)
+		convergePipeline = GetComputePipeline(workgroupSize, PassConverge);
+	if (DynamicResolution())
+		upscalePipeline = GetComputePipeline(workgroupSize, PassUpscale);
+	if (settings.interleave > 1)
+		reconstructPipeline = GetComputePipeline(workgroupSize, PassReconstruct);
+}
+
+void Application::PrepareDenoiseBuffers()
+{
+	// Every binding needs a buffer, even without the denoiser.
+	VkDeviceSize pixels = (settings.denoiseIterations > 0 || settings.temporal) ? VkDeviceSize(WIDTH) * HEIGHT : 1;
+
+	// Sizes of GBufferTexel & the two ping-pong images of iterations in between, see the denoise pass in shaders/raytracing.comp.
+	// Temporal reprojection keeps the G-buffer of the frame before as well.
+	VkDeviceSize gbufferSize = (settings.temporal ? 2 : 1) * pixels * 32;
+	VkDeviceSize denoiseSize = 2 * pixels * 16;
+
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	CreateStorageBuffer(nullptr, gbufferSize, gbufferBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, gbufferDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, denoiseSize, denoiseBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, denoiseDeviceMemory, memTypeIndex);
+}
+
+// One a-trous iteration per dispatch, each reads what the one before wrote. The last one writes the compute image.
+void Application::RecordDenoise(const VkCommandBuffer buffer)
+{
+	if (settings.denoiseIterations == 0)
+		return;
+
+	auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	WavefrontConstants constants = {};
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, denoisePipeline);
+	for (uint32_t iteration = 0; iteration < settings.denoiseIterations; iteration++)
+	{
+		// The first iteration reads the accumulation image & the G-buffer the trace just wrote.
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		constants.denoiseIteration = int32_t(iteration);
+		vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		RecordDispatch(buffer, workgroupSize);
+	}
+}
+#pragma endregion
+
+
+#pragma region Temporal Reprojection
+void Application::PrepareTemporalBuffers(const std::vector<Matrix4>& instanceMotion)
+{
+	// Every binding needs a buffer, even without temporal reprojection or instances.
+	VkDeviceSize pixels = settings.temporal ? VkDeviceSize(WIDTH) * HEIGHT : 1;
+	std::vector<Matrix4> motion = instanceMotion;
+	motion.resize(std::max<size_t>(motion.size(), 1));
+
+	// Motion vectors & history of this frame & the one before, a vec4 per pixel each.
+	VkDeviceSize instanceMotionSize = motion.size() * sizeof(Matrix4);
+	VkDeviceSize motionSize = 2 * pixels * 16;
+	VkDeviceSize historySize = 2 * pixels * 16;
+
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	CreateStorageBuffer(motion.data(), instanceMotionSize, instanceMotionBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		instanceMotionDeviceMemory, memTypeIndex);
+
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	CreateStorageBuffer(nullptr, motionSize, motionBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, motionDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, historySize, historyBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, historyDeviceMemory, memTypeIndex);
+}
+
+// Blends the samples of the frame into the reprojected history & writes the compute image, the denoiser filters it after.
+void Application::RecordTemporal(const VkCommandBuffer buffer)
+{
+	if (!settings.temporal)
+		return;
+
+	// Reads the accumulation image, G-buffer & motion vectors the trace just wrote.
+	auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	WavefrontConstants constants = {};
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipeline);
+	vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	RecordDispatch(buffer, workgroupSize);
+}
+
+// Motion vectors point back to the camera of the frame before.
+void Application::UpdateCamera()
+{
+	std::copy(app.camera, app.camera + 4, app.previousCamera);
+
+	CameraPose pose = settings.orbit ? CameraPose::Orbit(app.frame) : CameraPose();
+	app.camera[0] = pose.position.x;
+	app.camera[1] = pose.position.y;
+	app.camera[2] = pose.position.z;
+	app.camera[3] = pose.yaw;
+}
+#pragma endregion
+
+
+#pragma region Adaptive Sampling
+void Application::PrepareAdaptiveBuffers()
+{
+	// Every binding needs a buffer, even without adaptive sampling.
+	VkDeviceSize pixels = settings.adaptiveThreshold > 0.0f ? VkDeviceSize(WIDTH) * HEIGHT : 1;
+
+	// The workgroup size isn't tuned yet, so the tile list holds as many tiles as a 1x1 workgroup would need. It starts out as
+	// every tile in order, which makes a full dispatch over it (i.e. while tuning) trace the whole image.
+	std::vector<uint32_t> tiles(4 + pixels);
+	for (size_t i = 0; i < pixels; i++)
+		tiles[4 + i] = uint32_t(i);
+	tiles[1] = tiles[2] = 1;
+
+	VkDeviceSize momentsSize = pixels * sizeof(float);
+	VkDeviceSize tilesSize = tiles.size() * sizeof(uint32_t);
+
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	CreateStorageBuffer(nullptr, momentsSize, momentsBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, momentsDeviceMemory, memTypeIndex);
+
+	// Written by the host whenever the accumulation starts over & its tile count read back after every frame.
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	CreateStorageBuffer(tiles.data(), tilesSize, adaptiveTilesBuffer,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		adaptiveTilesDeviceMemory, memTypeIndex);
+}
+
+// Rebuilds the tile list from the samples the trace just added & shows the accumulated image, traced or not.
+void Application::RecordConverge(const VkCommandBuffer buffer)
+{
+	if (settings.adaptiveThreshold <= 0.0f)
+		return;
+
+	// The trace is done reading the tile list before it is cleared.
+	auto indirectRead = Initializers::GlobalMemoryBarrier(0, VK_ACCESS_TRANSFER_WRITE_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &indirectRead, 0, nullptr, 0, nullptr);
+	vkCmdFillBuffer(buffer, adaptiveTilesBuffer, 0, sizeof(uint32_t), 0);
+
+	// Reads the accumulation image & moments the trace just wrote.
+	auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	WavefrontConstants constants = {};
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, convergePipeline);
+	vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	RecordDispatch(buffer, workgroupSize);
+
+	// The next frame dispatches the list & the host reads its tile count once the fence signals.
+	auto tilesWritten = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &tilesWritten, 0, nullptr, 0, nullptr);
+}
+
+// One tile per workgroup of a full dispatch.
+uint32_t Application::GetAdaptiveTileTotal() const
+{
+	return WorkgroupTuner::GroupCount(renderExtent.width, workgroupSize.x) * WorkgroupTuner::GroupCount(renderExtent.height, workgroupSize.y);
+}
+
+// Called before every frame is submitted, the frame before is done. Lists all tiles again if the accumulation starts over,
+// otherwise the frame traces the tiles the last converge pass left.
+void Application::UpdateAdaptiveTiles()
+{
+	if (settings.adaptiveThreshold <= 0.0f)
+		return;
+
+	uint32_t total = GetAdaptiveTileTotal();
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	if (total > properties.limits.maxComputeWorkGroupCount[0])
+		throw std::runtime_error("Adaptive sampling needs more tiles than one dispatch can have, use a larger --workgroup !");
+
+	void* mapped = nullptr;
+	auto result = vkMapMemory(logicalDevice, adaptiveTilesDeviceMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to map adaptive tile memory !");
+
+	auto tiles = static_cast<uint32_t*>(mapped);
+	if (app.sampleCount == 0)
+	{
+		tiles[0] = total;
+		for (uint32_t i = 0; i < total; i++)
+			tiles[4 + i] = i;
+	}
+	adaptiveTileCount = tiles[0];
+
+	vkUnmapMemory(logicalDevice, adaptiveTilesDeviceMemory);
+}
+#pragma endregion
+
+
+#pragma region Dynamic Resolution
+bool Application::DynamicResolution() const
+{
+	return settings.renderScale < 1.0f || settings.targetMs > 0.0f;
+}
+
+// Takes effect with the next recorded command buffer & uniform upload, a new size starts the accumulation over.
+void Application::SetRenderScale(float scale)
+{
+	renderExtent = { ScaledSize(WIDTH, scale), ScaledSize(HEIGHT, scale) };
+	app.renderSize[0] = int32_t(renderExtent.width);
+	app.renderSize[1] = int32_t(renderExtent.height);
+	std::copy(app.renderSize, app.renderSize + 2, app.imageSize);
+}
+
+// Called once the timestamps of a frame are collected, returns whether the governor changed the render size.
+bool Application::UpdateRenderScale()
+{
+	if (!renderScaleGovernor || !renderScaleGovernor->Update(gpuTimer.GetLastMs()))
+		return false;
+
+	SetRenderScale(renderScaleGovernor->GetScale());
+	return true;
+}
+
+// Stretches the traced pixels of the compute image over the upscaled image, which is shown & saved instead.
+void Application::RecordUpscale(const VkCommandBuffer buffer)
+{
+	if (!DynamicResolution())
+		return;
+
+	// Reads what the trace or the last filter pass wrote, the copy of the frame before is done with the upscaled image.
+	auto computeRead = Initializers::ImageMemoryBarrier(computeImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+	computeRead.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	computeRead.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	computeRead.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	auto upscaledWrite = Initializers::ImageMemoryBarrier(upscaledImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	upscaledWrite.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	upscaledWrite.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	upscaledWrite.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+	std::vector<VkImageMemoryBarrier> barriers{ computeRead, upscaledWrite };
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+	// One invocation per output pixel.
+	WavefrontConstants constants = {};
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, upscalePipeline);
+	vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(buffer, WorkgroupTuner::GroupCount(WIDTH, workgroupSize.x), WorkgroupTuner::GroupCount(HEIGHT, workgroupSize.y), 1);
+}
+
+VkImage Application::GetOutputImage() const
+{
+	return DynamicResolution() ? upscaledImage : computeImage;
+}
+#pragma endregion
+
+
+#pragma region Interleaved Rendering
+// Fills in the pixels the interleaved trace left out, from their own samples or the traced pixels around them.
+void Application::RecordReconstruct(const VkCommandBuffer buffer)
+{
+	if (settings.interleave <= 1)
+		return;
+
+	// Reads the compute & accumulation images the trace just wrote.
+	auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// One invocation per pixel, the traced ones return right away.
+	WavefrontConstants constants = {};
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, reconstructPipeline);
+	vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	RecordDispatch(buffer, workgroupSize);
+}
+#pragma endregion
+
+
+#pragma region Wavefront
+void Application::CreateWavefrontPipelines()
+{
+	wavefrontGroupSize = workgroupSize.x * workgroupSize.y;
+	WorkgroupSize size = { wavefrontGroupSize, 1 };
+
+	generatePipeline = GetComputePipeline(size, PassGenerate);
+	extendPipeline = GetComputePipeline(size, PassExtend);
+	shadePipeline = GetComputePipeline(size, PassShade);
+	connectPipeline = GetComputePipeline(size, PassConnect);
+	resolvePipeline = GetComputePipeline(size, PassResolve);
+
+	if (settings.sortRays)
+	{
+		sortKeysPipeline = GetComputePipeline(size, PassSortKeys);
+		sortScanPipeline = GetComputePipeline(size, PassSortScan);
+		sortScatterPipeline = GetComputePipeline(size, PassSortScatter);
+	}
+
+	std::cout << "Wavefront passes with " << wavefrontGroupSize << " invocations per workgroup" << std::endl;
+}
+
+void Application::PrepareWavefrontBuffers()
+{
+	// The megakernel never touches the queues, but every binding needs a buffer.
+	VkDeviceSize capacity = settings.wavefront ? VkDeviceSize(WIDTH) * HEIGHT : 1;
+
+	// Ray sorting adds a sorted copy of the ray & shadow queues and a key & rank per entry.
+	VkDeviceSize sortCapacity = settings.sortRays ? capacity : 1;
+	VkDeviceSize copies = settings.sortRays ? 1 : 0;
+
+	// Sizes of WavefrontRay, Hit, ShadowRay & the radiance of a pixel in shaders/raytracing.comp.
+	VkDeviceSize raySize = (2 + copies) * capacity * 48;
+	VkDeviceSize hitSize = capacity * 16;
+	VkDeviceSize shadowRaySize = (1 + copies) * capacity * 64;
+	VkDeviceSize pixelRadianceSize = capacity * 16;
+	VkDeviceSize queueSize = sizeof(WavefrontQueues);
+	VkDeviceSize sortSize = 2 * SortBins * sizeof(uint32_t) + sortCapacity * 2 * sizeof(uint32_t);
+
+	// Only the GPU reads & writes the queues.
+	int memTypeIndex = 0;
+	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	CreateStorageBuffer(nullptr, raySize, rayBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, rayDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, hitSize, hitBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hitDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, shadowRaySize, shadowRayBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, shadowRayDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, pixelRadianceSize, pixelRadianceBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pixelRadianceDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, queueSize, queueBuffer,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, queueDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nullptr, sortSize, sortBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sortDeviceMemory, memTypeIndex);
+}
+
+void Application::RecordWavefront(const VkCommandBuffer buffer)
+{
+	uint32_t pixels = renderExtent.width * renderExtent.height;
+	uint32_t generateGroups = WorkgroupTuner::GroupCount(pixels, wavefrontGroupSize);
+	VkDeviceSize shadowCountOffset = offsetof(WavefrontQueues, shadowCount);
+	VkDeviceSize shadowDispatchOffset = offsetof(WavefrontQueues, shadowDispatch);
+	uint32_t emptyCount = 0;
+	WavefrontDispatch emptyDispatch = { 0, 1, 1, 0 };
+
+	// All passes run once per sample of the frame, the resolve pass adds each one to the accumulation image.
+	for (uint32_t sample = 0; sample < app.samplesPerPixel; sample++)
+	{
+		WavefrontConstants constants = { 0, sample, 0, 0, 0 };
+
+		// Generate fills the first queue with one path per pixel, all other queues start empty.
+		WavefrontQueues queues = {};
+		queues.rayCount[0] = pixels;
+		queues.rayDispatch[0] = { generateGroups, 1, 1, 0 };
+		queues.rayDispatch[1] = emptyDispatch;
+		queues.shadowDispatch = emptyDispatch;
+		vkCmdUpdateBuffer(buffer, queueBuffer, 0, sizeof(queues), &queues);
+		vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		RecordWavefrontBarrier(buffer);
+
+		vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, generatePipeline);
+		vkCmdDispatch(buffer, generateGroups, 1, 1);
+		RecordWavefrontBarrier(buffer);
+
+		for (int bounce = 0; bounce < shaderVariant.maxBounces; bounce++)
+		{
+			// Bounces read from one queue & append the paths that go on to the other.
+			constants.queue = bounce % 2;
+			int32_t next = 1 - constants.queue;
+			VkDeviceSize dispatchOffset = offsetof(WavefrontQueues, rayDispatch) + constants.queue * sizeof(WavefrontDispatch);
+
+			// Primary rays leave the camera in pixel order, which is as coherent as it gets.
+			constants.readSorted = (sortRays && bounce > 0) ? 1 : 0;
+			if (constants.readSorted)
+				RecordSort(buffer, constants, false);
+			vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, extendPipeline);
+			vkCmdDispatchIndirect(buffer, queueBuffer, dispatchOffset);
+			RecordWavefrontBarrier(buffer);
+
+			// The previous bounce is done reading the next queue, empty it.
+			vkCmdUpdateBuffer(buffer, queueBuffer, offsetof(WavefrontQueues, rayCount) + next * sizeof(uint32_t), sizeof(emptyCount), &emptyCount);
+			vkCmdUpdateBuffer(buffer, queueBuffer, offsetof(WavefrontQueues, rayDispatch) + next * sizeof(WavefrontDispatch),
+				sizeof(emptyDispatch), &emptyDispatch);
+			RecordWavefrontBarrier(buffer);
+
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadePipeline);
+			vkCmdDispatchIndirect(buffer, queueBuffer, dispatchOffset);
+			RecordWavefrontBarrier(buffer);
+
+			// Paths bounce off diffuse surfaces, so every bounce connects its own shadow rays.
+			if (sortRays)
+			{
+				WavefrontConstants shadowConstants = constants;
+				shadowConstants.readSorted = 1;
+				RecordSort(buffer, shadowConstants, true);
+				vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(shadowConstants), &shadowConstants);
+			}
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, connectPipeline);
+			vkCmdDispatchIndirect(buffer, queueBuffer, shadowDispatchOffset);
+			RecordWavefrontBarrier(buffer);
+
+			vkCmdUpdateBuffer(buffer, queueBuffer, shadowCountOffset, sizeof(emptyCount), &emptyCount);
+			vkCmdUpdateBuffer(buffer, queueBuffer, shadowDispatchOffset, sizeof(emptyDispatch), &emptyDispatch);
+			RecordWavefrontBarrier(buffer);
+		}
+
+		vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, resolvePipeline);
+		vkCmdDispatch(buffer, generateGroups, 1, 1);
+		RecordWavefrontBarrier(buffer);
+	}
+}
+
+void Application::RecordWavefrontBarrier(const VkCommandBuffer buffer)
+{
+	// Queue entries, counters & dispatch arguments written by one pass or update are read by the next one.
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	auto barrier = Initializers::GlobalMemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	vkCmdPipelineBarrier(buffer, stages, stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Counting sort of the current ray queue or the shadow queue into its sorted copy, see the sort passes in shaders/raytracing.comp.
+void Application::RecordSort(const VkCommandBuffer buffer, WavefrontConstants constants, bool shadows)
+{
+	VkDeviceSize dispatchOffset = shadows ? offsetof(WavefrontQueues, shadowDispatch)
+		: offsetof(WavefrontQueues, rayDispatch) + constants.queue * sizeof(WavefrontDispatch);
+
+	constants.sortShadows = shadows ? 1 : 0;
+	constants.readSorted = 0;
+	vkCmdPushConstants(buffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	vkCmdFillBuffer(buffer, sortBuffer, 0, SortBins * sizeof(uint32_t), 0);
+	RecordWavefrontBarrier(buffer);
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortKeysPipeline);
+	vkCmdDispatchIndirect(buffer, queueBuffer, dispatchOffset);
+	RecordWavefrontBarrier(buffer);
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortScanPipeline);
+	vkCmdDispatch(buffer, 1, 1, 1);
+	RecordWavefrontBarrier(buffer);
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sortScatterPipeline);
+	vkCmdDispatchIndirect(buffer, queueBuffer, dispatchOffset);
+	RecordWavefrontBarrier(buffer);
+}
+#pragma endregion
+
+
+#pragma region Workgroup Tuning
+void Application::ChooseWorkgroupSize(const VKDeleter<VkShaderModule>& shaderModule)
+{
+	if (settings.workgroupX > 0)
+	{
+		workgroupSize = { settings.workgroupX, settings.workgroupY };
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	WorkgroupTuner tuner(settings.workgroupCachePath, properties);
+	if (!settings.retune && tuner.LoadCached(workgroupSize))
+	{
+		std::cout << "Workgroup size " << workgroupSize.x << "x" << workgroupSize.y << " (cached)" << std::endl;
+		return;
+	}
+
+	double bestMs = 0.0;
+	for (const auto& candidate : WorkgroupTuner::GetCandidates(properties.limits))
+	{
+		double ms = TimeWorkgroupSize(shaderModule, candidate);
+		fprintf(stdout, "Workgroup size %2ux%-2u: %8.3f ms\n", candidate.x, candidate.y, ms);
+
+		if (bestMs == 0.0 || ms < bestMs)
+		{
+			bestMs = ms;
+			workgroupSize = candidate;
+		}
+	}
+
+	std::cout << "Workgroup size " << workgroupSize.x << "x" << workgroupSize.y << " is the fastest, cached in "
+		<< settings.workgroupCachePath << std::endl;
+	tuner.StoreCached(workgroupSize);
+}
+
+double Application::TimeWorkgroupSize(const VKDeleter<VkShaderModule>& shaderModule, WorkgroupSize size)
+{
+	const int Runs = 8;
+
+	VKDeleter<VkPipeline> pipeline{ logicalDevice, vkDestroyPipeline };
+	CreateComputePipeline(shaderModule, size, pipeline);
+
+	GpuTimer timer(logicalDevice);
+	auto indices = FindQueueFamilies(physicalDevice, surface);
+	timer.Create(physicalDevice, indices.computeFamily, { "dispatch" });
+
+	auto beginInfo = Initializers::CommandBufferBeginInfo(0);
+	vkBeginCommandBuffer(computeCommandBuffer, &beginInfo);
+
+	// The image content is irrelevant here, it only has to be in the general layout.
+	auto barrier = Initializers::ImageMemoryBarrier(computeImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkCmdBindPipeline(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout,
+		0, 1, &computeDescriptorSets[0], 0, 0);
+
+	timer.Reset(computeCommandBuffer);
+	timer.WriteTimestamp(computeCommandBuffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	RecordDispatch(computeCommandBuffer, size, true);
+	timer.WriteTimestamp(computeCommandBuffer, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	auto result = vkEndCommandBuffer(computeCommandBuffer);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Workgroup tuning Command Buffer Recording couldn't be ended !");
+
+	// The fastest run counts, the first one usually pays for shader compilation & cache warm up.
+	double bestMs = 0.0;
+	for (int i = 0; i < Runs; i++)
+	{
+		auto submitInfo = Initializers::SubmitInfo(&computeCommandBuffer);
+		auto begin = GetTime();
+
+		result = vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit the workgroup tuning Command Buffer !");
+		vkQueueWaitIdle(computeQueue);
+
+		double ms = 1000.0 * (GetTime() - begin);
+		if (timer.Enabled())
+		{
+			timer.Collect();
+			ms = timer.GetStageTimings()[0].minMs;
+		}
+
+		if (i == 0 || ms < bestMs)
+			bestMs = ms;
+	}
+
+	return bestMs;
+}
 #pragma endregion
 
 
@@ -754,7 +2484,7 @@ void Application::SetFirstImageBarriers(const VkCommandBuffer buffer, int curIma
 	compWrite.srcAccessMask = 0;
 	compWrite.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 
-	auto compTransfer = Initializers::ImageMemoryBarrier(computeImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	auto compTransfer = Initializers::ImageMemoryBarrier(GetOutputImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 	compTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	compTransfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 	compTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
@@ -792,7 +2522,7 @@ void Application::CopyImageMemory(const VkCommandBuffer buffer, int curImageInde
 	copy.dstOffset = { 0, 0, 0 };
 
 
-	vkCmdCopyImage(buffer, computeImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImages[curImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+	vkCmdCopyImage(buffer, GetOutputImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImages[curImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
 }
 
 void Application::SetSecondImageBarriers(const VkCommandBuffer buffer, int curImageIndex)
@@ -829,22 +2559,105 @@ void Application::PrepareStorageBuffers()
 {
 	std::vector<Planee> planes;
 	std::vector<Sphere> spheres;
-	InitGameObjects(planes, spheres);
+	std::vector<Mesh> meshes;
+	std::vector<Light> lights;
+	InitGameObjects(planes, spheres, meshes, instances, lights);
+	ChooseShaderVariant(planes, spheres, meshes);
+
+	// Reorders the spheres & triangles to match the leaves of their hierarchies, the mesh nodes follow the sphere nodes.
+	Bvh bvh(spheres);
+	std::vector<BvhNode> nodes = bvh.GetNodes();
+	// Staging takes the top levels of the sphere hierarchy, which breadth first order puts in front.
+	if (settings.sharedStaging)
+		nodes = Bvh::BreadthFirst(nodes);
+	size_t sphereNodeCount = nodes.size();
+	MeshBuffers meshBuffers(meshes, int32_t(nodes.size()));
+	nodes.insert(nodes.end(), meshBuffers.nodes.begin(), meshBuffers.nodes.end());
+
+	PrimitiveBuffers primitives(planes, spheres);
+	ReportPrimitiveLayout(primitives);
+	ChooseSharedStaging(primitives, sphereNodeCount);
+
+	app.instanceCount = int32_t(instances.Count());
+	app.sampler = settings.sampler;
+	app.samplesPerPixel = settings.samplesPerPixel;
+	UpdateCamera();
+	std::copy(app.camera, app.camera + 4, app.previousCamera);
+	if (settings.targetMs > 0.0f)
+		renderScaleGovernor.reset(new RenderScaleGovernor(settings.targetMs, MinRenderScale, settings.renderScale));
+	SetRenderScale(settings.renderScale);
+	std::copy(app.renderSize, app.renderSize + 2, app.previousRenderSize);
+
+	// Storage buffers can't be empty either, the mask is only generated for the blue noise sampler.
+	Sampler sampler(settings.sampler);
+	std::vector<float> blueNoise = sampler.GetBlueNoise();
+	blueNoise.resize(std::max<size_t>(blueNoise.size(), 1));
+
+	// Storage buffers can't be empty, scenes without meshes get a single unused entry.
+	std::vector<MeshInstance> meshInstances = instances.GetInstances();
+	if (meshBuffers.meshes.empty())
+	{
+		meshBuffers.vertices.resize(1);
+		meshBuffers.indices.resize(3);
+		meshBuffers.meshes.resize(1);
+		meshInstances.resize(1);
+	}
+	// A light without emission in scenes without lights.
+	if (lights.empty())
+		lights.push_back(Light::Point(Vector3(), Vector3()));
 
 	int memTypeIndex = 0;
 	GetMemoryProperties(memTypeIndex, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
-	VkDeviceSize spBufferSize = spheres.size() * sizeof(Sphere);
-	VkDeviceSize plBufferSize = planes.size() * sizeof(Planee);
+	VkDeviceSize spBufferSize = primitives.spheres.size() * sizeof(PrimitiveGeometry);
+	VkDeviceSize plBufferSize = primitives.planes.size() * sizeof(PrimitiveGeometry);
+	VkDeviceSize materialBufferSize = primitives.materials.size() * sizeof(Material);
+	VkDeviceSize lightBufferSize = lights.size() * sizeof(Light);
+	VkDeviceSize bvhBufferSize = nodes.size() * sizeof(BvhNode);
+	VkDeviceSize vertexBufferSize = meshBuffers.vertices.size() * sizeof(MeshVertex);
+	VkDeviceSize indexBufferSize = meshBuffers.indices.size() * sizeof(uint32_t);
+	VkDeviceSize meshBufferSize = meshBuffers.meshes.size() * sizeof(MeshInfo);
+	VkDeviceSize instanceBufferSize = meshInstances.size() * sizeof(MeshInstance);
+	VkDeviceSize instanceNodeBufferSize = instances.GetNodes().size() * sizeof(BvhNode);
+	VkDeviceSize blueNoiseBufferSize = blueNoise.size() * sizeof(float);
+	VkDeviceSize pathStatsBufferSize = sizeof(PathCounters);
 	VkDeviceSize uniformBufferSize = sizeof(app);
 
-	CreateStorageBuffer(spheres.data(), spBufferSize, sphereBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sphereDeviceMemory, memTypeIndex);
-	CreateStorageBuffer(planes.data(), plBufferSize, planeBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, planeDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(primitives.spheres.data(), spBufferSize, sphereBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sphereDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(primitives.planes.data(), plBufferSize, planeBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, planeDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(primitives.materials.data(), materialBufferSize, materialBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		materialDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(lights.data(), lightBufferSize, lightBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lightDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(nodes.data(), bvhBufferSize, bvhBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bvhDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(meshBuffers.vertices.data(), vertexBufferSize, vertexBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, vertexDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(meshBuffers.indices.data(), indexBufferSize, indexBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, indexDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(meshBuffers.meshes.data(), meshBufferSize, meshBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(meshInstances.data(), instanceBufferSize, instanceBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(instances.GetNodes().data(), instanceNodeBufferSize, instanceNodeBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		instanceNodeDeviceMemory, memTypeIndex);
+	CreateStorageBuffer(blueNoise.data(), blueNoiseBufferSize, blueNoiseBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, blueNoiseDeviceMemory, memTypeIndex);
+	PathCounters counters = {};
+	CreateStorageBuffer(&counters, pathStatsBufferSize, pathStatsBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pathStatsDeviceMemory, memTypeIndex);
 
 	CreateStorageBuffer(&app, uniformBufferSize, uniformBuffer, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, uniformDeviceMemory, memTypeIndex);
+	uploadedApp = app;
+
+	PrepareWavefrontBuffers();
+	PrepareDenoiseBuffers();
+	// Nothing moved yet.
+	PrepareTemporalBuffers(instances.GetMotion(instances.GetTransforms()));
+	PrepareAdaptiveBuffers();
 }
 
 
+// What intersection tests read per frame & ray at most, compared to the interleaved structs.
+void Application::ReportPrimitiveLayout(const PrimitiveBuffers& primitives)
+{
+	fprintf(stdout, "%zu spheres & %zu planes: %.2f MB geometry, %.2f MB materials (%.2f MB interleaved)\n",
+		primitives.spheres.size(), primitives.planes.size(), primitives.GeometryBytes() / 1048576.0,
+		primitives.materials.size() * sizeof(Material) / 1048576.0, primitives.InterleavedBytes() / 1048576.0);
+}
+
 void Application::CreateStorageBuffer(const void* data, VkDeviceSize &bufferSize, VKDeleter<VkBuffer> &buffer,
 	VkBufferUsageFlags bufferUsageFlags, VKDeleter<VkDeviceMemory> &deviceMemory, uint32_t memTypeIndex)
 {
@@ -868,7 +2681,8 @@ void Application::CreateStorageBuffer(const void* data, VkDeviceSize &bufferSize
 		throw std::runtime_error("Failed to allocate device memory for storage buffer !");
 
 
-	CopyMemory(data, deviceMemory, bufferSize);
+	if (data != nullptr)
+		CopyMemory(data, deviceMemory, bufferSize);
 
 	vkBindBufferMemory(logicalDevice, buffer, deviceMemory, 0);
 }
@@ -877,11 +2691,58 @@ void Application::CreateStorageBuffer(const void* data, VkDeviceSize &bufferSize
 void Application::UpdateUniformBuffer()
 {
 	// Update values here
-	app.time = glfwGetTime();
+	app.time = GetTime();
 	// 
 
+	// Accumulation starts over whenever anything but the time & frame changes, with temporal reprojection every frame.
+	// Poster tiles change the samples per dispatch while accumulating, see DispatchBudget.
+	App previous = uploadedApp;
+	previous.time = app.time;
+	previous.sampleCount = app.sampleCount;
+	previous.samplesPerPixel = app.samplesPerPixel;
+	previous.frame = app.frame;
+	std::copy(app.previousRenderSize, app.previousRenderSize + 2, previous.previousRenderSize);
+	if (std::memcmp(&previous, &app, sizeof(app)) != 0 || settings.temporal)
+		ResetAccumulation();
+
 	VkDeviceSize size = sizeof(app);
 	CopyMemory(&app, uniformDeviceMemory, size);
+	uploadedApp = app;
+	std::copy(app.renderSize, app.renderSize + 2, app.previousRenderSize);
+	UpdateAdaptiveTiles();
+
+	// The next frame adds its samples to the ones of this frame.
+	app.sampleCount += app.samplesPerPixel;
+	app.frame++;
+}
+
+void Application::ResetAccumulation()
+{
+	app.sampleCount = 0;
+}
+
+void Application::UpdateInstances()
+{
+	if (!settings.animate || instances.Count() == 0)
+		return;
+
+	std::vector<Matrix4> previousTransforms = instances.GetTransforms();
+	AnimateInstances(instances);
+
+	ResetAccumulation();
+
+	// Only the instances & their hierarchy change, the geometry stays as uploaded.
+	VkDeviceSize instanceSize = instances.Count() * sizeof(MeshInstance);
+	VkDeviceSize nodeSize = instances.GetNodes().size() * sizeof(BvhNode);
+	CopyMemory(instances.GetInstances().data(), instanceDeviceMemory, instanceSize);
+	CopyMemory(instances.GetNodes().data(), instanceNodeDeviceMemory, nodeSize);
+
+	if (settings.temporal)
+	{
+		std::vector<Matrix4> motion = instances.GetMotion(previousTransforms);
+		VkDeviceSize motionSize = motion.size() * sizeof(Matrix4);
+		CopyMemory(motion.data(), instanceMotionDeviceMemory, motionSize);
+	}
 }
 
 void Application::CopyMemory(const void* data, VKDeleter<VkDeviceMemory> &deviceMemory, VkDeviceSize &bufferSize)
@@ -902,28 +2763,32 @@ void Application::CopyMemory(const void* data, VKDeleter<VkDeviceMemory> &device
 		mapped = nullptr;
 	}
 }
-#pragma endregion
 
+// Adds the counters of the frames done so far to pathStats & clears them, so they don't overflow. The GPU must not be
+// tracing while this runs, i.e. call it after waiting for the compute fence.
+void Application::CollectPathStats()
+{
+	if (!settings.pathStats)
+		return;
 
+	void* mapped = nullptr;
+	auto result = vkMapMemory(logicalDevice, pathStatsDeviceMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to map path statistics memory !");
 
+	auto counters = static_cast<PathCounters*>(mapped);
+	pathStats.Add(*counters);
+	*counters = {};
 
-std::vector<char> Application::ReadBinaryFile(const std::string& filename)
-{
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	vkUnmapMemory(logicalDevice, pathStatsDeviceMemory);
+}
+#pragma endregion
 
-	if (!file.is_open())
-		throw std::runtime_error("Failed to open binary file !");
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
 
-	return buffer;
-}
 
-void Application::InitGameObjects(std::vector<Planee> &planes, std::vector<Sphere> &spheres)
+void Application::InitGameObjects(std::vector<Planee> &planes, std::vector<Sphere> &spheres, std::vector<Mesh> &meshes, InstanceSet &meshInstances,
+	std::vector<Light> &lights)
 {
 	auto AddPlanee = [&planes](Planee* go, Vector3 color, int type)
 	{
@@ -957,4 +2822,142 @@ void Application::InitGameObjects(std::vector<Planee> &planes, std::vector<Spher
 	AddPlanee(right, Vector3(0.007, 0.580, 0.8), 1);
 	AddPlanee(ceiling, Vector3(0.8, 0.8, 0.8), 1);
 	AddPlanee(front, Vector3(0.8, 0.8, 0.8), 1);
+
+	AddRandomSpheres(spheres, settings.extraSpheres);
+	LoadMeshes(meshes, meshInstances);
+
+	// Panel just below the ceiling, facing down.
+	lights.push_back(Light::Rectangle(Vector3(-0.6f, 2.95f, -3.45f), Vector3(1.2f, 0, 0), Vector3(0, 0, 0.4f), Vector3(150, 150, 150)));
+	AddRandomLights(lights, settings.extraLights);
+	UpdateLightCdf(lights);
+}
+
+void Application::LoadMeshes(std::vector<Mesh> &meshes, InstanceSet &meshInstances)
+{
+	for (size_t i = 0; i < settings.meshPaths.size(); i++)
+	{
+		const auto& path = settings.meshPaths[i];
+
+		auto begin = GetTime();
+		meshes.push_back(LoadObj(path));
+		auto& mesh = meshes.back();
+
+		fprintf(stdout, "Loaded %s: %zu vertices, %u triangles in %.1f ms\n", path.c_str(), mesh.positions.size(),
+			mesh.TriangleCount(), 1000.0 * (GetTime() - begin));
+
+		mesh.mat = Material(Vector3(0.8, 0.8, 0.8), 1);
+
+		// Side by side on the floor, between the walls.
+		if (settings.meshInstances == 0)
+		{
+			float slot = 4.0f / settings.meshPaths.size();
+			meshInstances.Add(int32_t(i), mesh.FitInto(Vector3(-2.0f + slot * (i + 0.5f), 0, -3.8f), -2.5f, std::min(2.0f, 0.9f * slot)));
+		}
+	}
+
+	AddRandomInstances(meshes, meshInstances, settings.meshInstances);
+	meshInstances.Build(meshes);
+
+	if (meshInstances.Count() == 0)
+		return;
+
+	// Geometry is stored once per mesh, each instance only adds its MeshInstance & share of the instance hierarchy.
+	double geometryBytes = 0.0, flattenedBytes = 0.0;
+	for (const auto& mesh : meshes)
+		geometryBytes += mesh.positions.size() * sizeof(MeshVertex) + mesh.indices.size() * sizeof(uint32_t);
+	for (const auto& instance : meshInstances.GetInstances())
+		flattenedBytes += meshes[instance.mesh].positions.size() * sizeof(MeshVertex) + meshes[instance.mesh].indices.size() * sizeof(uint32_t);
+	double instanceBytes = meshInstances.Count() * sizeof(MeshInstance) + meshInstances.GetNodes().size() * sizeof(BvhNode);
+
+	fprintf(stdout, "%u instances of %zu meshes: %.2f MB geometry + %.2f MB instances, %.2f MB if every instance had its own copy\n",
+		meshInstances.Count(), meshes.size(), geometryBytes * 1e-6, instanceBytes * 1e-6, flattenedBytes * 1e-6);
+}
+
+void Application::AddRandomInstances(const std::vector<Mesh> &meshes, InstanceSet &meshInstances, uint32_t count)
+{
+	// Fixed seed, so that CPU & GPU render the same scene.
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> x(-2.5f, 2.5f), y(-2.5f, 2.5f), z(-5.3f, -1.5f), unit(0.0f, 1.0f);
+
+	// Same spacing as AddRandomSpheres.
+	float volume = 5.0f * 5.0f * 3.8f;
+	float size = count ? 0.5f * std::cbrt(volume / count) : 0.0f;
+	size = std::min(size, 1.0f);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t mesh = int32_t(i % meshes.size());
+		Vector3 position(x(random), y(random), z(random));
+		float yaw = 2.0f * 3.141592f * unit(random);
+		auto objectToWorld = meshes[mesh].FitInto(position, position.y, size, yaw);
+
+		// Mostly diffuse, every 8th instance is a mirror.
+		int type = (i % 8 == 7) ? 2 : 1;
+		Vector3 color(unit(random), unit(random), unit(random));
+		meshInstances.Add(mesh, objectToWorld, Material(color, type));
+	}
+}
+
+void Application::AnimateInstances(InstanceSet &meshInstances)
+{
+	// A fixed step per frame keeps animated CPU & GPU renders comparable.
+	for (uint32_t i = 0; i < meshInstances.Count(); i++)
+		meshInstances.Rotate(i, (i % 2) ? -0.05f : 0.05f);
+
+	meshInstances.Refit();
+}
+
+// Small sphere & point lights in the upper half of the room, together as bright as the ceiling light.
+void Application::AddRandomLights(std::vector<Light> &lights, uint32_t count)
+{
+	if (count == 0 || lights.empty())
+		return;
+
+	std::mt19937 random(4242);
+	std::uniform_real_distribution<float> x(-2.4f, 2.4f), y(0.5f, 2.6f), z(-5.2f, -1.5f), unit(0.0f, 1.0f);
+
+	const float PI = 3.141592f;
+	float power = lights.front().Power() / count;
+
+	lights.reserve(lights.size() + count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// Tinted, but with the luminance Light::Power measures.
+		Vector3 tint(0.5f + unit(random), 0.5f + unit(random), 0.5f + unit(random));
+		tint = tint / (0.2126f * tint.x + 0.7152f * tint.y + 0.0722f * tint.z);
+		Vector3 position(x(random), y(random), z(random));
+
+		// Every other light is a point.
+		if (i % 2 == 1)
+		{
+			lights.push_back(Light::Point(position, tint * (power / (4.0f * PI))));
+			continue;
+		}
+
+		float radius = 0.05f + 0.1f * unit(random);
+		lights.push_back(Light::Sphere(position, radius, tint * (power / (4.0f * PI * PI * radius * radius))));
+	}
+}
+
+void Application::AddRandomSpheres(std::vector<Sphere> &spheres, uint32_t count)
+{
+	// Fixed seed, so that CPU & GPU render (and benchmark) the same scene.
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> x(-2.5f, 2.5f), y(-2.3f, 2.7f), z(-5.3f, -1.5f), unit(0.0f, 1.0f);
+
+	// Keep the spheres roughly a quarter of their average spacing apart from each other, whatever the count.
+	float volume = 5.0f * 5.0f * 3.8f;
+	float radius = count ? 0.25f * std::cbrt(volume / count) : 0.0f;
+	radius = std::min(radius, 0.3f);
+
+	spheres.reserve(spheres.size() + count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Sphere sphere(Vector3(x(random), y(random), z(random)), radius);
+
+		// Mostly diffuse, every 8th sphere is a mirror.
+		int type = (i % 8 == 7) ? 2 : 1;
+		sphere.mat = Material(Vector3(unit(random), unit(random), unit(random)), type);
+		spheres.push_back(sphere);
+	}
 }
\ No newline at end of file
@@ -1,14 +1,31 @@
 #pragma once
 
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
+#include "VulkanPlatform.h"
 #include <vector>
 #include <fstream>
+#include <chrono>
+#include <map>
+#include <memory>
 #include "VkDeleter.h"
-
-#include "Scene\Planee.h"
-#include "Scene\Sphere.h"
-#include "Scene\Vector3.h"
+#include "RenderSettings.h"
+#include "GpuTimer.h"
+#include "ShaderVariant.h"
+#include "WorkgroupTuner.h"
+#include "PipelineCacheFile.h"
+#include "ShaderWatcher.h"
+#include "PathStats.h"
+#include "RenderScale.h"
+#include "Poster.h"
+#include "Cpu/CpuRenderer.h"
+
+#include "Scene/Camera.h"
+#include "Scene/InstanceSet.h"
+#include "Scene/Light.h"
+#include "Scene/Mesh.h"
+#include "Scene/Planee.h"
+#include "Scene/PrimitiveBuffers.h"
+#include "Scene/Sphere.h"
+#include "Scene/Vector3.h"
 
 
 /// <summary>
@@ -30,6 +47,36 @@ const std::vector<const char*> deviceExtensions =
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+// Keys of the ray sort, keep in sync with SortBins in shaders/raytracing.comp.
+const uint32_t SortBins = 16384;
+
+// Queues buffer of the wavefront pipeline, see shaders/raytracing.comp.
+struct WavefrontDispatch
+{
+	uint32_t x, y, z;
+	uint32_t pad;
+};
+
+struct WavefrontQueues
+{
+	uint32_t rayCount[2];
+	uint32_t shadowCount;
+	uint32_t pad;
+	WavefrontDispatch rayDispatch[2];
+	WavefrontDispatch shadowDispatch;
+};
+
+// Push constants of the wavefront passes.
+struct WavefrontConstants
+{
+	int32_t queue;
+	uint32_t sampleOffset;
+	int32_t sortShadows;
+	int32_t readSorted;
+	// Iteration of the denoise pass, which sets its step width & buffers.
+	int32_t denoiseIteration;
+};
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -39,6 +86,8 @@ const bool enableValidationLayers = true;
 class Application
 {
 public:
+	explicit Application(const RenderSettings& settings);
+
 	void Run();
 
 	static void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator);
@@ -46,8 +95,11 @@ public:
 														size_t location, int32_t code, const char* layerPrefix, const char* msg, void* userData);
 private:
 #pragma region Fields
-	GLFWwindow* window;
-	double lastTime = glfwGetTime();
+	RenderSettings settings;
+
+	GLFWwindow* window = nullptr;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	double lastTime = 0.0;
 	int frames = 0;
 
 	VKDeleter<VkInstance> instance{ vkDestroyInstance };
@@ -69,7 +121,61 @@ private:
 	std::vector<VKDeleter<VkImageView>> swapChainImageViews;
 
 
-	VKDeleter<VkPipeline> computePipeline{ logicalDevice, vkDestroyPipeline };
+	// Pass specialization constant of shaders/raytracing.comp.
+	enum ShaderPass { PassMegakernel, PassGenerate, PassExtend, PassShade, PassConnect, PassResolve, PassSortKeys, PassSortScan, PassSortScatter, PassDenoise, PassTemporal,
+		PassConverge, PassUpscale, PassReconstruct };
+
+	// Every pipeline built so far, per pass, local size & shader variant. They live as long as the shader module they came from.
+	struct PipelineKey
+	{
+		ShaderPass pass;
+		uint32_t x, y;
+		ShaderVariant variant;
+
+		bool operator<(const PipelineKey& other) const
+		{
+			return std::tie(pass, x, y, variant) < std::tie(other.pass, other.x, other.y, other.variant);
+		}
+	};
+	VKDeleter<VkShaderModule> computeShaderModule{ logicalDevice, vkDestroyShaderModule };
+	// Compiles edits of settings.shaderPath in the background, see ReloadShader.
+	std::unique_ptr<ShaderWatcher> shaderWatcher;
+	// Loaded from settings.pipelineCachePath at startup & written back on exit, see CreatePipelineCache.
+	VKDeleter<VkPipelineCache> pipelineCache{ logicalDevice, vkDestroyPipelineCache };
+	bool pipelineCacheWarm = false;
+	// Time spent in vkCreateComputePipelines, including workgroup tuning.
+	double pipelineSeconds = 0.0;
+	uint32_t pipelineCount = 0;
+	std::map<PipelineKey, std::unique_ptr<VKDeleter<VkPipeline>>> pipelineVariants;
+	// Constants & scene features the pipelines below are specialized on.
+	ShaderVariant shaderVariant;
+
+	// Pipelines of the current variant, owned by pipelineVariants.
+	VkPipeline computePipeline = VK_NULL_HANDLE;
+	WorkgroupSize workgroupSize = { 8, 8 };
+
+	VkPipeline generatePipeline = VK_NULL_HANDLE;
+	VkPipeline extendPipeline = VK_NULL_HANDLE;
+	VkPipeline shadePipeline = VK_NULL_HANDLE;
+	VkPipeline connectPipeline = VK_NULL_HANDLE;
+	VkPipeline resolvePipeline = VK_NULL_HANDLE;
+	VkPipeline sortKeysPipeline = VK_NULL_HANDLE;
+	VkPipeline sortScanPipeline = VK_NULL_HANDLE;
+	VkPipeline sortScatterPipeline = VK_NULL_HANDLE;
+	VkPipeline denoisePipeline = VK_NULL_HANDLE;
+	VkPipeline temporalPipeline = VK_NULL_HANDLE;
+	VkPipeline convergePipeline = VK_NULL_HANDLE;
+	VkPipeline upscalePipeline = VK_NULL_HANDLE;
+	VkPipeline reconstructPipeline = VK_NULL_HANDLE;
+	// Sort secondary & shadow rays before they are intersected, only RenderHeadless turns it off again to compare.
+	bool sortRays = false;
+	// How much of the scene every workgroup stages in shared memory, see SharedPlanes, SharedSpheres & SharedNodes in the shader.
+	struct SharedStaging
+	{
+		uint32_t planes, spheres, nodes;
+	} sharedStaging = {};
+	// Wavefront passes run on one dimensional workgroups with as many invocations as workgroupSize.
+	uint32_t wavefrontGroupSize = 64;
 	VKDeleter<VkDescriptorPool> computeDescriptorPool{ logicalDevice, vkDestroyDescriptorPool };
 	VKDeleter<VkDescriptorSetLayout> computeDescriptorSetLayout{ logicalDevice, vkDestroyDescriptorSetLayout };
 	VKDeleter<VkPipelineLayout> computePipelineLayout{ logicalDevice, vkDestroyPipelineLayout };
@@ -79,21 +185,100 @@ private:
 	VkCommandBuffer computeCommandBuffer;
 	VKDeleter<VkFence> computeFence{ logicalDevice, vkDestroyFence };
 
+	// Stages timed by gpuTimer, in recording order. Headless rendering only times the dispatch, reconstruct, converge, temporal, denoise
+	// & upscale passes.
+	enum TimingStage { TimingDispatch, TimingReconstruct, TimingConverge, TimingTemporal, TimingDenoise, TimingUpscale, TimingImageBarriers, TimingCopy,
+		TimingPresentBarrier, TimingPresent };
+	GpuTimer gpuTimer{ logicalDevice };
+	bool timestampsPending = false;
+
 	VKDeleter<VkSemaphore> imageAvailableSemaphore{ logicalDevice, vkDestroySemaphore };
 	VKDeleter<VkSemaphore> renderFinishedSemaphore{ logicalDevice, vkDestroySemaphore };
 
 
+	VkFormat computeImageFormat;
 	VKDeleter<VkImage> computeImage{ logicalDevice, vkDestroyImage };
 	VKDeleter<VkImageView > computeImageView{ logicalDevice, vkDestroyImageView };
 	VKDeleter<VkDeviceMemory> computeImgDeviceMemory{ logicalDevice, vkFreeMemory };
 
+	VKDeleter<VkImage> accumulationImage{ logicalDevice, vkDestroyImage };
+	VKDeleter<VkImageView> accumulationImageView{ logicalDevice, vkDestroyImageView };
+	VKDeleter<VkDeviceMemory> accumulationDeviceMemory{ logicalDevice, vkFreeMemory };
+
+	// Shown & saved instead of the compute image with dynamic resolution, see RecordUpscale.
+	VKDeleter<VkImage> upscaledImage{ logicalDevice, vkDestroyImage };
+	VKDeleter<VkImageView> upscaledImageView{ logicalDevice, vkDestroyImageView };
+	VKDeleter<VkDeviceMemory> upscaledDeviceMemory{ logicalDevice, vkFreeMemory };
+	// Pixels the passes trace, the top left part of the compute image. Changed between frames by SetRenderScale.
+	VkExtent2D renderExtent = { WIDTH, HEIGHT };
+	// Follows the GPU frame time with --target-ms.
+	std::unique_ptr<RenderScaleGovernor> renderScaleGovernor;
+
 
 	VKDeleter<VkBuffer> sphereBuffer{ logicalDevice, vkDestroyBuffer };
 	VKDeleter<VkBuffer> planeBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> bvhBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> vertexBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> indexBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> meshBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> instanceBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> instanceNodeBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> rayBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> hitBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> shadowRayBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> queueBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> pixelRadianceBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> blueNoiseBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> sortBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> materialBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> lightBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> pathStatsBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> gbufferBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> denoiseBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> instanceMotionBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> motionBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> historyBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> momentsBuffer{ logicalDevice, vkDestroyBuffer };
+	VKDeleter<VkBuffer> adaptiveTilesBuffer{ logicalDevice, vkDestroyBuffer };
 
 	VKDeleter<VkBuffer> uniformBuffer{ logicalDevice, vkDestroyBuffer };
 	VKDeleter<VkDeviceMemory> sphereDeviceMemory{ logicalDevice, vkFreeMemory };
 	VKDeleter<VkDeviceMemory> planeDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> bvhDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> vertexDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> indexDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> meshDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> instanceDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> instanceNodeDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> rayDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> hitDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> shadowRayDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> queueDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> pixelRadianceDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> blueNoiseDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> sortDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> materialDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> lightDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> pathStatsDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> gbufferDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> denoiseDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> instanceMotionDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> motionDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> historyDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> momentsDeviceMemory{ logicalDevice, vkFreeMemory };
+	VKDeleter<VkDeviceMemory> adaptiveTilesDeviceMemory{ logicalDevice, vkFreeMemory };
+	// Counters of the PathStatistics buffer, summed up over all frames, see CollectPathStats.
+	PathStats pathStats;
+
+	// Tiles the next frame traces with adaptive sampling & the samples the frames of RenderFrames traced, see UpdateAdaptiveTiles.
+	uint32_t adaptiveTileCount = 0;
+	uint64_t adaptiveSamples = 0;
+	// Frames the last RenderFrames call submitted, fewer than asked for once adaptive sampling converged, & the pixels they traced.
+	uint32_t renderedFrames = 0;
+	double renderedPixels = 0.0;
+
+	// Kept to move instances after upload, see UpdateInstances.
+	InstanceSet instances;
 
 	VKDeleter<VkDeviceMemory> uniformDeviceMemory{ logicalDevice, vkFreeMemory };
 #pragma endregion
@@ -106,7 +291,33 @@ private:
 	void Update();
 	void Draw();
 
-	void DebugFrameTime();
+	double GetTime();
+
+#pragma region Timings
+	void CreateTimestampQueries();
+	void PrintFrameTimings();
+	void ReportTimings();
+#pragma endregion
+
+#pragma region Headless
+	void RenderHeadless();
+	double RenderFrames(uint32_t frames);
+	void SaveComputeImage(const std::string& path);
+	void ReadOutputImage(VkExtent2D extent, std::vector<uint8_t>& pixels);
+	void CompareOutput();
+#pragma endregion
+
+#pragma region Poster
+	void RenderPoster();
+	void SetPosterTile(const PosterTile& tile);
+	void RenderPosterCpu(CpuRenderer& renderer, ThreadPool& pool, uint32_t tileWidth, uint32_t tileHeight);
+#pragma endregion
+
+#pragma region CPU Rendering
+	void RenderCpu();
+	void ReportCpuScaling(CpuRenderer& renderer, std::vector<uint8_t>& pixels);
+	void ReportBvhScaling();
+#pragma endregion
 
 
 	void CreateVulkanInstance();
@@ -129,6 +340,7 @@ private:
 	void GetPhysicalDevice();
 	bool IsDeviceSuitable(VkPhysicalDevice device);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	std::vector<const char*> GetDeviceExtensions();
 #pragma endregion
 
 	void CreateLogicalDevice();
@@ -143,12 +355,25 @@ private:
 #pragma region Image Setup
 	void CreateImageViews();
 
-	void CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageView> &imgView, VKDeleter<VkDeviceMemory> &memory);
+	void CreateComputeImage(VKDeleter<VkImage> &img, VKDeleter<VkImageView> &imgView, VKDeleter<VkDeviceMemory> &memory, VkExtent2D extent);
+	void CreateAccumulationImage();
+	void PrepareAccumulationImage();
 #pragma endregion
 
 #pragma region Pipelines
 	void CreateShaderModule(const std::vector<char>& code, VKDeleter<VkShaderModule>& shaderModule);
+	std::vector<char> LoadComputeShader();
+	bool ReloadShader();
+	void CreatePipelineCache();
+	void StorePipelineCache();
+	void ReportStartup(double seconds);
 	void CreateComputePipeline();
+	void CreateComputePipeline(const VKDeleter<VkShaderModule>& shaderModule, WorkgroupSize size, VKDeleter<VkPipeline>& pipeline,
+		ShaderPass pass = PassMegakernel);
+	VkPipeline GetComputePipeline(WorkgroupSize size, ShaderPass pass = PassMegakernel);
+	void ChooseShaderVariant(const std::vector<Planee>& planes, const std::vector<Sphere>& spheres, const std::vector<Mesh>& meshes);
+
+	void ChooseSharedStaging(const PrimitiveBuffers& primitives, size_t sphereNodeCount);
 
 	void CreateDescriptorPool();
 	void PrepareComputeForPipelineCreation();
@@ -159,6 +384,52 @@ private:
 	void CreateComputeCommandBuffer();
 	void RecordComputeCommandBuffer();
 	void CreateComputeFence();
+	void RecordDispatch(const VkCommandBuffer buffer, WorkgroupSize size, bool interleaved = false);
+	void RecordTrace(const VkCommandBuffer buffer);
+#pragma endregion
+
+#pragma region Denoising
+	void CreateFilterPipelines();
+	void PrepareDenoiseBuffers();
+	void RecordDenoise(const VkCommandBuffer buffer);
+#pragma endregion
+
+#pragma region Temporal Reprojection
+	void PrepareTemporalBuffers(const std::vector<Matrix4>& instanceMotion);
+	void RecordTemporal(const VkCommandBuffer buffer);
+	void UpdateCamera();
+#pragma endregion
+
+#pragma region Adaptive Sampling
+	void PrepareAdaptiveBuffers();
+	void RecordConverge(const VkCommandBuffer buffer);
+	uint32_t GetAdaptiveTileTotal() const;
+	void UpdateAdaptiveTiles();
+#pragma endregion
+
+#pragma region Dynamic Resolution
+	bool DynamicResolution() const;
+	void SetRenderScale(float scale);
+	bool UpdateRenderScale();
+	void RecordUpscale(const VkCommandBuffer buffer);
+	VkImage GetOutputImage() const;
+#pragma endregion
+
+#pragma region Interleaved Rendering
+	void RecordReconstruct(const VkCommandBuffer buffer);
+#pragma endregion
+
+#pragma region Wavefront
+	void CreateWavefrontPipelines();
+	void PrepareWavefrontBuffers();
+	void RecordWavefront(const VkCommandBuffer buffer);
+	void RecordWavefrontBarrier(const VkCommandBuffer buffer);
+	void RecordSort(const VkCommandBuffer buffer, WavefrontConstants constants, bool shadows);
+#pragma endregion
+
+#pragma region Workgroup Tuning
+	void ChooseWorkgroupSize(const VKDeleter<VkShaderModule>& shaderModule);
+	double TimeWorkgroupSize(const VKDeleter<VkShaderModule>& shaderModule, WorkgroupSize size);
 #pragma endregion
 
 #pragma region Synchronization
@@ -171,30 +442,55 @@ private:
 	void SetSecondImageBarriers(const VkCommandBuffer buffer, int curImage);
 #pragma endregion
 
-	std::vector<char> ReadBinaryFile(const std::string& filename);
-
 
 #pragma region Buffers
 	void GetMemoryProperties(int &memoryTypeIndex, VkMemoryPropertyFlags properties);
 
 	void PrepareStorageBuffers();
+	void ReportPrimitiveLayout(const PrimitiveBuffers& primitives);
 
 	void CreateStorageBuffer(const void* data, VkDeviceSize &bufferSize, VKDeleter<VkBuffer> &buffer,
 		VkBufferUsageFlags bufferUsageFlags, VKDeleter<VkDeviceMemory> &deviceMemory, uint32_t memTypeIndex);
 
 	void UpdateUniformBuffer();
+	void UpdateInstances();
+	void ResetAccumulation();
+	void CollectPathStats();
 
 	void CopyMemory(const void* data, VKDeleter<VkDeviceMemory> &deviceMemory, VkDeviceSize &bufferSize);
 #pragma endregion
 
 
-	void InitGameObjects(std::vector<Planee> &planes, std::vector<Sphere> &spheres);
+	void InitGameObjects(std::vector<Planee> &planes, std::vector<Sphere> &spheres, std::vector<Mesh> &meshes, InstanceSet &meshInstances,
+		std::vector<Light> &lights);
+	void AddRandomSpheres(std::vector<Sphere> &spheres, uint32_t count);
+	void AddRandomLights(std::vector<Light> &lights, uint32_t count);
+	void LoadMeshes(std::vector<Mesh> &meshes, InstanceSet &meshInstances);
+	void AddRandomInstances(const std::vector<Mesh> &meshes, InstanceSet &meshInstances, uint32_t count);
+	void AnimateInstances(InstanceSet &meshInstances);
 
 
 	struct App
 	{
 		float time;
-	} app;
+		int32_t instanceCount;
+		uint32_t sampleCount;
+		int32_t sampler;
+		uint32_t samplesPerPixel;
+		uint32_t frame;
+		// Pixels traced this frame, which also keeps the vec4s aligned to 16 bytes as std140 wants.
+		int32_t renderSize[2];
+		// Position & yaw of this frame's camera & the one before, see CameraPose.
+		float camera[4];
+		float previousCamera[4];
+		// The history of the frame before only lines up if it was traced at the same size.
+		int32_t previousRenderSize[2];
+		// Where the traced pixels lie in the image the camera spans, which is only larger for poster tiles.
+		int32_t tileOrigin[2];
+		int32_t imageSize[2];
+	} app = {};
+	// Last uploaded state, any difference but the time & frame restarts accumulation.
+	App uploadedApp = {};
 #pragma endregion
 };
 
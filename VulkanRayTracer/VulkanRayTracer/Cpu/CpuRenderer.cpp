@@ -0,0 +1,1547 @@
+#include "CpuRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include "ShaderConstants.h"
+
+
+namespace
+{
+	// Keep these in sync with the #defines & the default specialization constants of shaders/raytracing.comp.
+	const float HitPlane = 0.0f;
+	const float HitSphere = 1.0f;
+	const float HitTriangle = 2.0f;
+
+	const float PI = 3.141592f;
+	const float Inf = 1000000.0f;
+	const float CameraEyeZ = -0.1f;
+
+	// See DenoiseAlbedo in the shader, black surfaces would lose their lighting.
+	inline Vector3 DenoiseAlbedo(const Vector3& albedo)
+	{
+		return Vector3(std::max(albedo.x, 0.01f), std::max(albedo.y, 0.01f), std::max(albedo.z, 0.01f));
+	}
+
+	// See Luminance in the shader.
+	inline float Luminance(float r, float g, float b)
+	{
+		return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+	}
+
+	// See RotateYaw in the shader.
+	inline Vector3 RotateYaw(const Vector3& v, float yaw)
+	{
+		float c = std::cos(yaw);
+		float s = std::sin(yaw);
+		return Vector3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+	}
+
+	inline Vector3N RotateYaw(const Vector3N& v, float yaw)
+	{
+		FloatN c(std::cos(yaw));
+		FloatN s(std::sin(yaw));
+		return Vector3N(c * v.x + s * v.z, v.y, c * v.z - s * v.x);
+	}
+
+	// See ClipToBox in the shader.
+	inline Vector3 ClipToBox(const Vector3& color, const Vector3& center, const Vector3& extent)
+	{
+		Vector3 offset = color - center;
+		float furthest = std::max(std::abs(offset.x) / std::max(extent.x, 0.0001f), std::max(std::abs(offset.y) / std::max(extent.y, 0.0001f),
+			std::abs(offset.z) / std::max(extent.z, 0.0001f)));
+		return (furthest > 1.0f) ? center + offset / furthest : color;
+	}
+
+	inline Vector3N Broadcast(const Vector3& v)
+	{
+		return Vector3N(v.x, v.y, v.z);
+	}
+
+	Vector3N TransformVector(const Matrix4& t, const Vector3N& v)
+	{
+		return Vector3N(FloatN(t.m[0]) * v.x + FloatN(t.m[4]) * v.y + FloatN(t.m[8]) * v.z,
+			FloatN(t.m[1]) * v.x + FloatN(t.m[5]) * v.y + FloatN(t.m[9]) * v.z,
+			FloatN(t.m[2]) * v.x + FloatN(t.m[6]) * v.y + FloatN(t.m[10]) * v.z);
+	}
+
+	Vector3N TransformPoint(const Matrix4& t, const Vector3N& p)
+	{
+		return TransformVector(t, p) + Vector3N(t.m[12], t.m[13], t.m[14]);
+	}
+
+	// Hits closer than epsilon are ignored, like the Epsilon specialization constant of the shader.
+	FloatN PlaneIntersection(const Vector3N& origin, const Vector3N& direction, const PrimitiveGeometry& plane, float epsilon)
+	{
+		auto normal = Broadcast(plane.xyz);
+		FloatN d0 = Dot(normal, direction);
+
+		FloatN t = FloatN(-1.0f) * ((Dot(normal, origin) + FloatN(plane.w)) / d0);
+		return Select((d0 != FloatN(0.0f)) & (t > FloatN(epsilon)), t, FloatN(0.0f));
+	}
+
+	FloatN SphereIntersection(const Vector3N& origin, const Vector3N& direction, const PrimitiveGeometry& sphere, float epsilon)
+	{
+		Vector3N delta = origin - Broadcast(sphere.xyz);
+		FloatN b = Dot(delta * FloatN(2.0f), direction);
+		FloatN c = Dot(delta, delta) - FloatN(sphere.w * sphere.w);
+
+		FloatN disc = b * b - FloatN(4.0f) * c;
+		MaskN hasRoots = disc >= FloatN(0.0f);
+		disc = Sqrt(Max(disc, FloatN(0.0f)));
+
+		// Always 2 solutions when pulling the square root.
+		FloatN result1 = FloatN(0.0f) - b + disc;
+		FloatN result2 = FloatN(0.0f) - b - disc;
+
+		FloatN result = Select(result1 > FloatN(epsilon), result1 / FloatN(2.0f), FloatN(0.0f));
+		result = Select(result2 > FloatN(epsilon), result2 / FloatN(2.0f), result);
+		return Select(hasRoots, result, FloatN(0.0f));
+	}
+
+	// Lanes which enter the box before maxDist, see BoxIntersection in the shader.
+	MaskN BoxIntersection(const Vector3N& origin, const Vector3N& invDirection, const BvhNode& node, FloatN maxDist, FloatN& enter)
+	{
+		Vector3N t0 = (Broadcast(node.boundsMin) - origin) * invDirection;
+		Vector3N t1 = (Broadcast(node.boundsMax) - origin) * invDirection;
+
+		enter = Max(Max(Min(t0.x, t1.x), Min(t0.y, t1.y)), Max(Min(t0.z, t1.z), FloatN(0.0f)));
+		FloatN exit = Min(Min(Max(t0.x, t1.x), Max(t0.y, t1.y)), Max(t0.z, t1.z));
+
+		return (enter <= exit) & (enter < maxDist);
+	}
+
+	// Component k of v per lane, with k given as the masks k == 0 & k == 1.
+	inline FloatN Pick(const Vector3N& v, MaskN is0, MaskN is1)
+	{
+		return Select(is0, v.x, Select(is1, v.y, v.z));
+	}
+
+	inline MaskN SelectMask(MaskN mask, MaskN a, MaskN b)
+	{
+		return (mask & a) | AndNot(b, mask);
+	}
+
+	// Cosine weighted direction around the normal, see SampleDiffuse in the shader.
+	Vector3 SampleDiffuse(const Vector3& normal, float u, float v)
+	{
+		float s = (normal.z >= 0) ? 1.0f : -1.0f;
+		float a = -1.0f / (s + normal.z);
+		float b = normal.x * normal.y * a;
+		Vector3 tangent(1.0f + s * normal.x * normal.x * a, s * b, -s * normal.x);
+		Vector3 bitangent(b, s + normal.y * normal.y * a, -normal.y);
+
+		float r = std::sqrt(u);
+		float phi = 2 * PI * v;
+		return (tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(1.0f - u)).Normalized();
+	}
+
+	int CountLanes(MaskN mask)
+	{
+		int count = 0;
+		for (int bits = mask.Bits(); bits; bits &= bits - 1)
+			count++;
+		return count;
+	}
+}
+
+
+struct CpuRenderer::RayShearN
+{
+	MaskN x0, x1, y0, y1, z0, z1;
+	FloatN sx, sy, sz;
+
+	explicit RayShearN(const Vector3N& direction)
+	{
+		FloatN ax = Abs(direction.x), ay = Abs(direction.y), az = Abs(direction.z);
+
+		// kz is the dominant axis, kx & ky follow it cyclically.
+		z0 = (ax > ay) & (ax > az);
+		z1 = AndNot(ay > az, ax > ay);
+		MaskN z2 = AndNot(AndNot(MaskAll(), z0), z1);
+
+		x0 = z2;
+		x1 = z0;
+		y0 = z1;
+		y1 = z2;
+
+		// Swapping kx & ky keeps the winding & thereby the sign of the barycentrics.
+		FloatN dz = Pick(direction, z0, z1);
+		MaskN swap = dz < FloatN(0.0f);
+		MaskN nx0 = SelectMask(swap, y0, x0), nx1 = SelectMask(swap, y1, x1);
+		y0 = SelectMask(swap, x0, y0);
+		y1 = SelectMask(swap, x1, y1);
+		x0 = nx0;
+		x1 = nx1;
+
+		sx = Pick(direction, x0, x1) / dz;
+		sy = Pick(direction, y0, y1) / dz;
+		sz = FloatN(1.0f) / dz;
+	}
+};
+
+
+CpuRenderer::CpuRenderer(const std::vector<Planee>& planes, const std::vector<Sphere>& spheres, std::vector<Mesh> sceneMeshes,
+	const InstanceSet& sceneInstances, const std::vector<Light>& lights, uint32_t width, uint32_t height)
+	: lights(lights), width(width), height(height), imageWidth(width), imageHeight(height), accumulation(size_t(width) * height * 4)
+{
+	// Same layout as the GPU buffers, see Application::PrepareStorageBuffers.
+	std::vector<Sphere> sortedSpheres = spheres;
+	Bvh bvh(sortedSpheres);
+	nodes = bvh.GetNodes();
+	sphereBvhDepth = bvh.GetDepth();
+	primitives = PrimitiveBuffers(planes, sortedSpheres);
+
+	MeshBuffers buffers(sceneMeshes, int32_t(nodes.size()));
+	nodes.insert(nodes.end(), buffers.nodes.begin(), buffers.nodes.end());
+	vertices.swap(buffers.vertices);
+	indices.swap(buffers.indices);
+	meshes.swap(buffers.meshes);
+
+	UpdateInstances(sceneInstances);
+}
+
+void CpuRenderer::UpdateInstances(const InstanceSet& sceneInstances)
+{
+	// Nothing moved the first time.
+	if (transforms.size() != sceneInstances.Count())
+		transforms = sceneInstances.GetTransforms();
+	instanceMotion = sceneInstances.GetMotion(transforms);
+	transforms = sceneInstances.GetTransforms();
+
+	instances = sceneInstances.GetInstances();
+	instanceNodes = sceneInstances.GetNodes();
+	ResetAccumulation();
+}
+
+void CpuRenderer::SetSampler(SamplerType type, uint32_t samples)
+{
+	sampler = Sampler(type);
+	samplesPerPixel = samples;
+	ResetAccumulation();
+}
+
+void CpuRenderer::SetShading(uint32_t bounces, float shadowFactor, float hitEpsilon, uint32_t roulette)
+{
+	maxBounces = int(bounces);
+	shadow = shadowFactor;
+	epsilon = hitEpsilon;
+	rouletteDepth = int(roulette);
+	ResetAccumulation();
+}
+
+void CpuRenderer::SetDenoise(uint32_t iterations)
+{
+	denoiseIterations = iterations;
+	AllocateFilterBuffers();
+}
+
+void CpuRenderer::SetTemporal(bool enabled)
+{
+	temporal = enabled;
+	frame = 0;
+	AllocateFilterBuffers();
+}
+
+void CpuRenderer::SetCamera(const CameraPose& pose)
+{
+	previousCamera = camera;
+	camera = pose;
+	if (camera.position.x != previousCamera.position.x || camera.position.y != previousCamera.position.y
+		|| camera.position.z != previousCamera.position.z || camera.yaw != previousCamera.yaw)
+		ResetAccumulation();
+}
+
+void CpuRenderer::SetAdaptive(float threshold)
+{
+	adaptiveThreshold = threshold;
+	moments.assign(threshold > 0.0f ? size_t(width) * height : 0, 0.0f);
+	ResetAccumulation();
+}
+
+void CpuRenderer::SetInterleave(uint32_t phases)
+{
+	interleave = phases;
+	ResetAccumulation();
+}
+
+void CpuRenderer::SetView(uint32_t originX, uint32_t originY, uint32_t viewWidth, uint32_t viewHeight)
+{
+	viewX = originX;
+	viewY = originY;
+	imageWidth = viewWidth;
+	imageHeight = viewHeight;
+	ResetAccumulation();
+}
+
+void CpuRenderer::ResetAccumulation()
+{
+	sampleCount = 0;
+	tileActive.assign(TileCount(), 1);
+}
+
+uint32_t CpuRenderer::TileCount() const
+{
+	return ((width + TileSize - 1) / TileSize) * ((height + TileSize - 1) / TileSize);
+}
+
+uint32_t CpuRenderer::GetActiveTiles() const
+{
+	return uint32_t(std::count(tileActive.begin(), tileActive.end(), uint8_t(1)));
+}
+
+void CpuRenderer::AllocateFilterBuffers()
+{
+	size_t pixels = size_t(width) * height;
+	gbuffer.assign(GBufferOutput() ? (temporal ? 2 : 1) * pixels : 0, GBufferTexel());
+	denoiseColors.assign(denoiseIterations > 0 ? 2 * pixels : 0, Vector3());
+	motionVectors.assign(temporal ? 2 * pixels : 0, MotionTexel());
+	history.assign(temporal ? 2 * pixels : 0, HistoryTexel());
+}
+
+// See FrameHalf in the shader.
+size_t CpuRenderer::FrameHalf(bool previous) const
+{
+	if (!temporal)
+		return 0;
+	return ((frame + (previous ? 1 : 0)) % 2) * size_t(width) * height;
+}
+
+void CpuRenderer::Render(ThreadPool& pool, uint8_t* pixels)
+{
+	uint32_t tiles = TileCount();
+
+	// Every frame only shows its own samples & the history.
+	if (temporal)
+		ResetAccumulation();
+
+	// Tiles that converged keep the pixels they wrote last.
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	for (uint32_t tile = 0; tile < tiles; tile++)
+	{
+		if (!tileActive[tile])
+			continue;
+		uint32_t x0 = (tile % tilesX) * TileSize;
+		uint32_t y0 = (tile / tilesX) * TileSize;
+		tracedSamples += uint64_t(std::min(TileSize, width - x0)) * std::min(TileSize, height - y0) * samplesPerPixel / interleave;
+	}
+	pool.Run(tiles, [this, pixels](uint32_t tile) { RenderTile(tile, pixels); });
+
+	// Interpolates between the pixels traced in the tiles around as well, & reads whether pixels have history before the
+	// samples of this frame count.
+	if (interleave > 1)
+		pool.Run(tiles, [this, pixels](uint32_t tile) { ReconstructTile(tile, pixels); });
+	sampleCount += samplesPerPixel;
+
+	// The history is read around where the surface was, in the tiles nearby.
+	if (temporal)
+		pool.Run(tiles, [this, pixels](uint32_t tile) { TemporalTile(tile, pixels); });
+
+	// Taps reach into the neighbouring tiles, so every iteration waits for the one before.
+	for (uint32_t iteration = 0; iteration < denoiseIterations; iteration++)
+		pool.Run(tiles, [this, pixels, iteration](uint32_t tile) { DenoiseTile(tile, iteration, pixels); });
+
+	frame++;
+}
+
+void CpuRenderer::RenderTile(uint32_t tile, uint8_t* pixels)
+{
+	if (!tileActive[tile])
+		return;
+
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	uint32_t x0 = (tile % tilesX) * TileSize;
+	uint32_t y0 = (tile / tilesX) * TileSize;
+	uint32_t x1 = std::min(x0 + TileSize, width);
+	uint32_t y1 = std::min(y0 + TileSize, height);
+
+	uint32_t stride = PixelStride();
+	float laneOffsets[FloatN::Width];
+	for (int i = 0; i < FloatN::Width; i++)
+		laneOffsets[i] = float(i * stride);
+	FloatN lanes = FloatN::Load(laneOffsets);
+
+	// See FirstSample & main in the shader, all pixels of a tile have the same number of samples. Read before the first row
+	// adds this frame's.
+	uint32_t tileFirst = temporal ? frame * samplesPerPixel : sampleCount;
+	if (adaptiveThreshold > 0.0f && sampleCount > 0)
+		tileFirst = uint32_t(accumulation[(size_t(y0) * width + x0) * 4 + 3]);
+
+	PathStats stats;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		// Tiles start on an even column, interleaved frames trace every 2nd pixel from one of the first two. With 4 phases
+		// every 2nd row has none.
+		uint32_t start = x0;
+		if (interleave > 1 && !TracedThisFrame(int(start), int(y)))
+			start++;
+		if (interleave > 1 && !TracedThisFrame(int(start), int(y)))
+			continue;
+
+		for (uint32_t x = start; x < x1; x += FloatN::Width * stride)
+		{
+			FloatN px = FloatN(float(x)) + lanes;
+			MaskN active = px < FloatN(float(x1));
+
+			Vector3N color(0.0f, 0.0f, 0.0f);
+			FloatN squares(0.0f);
+			SurfaceN surface;
+			uint32_t first = tileFirst;
+			// The pixels traced this frame were traced last interleave frames ago, all or none of them before the reset.
+			if (interleave > 1)
+				first = HasInterleavedHistory(x, y) ? uint32_t(accumulation[(size_t(y) * width + x) * 4 + 3]) : 0;
+			bool accumulate = (interleave > 1) ? first > 0 : sampleCount > 0;
+			for (uint32_t s = 0; s < samplesPerPixel; s++)
+			{
+				// Jittered & turned like PrimaryRay in the shader.
+				FloatN jitterX(0.0f), jitterY(0.0f);
+				if (sampler.IsStochastic())
+					Sample2D(x, y, first + s, PixelDimension(), jitterX, jitterY);
+
+				Vector3N origin = Broadcast(camera.position);
+				Vector3N eye(0.0f, 0.0f, CameraEyeZ);
+				Vector3N direction = RotateYaw(Normalize(Camera(px + FloatN(float(viewX)) + jitterX, FloatN(float(viewY + y)) + jitterY) - eye),
+					camera.yaw);
+
+				Vector3N sample = Trace(origin, direction, active, x, y, first + s, stats, GBufferOutput() ? &surface : nullptr);
+				color = color + sample;
+				FloatN luminance = FloatN(0.2126f) * sample.x + FloatN(0.7152f) * sample.y + FloatN(0.0722f) * sample.z;
+				squares = squares + luminance * luminance;
+			}
+
+			float rgb[3][FloatN::Width];
+			color.x.Store(rgb[0]);
+			color.y.Store(rgb[1]);
+			color.z.Store(rgb[2]);
+
+			// See AccumulateMoments in the shader.
+			if (adaptiveThreshold > 0.0f)
+			{
+				float laneSquares[FloatN::Width];
+				squares.Store(laneSquares);
+				for (uint32_t i = 0; i < FloatN::Width && x + i * stride < x1; i++)
+				{
+					float& moment = moments[size_t(y) * width + x + i * stride];
+					moment = (sampleCount > 0) ? moment + laneSquares[i] : laneSquares[i];
+				}
+			}
+
+			if (temporal)
+			{
+				float point[3][FloatN::Width], instance[FloatN::Width];
+				surface.point.x.Store(point[0]);
+				surface.point.y.Store(point[1]);
+				surface.point.z.Store(point[2]);
+				surface.instance.Store(instance);
+
+				// See StoreMotion in the shader.
+				for (uint32_t i = 0; i < FloatN::Width && x + i * stride < x1; i++)
+				{
+					Vector3 current(point[0][i], point[1][i], point[2][i]);
+					Vector3 previous = (instance[i] >= 0.0f) ? instanceMotion[int(instance[i])].TransformPoint(current) : current;
+
+					float currentX, currentY, previousX, previousY;
+					ProjectToPixel(current, camera, currentX, currentY);
+					ProjectToPixel(previous, previousCamera, previousX, previousY);
+					Vector3 toCamera = current - camera.position;
+					Vector3 toPrevious = previous - previousCamera.position;
+
+					MotionTexel& motion = motionVectors[FrameHalf(false) + size_t(y) * width + x + i * stride];
+					motion.x = previousX - currentX;
+					motion.y = previousY - currentY;
+					motion.depth = std::sqrt(Vector3::Dot(toCamera, toCamera));
+					motion.previousDepth = std::sqrt(Vector3::Dot(toPrevious, toPrevious));
+				}
+			}
+
+			if (GBufferOutput())
+			{
+				float normal[3][FloatN::Width], albedo[3][FloatN::Width], depth[FloatN::Width], material[FloatN::Width];
+				surface.normal.x.Store(normal[0]);
+				surface.normal.y.Store(normal[1]);
+				surface.normal.z.Store(normal[2]);
+				surface.albedo.x.Store(albedo[0]);
+				surface.albedo.y.Store(albedo[1]);
+				surface.albedo.z.Store(albedo[2]);
+				surface.depth.Store(depth);
+				surface.material.Store(material);
+
+				for (uint32_t i = 0; i < FloatN::Width && x + i * stride < x1; i++)
+				{
+					GBufferTexel& texel = gbuffer[FrameHalf(false) + size_t(y) * width + x + i * stride];
+					texel.normal = Vector3(normal[0][i], normal[1][i], normal[2][i]);
+					texel.depth = depth[i];
+					texel.albedo = Vector3(albedo[0][i], albedo[1][i], albedo[2][i]);
+					texel.material = int32_t(material[i]);
+				}
+			}
+
+			// Accumulate & average like AccumulatePixel in the shader, then the same UNORM conversion as the imageStore into
+			// the rgba8 compute image, alpha is written as 0 as well.
+			for (uint32_t i = 0; i < FloatN::Width && x + i * stride < x1; i++)
+			{
+				size_t index = size_t(y) * width + x + i * stride;
+				float* sum = &accumulation[index * 4];
+				uint8_t* pixel = pixels + index * 4;
+
+				sum[3] = accumulate ? sum[3] + float(samplesPerPixel) : float(samplesPerPixel);
+				for (int c = 0; c < 3; c++)
+				{
+					sum[c] = accumulate ? sum[c] + rgb[c][i] : rgb[c][i];
+					float average = std::min(std::max(sum[c] / sum[3], 0.0f), 1.0f);
+					pixel[c] = uint8_t(average * 255.0f + 0.5f);
+				}
+				pixel[3] = 0;
+			}
+		}
+	}
+
+	// See Converge in the shader.
+	if (adaptiveThreshold > 0.0f)
+		tileActive[tile] = (TileError(x0, y0, x1, y1) >= adaptiveThreshold) ? 1 : 0;
+
+	std::lock_guard<std::mutex> lock(pathStatsMutex);
+	pathStats.Add(stats);
+}
+
+uint32_t CpuRenderer::InterleavePhase(uint32_t x, uint32_t y) const
+{
+	if (interleave == 2)
+		return (x + y) & 1;
+	return ((x & 1) == (y & 1)) ? (x & 1) : 2 + (y & 1);
+}
+
+bool CpuRenderer::TracedThisFrame(int x, int y) const
+{
+	return x >= 0 && y >= 0 && x < int(width) && y < int(height) && InterleavePhase(uint32_t(x), uint32_t(y)) == frame % interleave;
+}
+
+// See FramesSinceTraced in the shader, sampleCount holds the samples before this frame.
+bool CpuRenderer::HasInterleavedHistory(uint32_t x, uint32_t y) const
+{
+	uint32_t frames = (frame % interleave + interleave - InterleavePhase(x, y)) % interleave;
+	return sampleCount >= (frames == 0 ? interleave : frames) * samplesPerPixel;
+}
+
+void CpuRenderer::ReconstructTile(uint32_t tile, uint8_t* pixels)
+{
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	uint32_t x0 = (tile % tilesX) * TileSize;
+	uint32_t y0 = (tile / tilesX) * TileSize;
+	uint32_t x1 = std::min(x0 + TileSize, width);
+	uint32_t y1 = std::min(y0 + TileSize, height);
+
+	// Only reads the pixels RenderTile wrote, never the ones written here.
+	auto load = [this, pixels](int x, int y, float* color)
+	{
+		const uint8_t* pixel = pixels + (size_t(y) * width + x) * 4;
+		for (int c = 0; c < 3; c++)
+			color[c] = pixel[c] / 255.0f;
+	};
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			if (TracedThisFrame(int(x), int(y)))
+				continue;
+
+			size_t index = size_t(y) * width + x;
+			float color[3] = {};
+			if (HasInterleavedHistory(x, y))
+			{
+				const float* sum = &accumulation[index * 4];
+				for (int c = 0; c < 3; c++)
+					color[c] = std::min(std::max(sum[c] / sum[3], 0.0f), 1.0f);
+			}
+			else
+			{
+				// See Reconstruct in the shader.
+				const int directions[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 } };
+				bool found = false;
+				float bestDifference = 0.0f;
+				for (const auto& direction : directions)
+				{
+					int ax = int(x) + direction[0], ay = int(y) + direction[1];
+					int bx = int(x) - direction[0], by = int(y) - direction[1];
+					if (!TracedThisFrame(ax, ay) || !TracedThisFrame(bx, by))
+						continue;
+
+					float a[3], b[3];
+					load(ax, ay, a);
+					load(bx, by, b);
+					float difference = std::abs(Luminance(a[0], a[1], a[2]) - Luminance(b[0], b[1], b[2]));
+					if (!found || difference < bestDifference)
+					{
+						found = true;
+						bestDifference = difference;
+						for (int c = 0; c < 3; c++)
+							color[c] = (a[c] + b[c]) * 0.5f;
+					}
+				}
+
+				if (!found)
+				{
+					float count = 0.0f;
+					for (int j = -1; j <= 1; j++)
+					{
+						for (int i = -1; i <= 1; i++)
+						{
+							if (!TracedThisFrame(int(x) + i, int(y) + j))
+								continue;
+
+							float tap[3];
+							load(int(x) + i, int(y) + j, tap);
+							for (int c = 0; c < 3; c++)
+								color[c] += tap[c];
+							count += 1.0f;
+						}
+					}
+					for (int c = 0; c < 3; c++)
+						color[c] /= std::max(count, 1.0f);
+				}
+			}
+
+			uint8_t* pixel = pixels + index * 4;
+			for (int c = 0; c < 3; c++)
+				pixel[c] = uint8_t(color[c] * 255.0f + 0.5f);
+			pixel[3] = 0;
+		}
+	}
+}
+
+float CpuRenderer::TileError(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const
+{
+	// All pixels of a tile have the same number of samples.
+	float samples = accumulation[(size_t(y0) * width + x0) * 4 + 3];
+	if (samples < AdaptiveMinSamples)
+		return AdaptiveMaxError;
+
+	float tileError = 0.0f;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			size_t index = size_t(y) * width + x;
+			const float* sum = &accumulation[index * 4];
+			float mean = Luminance(sum[0], sum[1], sum[2]) / samples;
+			float variance = std::max(moments[index] / samples - mean * mean, 0.0f) * samples / (samples - 1.0f);
+			tileError += std::min(std::sqrt(variance / samples) / (mean + AdaptiveDarkBias), AdaptiveMaxError);
+		}
+	}
+	return tileError / float((x1 - x0) * (y1 - y0));
+}
+
+// Radiance of this frame, see TemporalCurrent in the shader.
+Vector3 CpuRenderer::TemporalCurrent(uint32_t x, uint32_t y) const
+{
+	const float* sum = &accumulation[(size_t(y) * width + x) * 4];
+	float samples = sum[3];
+	return Vector3(std::min(sum[0] / samples, TemporalMaxRadiance), std::min(sum[1] / samples, TemporalMaxRadiance),
+		std::min(sum[2] / samples, TemporalMaxRadiance));
+}
+
+bool CpuRenderer::TemporalMatch(size_t tapIndex, const GBufferTexel& surface, const MotionTexel& motion) const
+{
+	const GBufferTexel& previous = gbuffer[FrameHalf(true) + tapIndex];
+	float previousDepth = motionVectors[FrameHalf(true) + tapIndex].depth;
+	return previous.material == surface.material && Vector3::Dot(previous.normal, surface.normal) >= TemporalNormalThreshold
+		&& std::abs(previousDepth - motion.previousDepth) <= TemporalDepthTolerance * motion.previousDepth;
+}
+
+// Mirrors Temporal in the shader, the scalar way like DenoiseTile.
+void CpuRenderer::TemporalTile(uint32_t tile, uint8_t* pixels)
+{
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	uint32_t x0 = (tile % tilesX) * TileSize;
+	uint32_t y0 = (tile / tilesX) * TileSize;
+	uint32_t x1 = std::min(x0 + TileSize, width);
+	uint32_t y1 = std::min(y0 + TileSize, height);
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			size_t index = size_t(y) * width + x;
+			Vector3 current = TemporalCurrent(x, y);
+
+			Vector3 sum, squares;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					uint32_t tapX = uint32_t(std::min(std::max(int(x) + dx, 0), int(width) - 1));
+					uint32_t tapY = uint32_t(std::min(std::max(int(y) + dy, 0), int(height) - 1));
+					Vector3 color = TemporalCurrent(tapX, tapY);
+					sum = sum + color;
+					squares = squares + color * color;
+				}
+			}
+			Vector3 mean = sum / 9.0f;
+			Vector3 variance = squares / 9.0f - mean * mean;
+			Vector3 deviation(std::sqrt(std::max(variance.x, 0.0f)), std::sqrt(std::max(variance.y, 0.0f)),
+				std::sqrt(std::max(variance.z, 0.0f)));
+
+			const GBufferTexel& surface = gbuffer[FrameHalf(false) + index];
+			const MotionTexel& motion = motionVectors[FrameHalf(false) + index];
+			float positionX = float(x) + motion.x;
+			float positionY = float(y) + motion.y;
+			float cornerX = std::floor(positionX);
+			float cornerY = std::floor(positionY);
+			float fractionX = positionX - cornerX;
+			float fractionY = positionY - cornerY;
+
+			Vector3 previousColor;
+			float previousFrames = 0.0f;
+			float weightSum = 0.0f;
+			for (int i = 0; i < 4 && frame > 0; i++)
+			{
+				int offsetX = i % 2;
+				int offsetY = i / 2;
+				float tapX = cornerX + float(offsetX);
+				float tapY = cornerY + float(offsetY);
+				if (tapX < 0.0f || tapY < 0.0f || tapX >= float(width) || tapY >= float(height))
+					continue;
+
+				size_t tapIndex = size_t(tapY) * width + size_t(tapX);
+				if (!TemporalMatch(tapIndex, surface, motion))
+					continue;
+
+				float weight = (offsetX ? fractionX : 1.0f - fractionX) * (offsetY ? fractionY : 1.0f - fractionY);
+				const HistoryTexel& tap = history[FrameHalf(true) + tapIndex];
+				previousColor = previousColor + tap.color * weight;
+				previousFrames += tap.frames * weight;
+				weightSum += weight;
+			}
+
+			// Disoccluded pixels start over from this frame.
+			Vector3 color = current;
+			float frames = 1.0f;
+			if (weightSum > 0.01f)
+			{
+				frames = std::min(previousFrames / weightSum + 1.0f, TemporalMaxHistory);
+				Vector3 clipped = ClipToBox(previousColor / weightSum, mean, deviation * TemporalClipGamma);
+				color = clipped + (current - clipped) * (1.0f / frames);
+			}
+
+			history[FrameHalf(false) + index] = { color, frames };
+
+			uint8_t* pixel = pixels + index * 4;
+			pixel[0] = uint8_t(std::min(std::max(color.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+			pixel[1] = uint8_t(std::min(std::max(color.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+			pixel[2] = uint8_t(std::min(std::max(color.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+// Demodulated radiance before an iteration, see DenoiseInput in the shader.
+Vector3 CpuRenderer::DenoiseInput(size_t index, uint32_t iteration) const
+{
+	if (iteration > 0)
+		return denoiseColors[((iteration - 1) % 2) * size_t(width) * height + index];
+
+	Vector3 radiance;
+	if (temporal)
+		radiance = history[FrameHalf(false) + index].color;
+	else
+	{
+		const float* sum = &accumulation[index * 4];
+		radiance = Vector3(sum[0], sum[1], sum[2]) / sum[3];
+	}
+	radiance = Vector3(std::min(radiance.x, DenoiseMaxRadiance), std::min(radiance.y, DenoiseMaxRadiance),
+		std::min(radiance.z, DenoiseMaxRadiance));
+	return radiance / DenoiseAlbedo(gbuffer[FrameHalf(false) + index].albedo);
+}
+
+// Mirrors Denoise in the shader, the scalar way. It is a reference, not the fast path.
+void CpuRenderer::DenoiseTile(uint32_t tile, uint32_t iteration, uint8_t* pixels)
+{
+	static const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	uint32_t x0 = (tile % tilesX) * TileSize;
+	uint32_t y0 = (tile / tilesX) * TileSize;
+	uint32_t x1 = std::min(x0 + TileSize, width);
+	uint32_t y1 = std::min(y0 + TileSize, height);
+
+	int step = 1 << iteration;
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x++)
+		{
+			size_t index = size_t(y) * width + x;
+			const GBufferTexel& center = gbuffer[FrameHalf(false) + index];
+			Vector3 centerColor = DenoiseInput(index, iteration);
+			// The history holds samples of several frames.
+			float samples = temporal ? history[FrameHalf(false) + index].frames * float(samplesPerPixel)
+				: accumulation[index * 4 + 3];
+			float colorSigma = DenoiseColorSigma / (float(step) * std::sqrt(samples));
+
+			Vector3 sum;
+			float weightSum = 0.0f;
+			for (int dy = -2; dy <= 2; dy++)
+			{
+				for (int dx = -2; dx <= 2; dx++)
+				{
+					int tapX = int(x) + dx * step;
+					int tapY = int(y) + dy * step;
+					if (tapX < 0 || tapY < 0 || tapX >= int(width) || tapY >= int(height))
+						continue;
+
+					size_t tapIndex = size_t(tapY) * width + tapX;
+					const GBufferTexel& texel = gbuffer[FrameHalf(false) + tapIndex];
+					if (texel.material != center.material)
+						continue;
+
+					Vector3 color = DenoiseInput(tapIndex, iteration);
+					Vector3 difference = color - centerColor;
+					float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)]
+						* std::exp(-Vector3::Dot(difference, difference) / (colorSigma * colorSigma))
+						* std::pow(std::max(Vector3::Dot(center.normal, texel.normal), 0.0f), DenoiseNormalPower);
+					if (center.depth < Inf)
+						weight *= std::exp(-std::abs(texel.depth - center.depth) / (DenoiseDepthSigma * center.depth * float(step)));
+
+					sum = sum + color * weight;
+					weightSum += weight;
+				}
+			}
+
+			Vector3 filtered = sum / weightSum;
+			if (iteration + 1 < denoiseIterations)
+			{
+				denoiseColors[(iteration % 2) * size_t(width) * height + index] = filtered;
+				continue;
+			}
+
+			// Modulated again & converted like RenderTile writes the pixels.
+			Vector3 color = filtered * DenoiseAlbedo(center.albedo);
+			uint8_t* pixel = pixels + index * 4;
+			pixel[0] = uint8_t(std::min(std::max(color.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+			pixel[1] = uint8_t(std::min(std::max(color.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+			pixel[2] = uint8_t(std::min(std::max(color.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+
+Vector3N CpuRenderer::Camera(FloatN x, FloatN y) const
+{
+	float w = float(imageWidth);
+	float h = float(imageHeight);
+
+	float fovX = PI / 4;
+	float fovY = (h / w) * fovX;
+
+	FloatN _x = ((FloatN(2.0f) * x - FloatN(w)) / FloatN(w)) * FloatN(std::tan(fovX));
+	FloatN _y = FloatN(0.0f) - ((FloatN(2.0f) * y - FloatN(h)) / FloatN(h)) * FloatN(std::tan(fovY));
+
+	return Vector3N(_x, _y, FloatN(-1.0f));
+}
+
+void CpuRenderer::ProjectToPixel(const Vector3& point, const CameraPose& pose, float& x, float& y) const
+{
+	Vector3 local = RotateYaw(point - pose.position, -pose.yaw);
+	// Behind the camera, outside of every image.
+	if (local.z >= 0.0f)
+	{
+		x = y = -Inf;
+		return;
+	}
+
+	float w = float(imageWidth);
+	float h = float(imageHeight);
+
+	float fovX = PI / 4;
+	float fovY = (h / w) * fovX;
+
+	float scale = (-1.0f - CameraEyeZ) / local.z;
+	x = (local.x * scale / std::tan(fovX) + 1.0f) * w * 0.5f - float(viewX);
+	y = (1.0f - local.y * scale / std::tan(fovY)) * h * 0.5f - float(viewY);
+}
+
+void CpuRenderer::TryGetIntersection(const Vector3N& origin, const Vector3N& direction, MaskN active, HitN& hit, MaskN& found) const
+{
+	hit.id = FloatN(-1.0f);
+	hit.distance = FloatN(Inf);
+	hit.kind = FloatN(HitPlane);
+	hit.instance = FloatN(-1.0f);
+
+	for (size_t i = 0; i < primitives.planes.size(); i++)
+	{
+		FloatN dist = PlaneIntersection(origin, direction, primitives.planes[i], epsilon);
+		MaskN closer = active & (dist > FloatN(epsilon)) & (dist < hit.distance);
+
+		hit.distance = Select(closer, dist, hit.distance);
+		hit.id = Select(closer, FloatN(float(i)), hit.id);
+		hit.kind = Select(closer, FloatN(HitPlane), hit.kind);
+	}
+
+	IntersectBvh(origin, direction, active, 0, int(HitSphere), -1, FloatN(-1.0f), hit);
+	IntersectInstances(origin, direction, active, FloatN(-1.0f), FloatN(-1.0f), hit);
+
+	found = hit.id > FloatN(-1.0f);
+}
+
+FloatN CpuRenderer::TriangleIntersection(const Vector3N& origin, const RayShearN& shear, int32_t triangle) const
+{
+	Vector3N a = Broadcast(vertices[indices[3 * triangle]].position) - origin;
+	Vector3N b = Broadcast(vertices[indices[3 * triangle + 1]].position) - origin;
+	Vector3N c = Broadcast(vertices[indices[3 * triangle + 2]].position) - origin;
+
+	FloatN az = Pick(a, shear.z0, shear.z1), bz = Pick(b, shear.z0, shear.z1), cz = Pick(c, shear.z0, shear.z1);
+	FloatN ax = Pick(a, shear.x0, shear.x1) - shear.sx * az;
+	FloatN ay = Pick(a, shear.y0, shear.y1) - shear.sy * az;
+	FloatN bx = Pick(b, shear.x0, shear.x1) - shear.sx * bz;
+	FloatN by = Pick(b, shear.y0, shear.y1) - shear.sy * bz;
+	FloatN cx = Pick(c, shear.x0, shear.x1) - shear.sx * cz;
+	FloatN cy = Pick(c, shear.y0, shear.y1) - shear.sy * cz;
+
+	// Scaled barycentrics, a hit needs all of them to have the same sign.
+	FloatN u = cx * by - cy * bx;
+	FloatN v = ax * cy - ay * cx;
+	FloatN w = bx * ay - by * ax;
+
+	FloatN zero(0.0f);
+	MaskN outside = ((u < zero) | (v < zero) | (w < zero)) & ((u > zero) | (v > zero) | (w > zero));
+
+	FloatN det = u + v + w;
+	FloatN t = shear.sz * (u * az + v * bz + w * cz) / det;
+
+	MaskN hit = AndNot((det != zero) & (t > FloatN(epsilon)), outside);
+	return Select(hit, t, zero);
+}
+
+void CpuRenderer::IntersectBvh(const Vector3N& origin, const Vector3N& direction, MaskN active, int32_t root, int kind, int instance,
+	FloatN skip, HitN& hit) const
+{
+	Vector3N invDirection(FloatN(1.0f) / direction.x, FloatN(1.0f) / direction.y, FloatN(1.0f) / direction.z);
+
+	FloatN enter;
+	if (None(active & BoxIntersection(origin, invDirection, nodes[root], hit.distance, enter)))
+		return;
+
+	RayShearN shear(direction);
+
+	int32_t stack[Bvh::MaxDepth];
+	int stackSize = 0;
+	int32_t node = root;
+
+	while (true)
+	{
+		const BvhNode& current = nodes[node];
+
+		if (current.count > 0)
+		{
+			for (int32_t i = current.leftOrFirst; i < current.leftOrFirst + current.count; i++)
+			{
+				MaskN self = skip == FloatN(float(i));
+
+				FloatN dist = (kind == int(HitSphere)) ? SphereIntersection(origin, direction, primitives.spheres[i], epsilon) : TriangleIntersection(origin, shear, i);
+				MaskN closer = AndNot(active & (dist > FloatN(epsilon)) & (dist < hit.distance), self);
+
+				hit.distance = Select(closer, dist, hit.distance);
+				hit.id = Select(closer, FloatN(float(i)), hit.id);
+				hit.kind = Select(closer, FloatN(float(kind)), hit.kind);
+				hit.instance = Select(closer, FloatN(float(instance)), hit.instance);
+			}
+		}
+		else
+		{
+			int32_t left = current.leftOrFirst;
+			FloatN enterLeft, enterRight;
+			MaskN hitLeft = active & BoxIntersection(origin, invDirection, nodes[left], hit.distance, enterLeft);
+			MaskN hitRight = active & BoxIntersection(origin, invDirection, nodes[left + 1], hit.distance, enterRight);
+
+			if (Any(hitLeft | hitRight))
+			{
+				// Descend into the child most lanes reach first, the other one waits on the stack.
+				MaskN nearerLeft = hitLeft & ((enterLeft <= enterRight) | AndNot(MaskAll(), hitRight));
+				bool leftFirst = CountLanes(nearerLeft) * 2 >= CountLanes(hitLeft | hitRight);
+
+				int32_t nearChild = leftFirst ? left : left + 1;
+				int32_t farChild = leftFirst ? left + 1 : left;
+				MaskN nearHit = leftFirst ? hitLeft : hitRight;
+				MaskN farHit = leftFirst ? hitRight : hitLeft;
+
+				if (!Any(nearHit))
+					node = farChild;
+				else
+				{
+					if (Any(farHit))
+						stack[stackSize++] = farChild;
+					node = nearChild;
+				}
+
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		node = stack[--stackSize];
+	}
+}
+
+void CpuRenderer::IntersectInstances(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN skipInstance, FloatN skip,
+	HitN& hit) const
+{
+	if (instances.empty())
+		return;
+
+	Vector3N invDirection(FloatN(1.0f) / direction.x, FloatN(1.0f) / direction.y, FloatN(1.0f) / direction.z);
+
+	FloatN enter;
+	if (None(active & BoxIntersection(origin, invDirection, instanceNodes[0], hit.distance, enter)))
+		return;
+
+	int32_t stack[Bvh::MaxDepth];
+	int stackSize = 0;
+	int32_t node = 0;
+
+	while (true)
+	{
+		const BvhNode& current = instanceNodes[node];
+
+		if (current.count > 0)
+		{
+			for (int32_t i = current.leftOrFirst; i < current.leftOrFirst + current.count; i++)
+			{
+				// Same unnormalized transform as the shader, so distances stay comparable.
+				const auto& instance = instances[i];
+				Vector3N localOrigin = TransformPoint(instance.worldToObject, origin);
+				Vector3N localDirection = TransformVector(instance.worldToObject, direction);
+
+				FloatN instanceSkip = Select(skipInstance == FloatN(float(i)), skip, FloatN(-1.0f));
+				IntersectBvh(localOrigin, localDirection, active, meshes[instance.mesh].rootNode, int(HitTriangle), i, instanceSkip, hit);
+			}
+		}
+		else
+		{
+			int32_t left = current.leftOrFirst;
+			FloatN enterLeft, enterRight;
+			MaskN hitLeft = active & BoxIntersection(origin, invDirection, instanceNodes[left], hit.distance, enterLeft);
+			MaskN hitRight = active & BoxIntersection(origin, invDirection, instanceNodes[left + 1], hit.distance, enterRight);
+
+			if (Any(hitLeft | hitRight))
+			{
+				MaskN nearerLeft = hitLeft & ((enterLeft <= enterRight) | AndNot(MaskAll(), hitRight));
+				bool leftFirst = CountLanes(nearerLeft) * 2 >= CountLanes(hitLeft | hitRight);
+
+				int32_t nearChild = leftFirst ? left : left + 1;
+				int32_t farChild = leftFirst ? left + 1 : left;
+				MaskN nearHit = leftFirst ? hitLeft : hitRight;
+				MaskN farHit = leftFirst ? hitRight : hitLeft;
+
+				if (!Any(nearHit))
+					node = farChild;
+				else
+				{
+					if (Any(farHit))
+						stack[stackSize++] = farChild;
+					node = nearChild;
+				}
+
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		node = stack[--stackSize];
+	}
+}
+
+// Lanes drop out as soon as they hit anything, the packet leaves once no active lane is left searching.
+// Children are taken in node order, there is no nearest hit to find first.
+MaskN CpuRenderer::OccludedBvh(const Vector3N& origin, const Vector3N& direction, MaskN active, int32_t root, int kind, FloatN skip,
+	FloatN maxDist) const
+{
+	MaskN occluded = MaskNone();
+	Vector3N invDirection(FloatN(1.0f) / direction.x, FloatN(1.0f) / direction.y, FloatN(1.0f) / direction.z);
+
+	FloatN enter;
+	if (None(active & BoxIntersection(origin, invDirection, nodes[root], maxDist, enter)))
+		return occluded;
+
+	RayShearN shear(direction);
+
+	int32_t stack[Bvh::MaxDepth];
+	int stackSize = 0;
+	int32_t node = root;
+
+	while (true)
+	{
+		const BvhNode& current = nodes[node];
+
+		if (current.count > 0)
+		{
+			for (int32_t i = current.leftOrFirst; i < current.leftOrFirst + current.count; i++)
+			{
+				MaskN self = skip == FloatN(float(i));
+
+				FloatN dist = (kind == int(HitSphere)) ? SphereIntersection(origin, direction, primitives.spheres[i], epsilon) : TriangleIntersection(origin, shear, i);
+				occluded = occluded | AndNot(active & (dist > FloatN(epsilon)) & (dist < maxDist), self);
+
+				if (None(AndNot(active, occluded)))
+					return occluded;
+			}
+		}
+		else
+		{
+			MaskN searching = AndNot(active, occluded);
+
+			int32_t left = current.leftOrFirst;
+			FloatN enterLeft, enterRight;
+			MaskN hitLeft = searching & BoxIntersection(origin, invDirection, nodes[left], maxDist, enterLeft);
+			MaskN hitRight = searching & BoxIntersection(origin, invDirection, nodes[left + 1], maxDist, enterRight);
+
+			if (Any(hitLeft | hitRight))
+			{
+				if (!Any(hitLeft))
+					node = left + 1;
+				else
+				{
+					if (Any(hitRight))
+						stack[stackSize++] = left + 1;
+					node = left;
+				}
+
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		node = stack[--stackSize];
+	}
+
+	return occluded;
+}
+
+MaskN CpuRenderer::OccludedInstances(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN skipInstance, FloatN skip,
+	FloatN maxDist) const
+{
+	MaskN occluded = MaskNone();
+	if (instances.empty())
+		return occluded;
+
+	Vector3N invDirection(FloatN(1.0f) / direction.x, FloatN(1.0f) / direction.y, FloatN(1.0f) / direction.z);
+
+	FloatN enter;
+	if (None(active & BoxIntersection(origin, invDirection, instanceNodes[0], maxDist, enter)))
+		return occluded;
+
+	int32_t stack[Bvh::MaxDepth];
+	int stackSize = 0;
+	int32_t node = 0;
+
+	while (true)
+	{
+		const BvhNode& current = instanceNodes[node];
+		MaskN searching = AndNot(active, occluded);
+
+		if (current.count > 0)
+		{
+			for (int32_t i = current.leftOrFirst; i < current.leftOrFirst + current.count && Any(searching); i++)
+			{
+				const auto& instance = instances[i];
+				Vector3N localOrigin = TransformPoint(instance.worldToObject, origin);
+				Vector3N localDirection = TransformVector(instance.worldToObject, direction);
+
+				FloatN instanceSkip = Select(skipInstance == FloatN(float(i)), skip, FloatN(-1.0f));
+				occluded = occluded | OccludedBvh(localOrigin, localDirection, searching, meshes[instance.mesh].rootNode, int(HitTriangle),
+					instanceSkip, maxDist);
+				searching = AndNot(active, occluded);
+			}
+
+			if (None(searching))
+				return occluded;
+		}
+		else
+		{
+			int32_t left = current.leftOrFirst;
+			FloatN enterLeft, enterRight;
+			MaskN hitLeft = searching & BoxIntersection(origin, invDirection, instanceNodes[left], maxDist, enterLeft);
+			MaskN hitRight = searching & BoxIntersection(origin, invDirection, instanceNodes[left + 1], maxDist, enterRight);
+
+			if (Any(hitLeft | hitRight))
+			{
+				if (!Any(hitLeft))
+					node = left + 1;
+				else
+				{
+					if (Any(hitRight))
+						stack[stackSize++] = left + 1;
+					node = left;
+				}
+
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		node = stack[--stackSize];
+	}
+
+	return occluded;
+}
+
+// Whether anything but surface lies between origin & maxDist, checked cheapest first.
+MaskN CpuRenderer::Occluded(const Vector3N& origin, const Vector3N& direction, MaskN active, const HitN& surface, FloatN maxDist) const
+{
+	MaskN occluded = MaskNone();
+
+	for (size_t i = 0; i < primitives.planes.size(); i++)
+	{
+		MaskN self = (surface.id == FloatN(float(i))) & (surface.kind == FloatN(HitPlane));
+
+		FloatN dist = PlaneIntersection(origin, direction, primitives.planes[i], epsilon);
+		occluded = occluded | AndNot(active & (dist > FloatN(epsilon)) & (dist < maxDist), self);
+	}
+
+	FloatN noSkip(-1.0f);
+	MaskN searching = AndNot(active, occluded);
+	if (Any(searching))
+		occluded = occluded | OccludedBvh(origin, direction, searching, 0, int(HitSphere), Select(surface.kind == FloatN(HitSphere), surface.id, noSkip),
+			maxDist);
+
+	searching = AndNot(active, occluded);
+	if (Any(searching))
+		occluded = occluded | OccludedInstances(origin, direction, searching,
+			Select(surface.kind == FloatN(HitTriangle), surface.instance, noSkip), surface.id, maxDist);
+
+	return occluded;
+}
+
+void CpuRenderer::HitLights(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN maxDist, MaskN& hit,
+	Vector3N& emission) const
+{
+	// One light against the whole packet at a time, the same tests as Light::Intersect.
+	FloatN closest = maxDist;
+	hit = MaskNone();
+	emission = Vector3N(0.0f, 0.0f, 0.0f);
+
+	for (const auto& light : lights)
+	{
+		Vector3N position = Broadcast(light.position);
+		FloatN dist(-1.0f);
+		MaskN front = MaskNone();
+
+		if (light.type == LightRectangle)
+		{
+			Vector3 n = Vector3::Cross(light.u, light.v);
+			Vector3N normal = Broadcast(n), u = Broadcast(light.u), v = Broadcast(light.v);
+			FloatN denom = Dot(normal, direction);
+			FloatN t = Dot(normal, position - origin) / denom;
+			Vector3N local = origin + direction * t - position;
+			FloatN a = Dot(local, u) * FloatN(1.0f / Vector3::Dot(light.u, light.u));
+			FloatN b = Dot(local, v) * FloatN(1.0f / Vector3::Dot(light.v, light.v));
+			MaskN inside = (denom != FloatN(0.0f)) & (a >= FloatN(0.0f)) & (a <= FloatN(1.0f)) & (b >= FloatN(0.0f)) & (b <= FloatN(1.0f));
+			dist = Select(inside, t, dist);
+			front = denom < FloatN(0.0f);
+		}
+		else if (light.type == LightSphere)
+		{
+			Vector3N offset = origin - position;
+			FloatN b = Dot(offset, direction);
+			FloatN c = Dot(offset, offset) - FloatN(light.radius * light.radius);
+			FloatN discriminant = b * b - c;
+			FloatN root = Sqrt(Max(discriminant, FloatN(0.0f)));
+			FloatN nearest = FloatN(0.0f) - b - root;
+			dist = Select(discriminant >= FloatN(0.0f), Select(nearest > FloatN(0.0f), nearest, root - b), dist);
+			front = MaskAll();
+		}
+		else
+			continue;
+
+		MaskN closer = active & (dist > FloatN(epsilon)) & (dist < closest);
+		if (!Any(closer))
+			continue;
+
+		closest = Select(closer, dist, closest);
+		hit = hit | closer;
+		emission = Select(closer, Select(front, Broadcast(light.emission), Vector3N(0.0f, 0.0f, 0.0f)), emission);
+	}
+}
+
+void CpuRenderer::SampleLights(const Vector3N& hitPoint, MaskN active, uint32_t x, uint32_t y, uint32_t index, int bounce,
+	MaskN& sampled, Vector3N& direction, FloatN& distance, Vector3N& radiance) const
+{
+	// Without a sampler always the same light & the center of it.
+	FloatN su(0.5f), sv(0.5f);
+	if (sampler.IsStochastic())
+		Sample2D(x, y, index, LightDimension(bounce), su, sv);
+
+	float us[FloatN::Width], vs[FloatN::Width], px[FloatN::Width], py[FloatN::Width], pz[FloatN::Width];
+	float dx[FloatN::Width], dy[FloatN::Width], dz[FloatN::Width], ds[FloatN::Width];
+	float rr[FloatN::Width], rg[FloatN::Width], rb[FloatN::Width], ok[FloatN::Width];
+	su.Store(us);
+	sv.Store(vs);
+	hitPoint.x.Store(px);
+	hitPoint.y.Store(py);
+	hitPoint.z.Store(pz);
+
+	int activeBits = active.Bits();
+	for (int i = 0; i < FloatN::Width; i++)
+	{
+		dx[i] = dy[i] = dz[i] = rr[i] = rg[i] = rb[i] = ok[i] = 0.0f;
+		ds[i] = 1.0f;
+		if (!(activeBits & (1 << i)) || lights.empty())
+			continue;
+
+		float pickPdf;
+		int light = PickLight(lights, us[i], pickPdf);
+
+		LightSample sample;
+		if (!lights[light].Sample(Vector3(px[i], py[i], pz[i]), us[i], vs[i], sample))
+			continue;
+
+		dx[i] = sample.direction.x;
+		dy[i] = sample.direction.y;
+		dz[i] = sample.direction.z;
+		ds[i] = sample.distance;
+		rr[i] = sample.radiance.x / pickPdf;
+		rg[i] = sample.radiance.y / pickPdf;
+		rb[i] = sample.radiance.z / pickPdf;
+		ok[i] = 1.0f;
+	}
+
+	sampled = active & (FloatN::Load(ok) > FloatN(0.0f));
+	direction = Vector3N(FloatN::Load(dx), FloatN::Load(dy), FloatN::Load(dz));
+	distance = FloatN::Load(ds);
+	radiance = Vector3N(FloatN::Load(rr), FloatN::Load(rg), FloatN::Load(rb));
+}
+
+FloatN CpuRenderer::GetShadow(const Vector3N& origin, const Vector3N& direction, MaskN active, const HitN& surface, FloatN maxDist) const
+{
+	// See GetShadow in the shader, only previews without a sampler keep the shadow brightness.
+	FloatN blocked(sampler.IsStochastic() ? 0.0f : shadow);
+	return Select(Occluded(origin, direction, active, surface, maxDist), blocked, FloatN(1.0f));
+}
+
+void CpuRenderer::Sample2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension, FloatN& u, FloatN& v) const
+{
+	float us[FloatN::Width], vs[FloatN::Width];
+	for (int i = 0; i < FloatN::Width; i++)
+		sampler.Get2D(viewX + x + i * PixelStride(), viewY + y, index, dimension, us[i], vs[i]);
+
+	u = FloatN::Load(us);
+	v = FloatN::Load(vs);
+}
+
+Vector3N CpuRenderer::Trace(Vector3N origin, Vector3N direction, MaskN active, uint32_t x, uint32_t y, uint32_t index,
+	PathStats& stats, SurfaceN* surface) const
+{
+	Vector3N radiance(0.0f, 0.0f, 0.0f);
+	Vector3N throughput(1.0f, 1.0f, 1.0f);
+	// Lanes which count emission they hit, which diffuse bounces don't as they sample the light directly.
+	MaskN countEmission = MaskAll();
+	// Lanes without a diffuse bounce so far, which still write the G-buffer surface.
+	MaskN primary = MaskAll();
+	stats.paths += CountLanes(active);
+
+	for (int bounce = 0; bounce < maxBounces; bounce++)
+	{
+		stats.segments += CountLanes(active);
+
+		HitN hit;
+		MaskN found;
+		TryGetIntersection(origin, direction, active, hit, found);
+
+		// Lights aren't in the hierarchies, paths end on the closest one, see HitLight in the shader.
+		MaskN lightHit;
+		Vector3N emission;
+		HitLights(origin, direction, active, Select(found, hit.distance, FloatN(Inf)), lightHit, emission);
+		radiance = Select(lightHit & countEmission, radiance + throughput * emission, radiance);
+
+		// Lights & the background are the G-buffer surface of paths which only met mirrors so far.
+		if (surface)
+			surface->Store(active & primary & (lightHit | AndNot(active, found)), direction * FloatN(-1.0f), FloatN(Inf),
+				Vector3N(1.0f, 1.0f, 1.0f), FloatN(-1.0f));
+		// Motion vectors start at the first hit, lights & misses are far along the ray.
+		if (surface && bounce == 0)
+		{
+			MaskN onSurface = AndNot(found, lightHit);
+			surface->point = Select(onSurface, origin + direction * hit.distance, origin + direction * FloatN(Inf));
+			surface->instance = Select(onSurface & (hit.kind == FloatN(HitTriangle)), hit.instance, FloatN(-1.0f));
+		}
+		active = AndNot(active, lightHit);
+
+		// Lanes without intersection see a white background & stop.
+		radiance = Select(AndNot(active, found), radiance + throughput, radiance);
+		active = active & found;
+		if (None(active))
+			break;
+
+		Vector3N hitPoint = Select(active, origin + direction * hit.distance, origin);
+
+		// Gather normal & material of the hit primitive per lane, see GetSurface in the shader.
+		float ids[FloatN::Width], kinds[FloatN::Width], instanceIds[FloatN::Width];
+		float px[FloatN::Width], py[FloatN::Width], pz[FloatN::Width], dx[FloatN::Width], dy[FloatN::Width], dz[FloatN::Width];
+		float nx[FloatN::Width], ny[FloatN::Width], nz[FloatN::Width];
+		float cr[FloatN::Width], cg[FloatN::Width], cb[FloatN::Width], types[FloatN::Width], materialIds[FloatN::Width];
+		hit.id.Store(ids);
+		hit.kind.Store(kinds);
+		hit.instance.Store(instanceIds);
+		hitPoint.x.Store(px);
+		hitPoint.y.Store(py);
+		hitPoint.z.Store(pz);
+		direction.x.Store(dx);
+		direction.y.Store(dy);
+		direction.z.Store(dz);
+
+		int activeBits = active.Bits();
+		for (int i = 0; i < FloatN::Width; i++)
+		{
+			nx[i] = ny[i] = nz[i] = cr[i] = cg[i] = cb[i] = types[i] = materialIds[i] = 0.0f;
+			if (!(activeBits & (1 << i)))
+				continue;
+
+			const Material* mat;
+			if (kinds[i] == HitSphere)
+			{
+				const PrimitiveGeometry& s = primitives.spheres[int(ids[i])];
+				nx[i] = (px[i] - s.xyz.x) / s.w;
+				ny[i] = (py[i] - s.xyz.y) / s.w;
+				nz[i] = (pz[i] - s.xyz.z) / s.w;
+				mat = &primitives.materials[primitives.SphereMaterial(uint32_t(ids[i]))];
+				materialIds[i] = float(primitives.SphereMaterial(uint32_t(ids[i])));
+			}
+			else if (kinds[i] == HitTriangle)
+			{
+				int triangle = int(ids[i]);
+				const auto& instance = instances[int(instanceIds[i])];
+				const Vector3& a = vertices[indices[3 * triangle]].position;
+				const Vector3& b = vertices[indices[3 * triangle + 1]].position;
+				const Vector3& c = vertices[indices[3 * triangle + 2]].position;
+
+				// Back to world space with the inverse transpose, meshes are two sided, the normal always faces the incoming ray.
+				Vector3 normal = instance.worldToObject.TransformNormal(Vector3::Cross(b - a, c - a)).Normalized();
+				if (Vector3::Dot(normal, Vector3(dx[i], dy[i], dz[i])) > 0)
+					normal = normal * -1.0f;
+
+				nx[i] = normal.x;
+				ny[i] = normal.y;
+				nz[i] = normal.z;
+				mat = instance.overrideMaterial ? &instance.mat : &meshes[instance.mesh].mat;
+				materialIds[i] = float(primitives.materials.size()) + instanceIds[i];
+			}
+			else
+			{
+				const PrimitiveGeometry& p = primitives.planes[int(ids[i])];
+				nx[i] = p.xyz.x;
+				ny[i] = p.xyz.y;
+				nz[i] = p.xyz.z;
+				mat = &primitives.materials[int(ids[i])];
+				materialIds[i] = ids[i];
+			}
+
+			cr[i] = mat->color.x;
+			cg[i] = mat->color.y;
+			cb[i] = mat->color.z;
+			types[i] = float(mat->type);
+		}
+
+		Vector3N hitNormal(FloatN::Load(nx), FloatN::Load(ny), FloatN::Load(nz));
+		Vector3N matColor(FloatN::Load(cr), FloatN::Load(cg), FloatN::Load(cb));
+		FloatN matType = FloatN::Load(types);
+
+		// The first surface that isn't a mirror ends the G-buffer surface, mirrors don't tint what they reflect.
+		MaskN first = active & primary;
+		if (surface && Any(first))
+		{
+			Vector3N toCamera = hitPoint - Broadcast(camera.position);
+			surface->Store(first, Select(Dot(hitNormal, direction) > FloatN(0.0f), hitNormal * FloatN(-1.0f), hitNormal),
+				Sqrt(Dot(toCamera, toCamera)), Select(matType == FloatN(2.0f), Vector3N(1.0f, 1.0f, 1.0f), matColor),
+				FloatN::Load(materialIds));
+		}
+
+		// Specular BRDF
+		MaskN specular = active & (matType == FloatN(2.0f));
+		if (Any(specular))
+		{
+			FloatN cost = Dot(direction, hitNormal);
+			Vector3N reflected = Normalize(direction - hitNormal * (cost * FloatN(2.0f)));
+			direction = Select(specular, reflected, direction);
+		}
+
+		MaskN diffuse = active & (matType == FloatN(1.0f));
+		if (Any(diffuse))
+		{
+			// The side of the surface the path arrived on.
+			Vector3N facing = Select(Dot(hitNormal, direction) > FloatN(0.0f), hitNormal * FloatN(-1.0f), hitNormal);
+
+			MaskN sampled;
+			Vector3N lightDir, lightRadiance;
+			FloatN lightDist;
+			SampleLights(hitPoint, diffuse, x, y, index, bounce, sampled, lightDir, lightDist, lightRadiance);
+
+			// Lambertian BRDF times the cosine, the light sample is already divided by its density.
+			FloatN cosSurface = Dot(facing, lightDir);
+			MaskN lit = sampled & (cosSurface > FloatN(0.0f));
+			if (Any(lit))
+			{
+				Vector3N direct = throughput * matColor * (cosSurface * FloatN(1.0f / PI)) * lightRadiance;
+
+				// Shadow Ray, stops short of the light like in the shader.
+				direct = direct * GetShadow(hitPoint, lightDir, lit, hit, lightDist * FloatN(0.999f));
+				radiance = Select(lit, radiance + direct, radiance);
+			}
+
+			// Diffuse bounces need a sampler for their direction.
+			if (!sampler.IsStochastic() || bounce + 1 >= maxBounces)
+			{
+				if (sampler.IsStochastic())
+					stats.maxDepth += CountLanes(diffuse);
+				active = AndNot(active, diffuse);
+			}
+			else
+			{
+				float bx[FloatN::Width], by[FloatN::Width], bz[FloatN::Width];
+				int diffuseBits = diffuse.Bits();
+				for (int i = 0; i < FloatN::Width; i++)
+				{
+					bx[i] = by[i] = bz[i] = 0.0f;
+					if (!(diffuseBits & (1 << i)))
+						continue;
+
+					Vector3 normal(nx[i], ny[i], nz[i]);
+					if (Vector3::Dot(normal, Vector3(dx[i], dy[i], dz[i])) > 0)
+						normal = normal * -1.0f;
+
+					float u, v;
+					sampler.Get2D(viewX + x + i * PixelStride(), viewY + y, index, BounceDimension(bounce), u, v);
+					Vector3 bounceDirection = SampleDiffuse(normal, u, v);
+					bx[i] = bounceDirection.x;
+					by[i] = bounceDirection.y;
+					bz[i] = bounceDirection.z;
+				}
+
+				direction = Select(diffuse, Vector3N(FloatN::Load(bx), FloatN::Load(by), FloatN::Load(bz)), direction);
+				throughput = Select(diffuse, throughput * matColor, throughput);
+			}
+		}
+
+		// Paths off mirrors count the light they hit again.
+		countEmission = AndNot(MaskAll(), diffuse);
+		primary = AndNot(primary, diffuse);
+		origin = hitPoint;
+
+		// Russian roulette past rouletteDepth bounces, see ShadeHit in the shader.
+		if (bounce + 1 >= rouletteDepth && bounce + 1 < maxBounces && sampler.IsStochastic() && Any(active))
+		{
+			FloatN survival = Min(Max(throughput.x, Max(throughput.y, throughput.z)), FloatN(0.95f));
+			FloatN u, v;
+			Sample2D(x, y, index, RouletteDimension(bounce), u, v);
+
+			MaskN ended = active & (u >= survival);
+			stats.roulette += CountLanes(ended);
+			active = AndNot(active, ended);
+			throughput = Select(active, throughput / survival, throughput);
+		}
+	}
+
+	// Paths out of bounces carry no light, like the ones roulette ends.
+	stats.maxDepth += CountLanes(active);
+	return radiance;
+}
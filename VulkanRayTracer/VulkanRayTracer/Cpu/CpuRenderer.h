@@ -0,0 +1,237 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "SimdFloat.h"
+#include "../PathStats.h"
+#include "../Sampler.h"
+#include "../Scene/Bvh.h"
+#include "../Scene/Camera.h"
+#include "../Scene/InstanceSet.h"
+#include "../Scene/Light.h"
+#include "../Scene/Mesh.h"
+#include "../Scene/Planee.h"
+#include "../Scene/PrimitiveBuffers.h"
+#include "../Scene/Sphere.h"
+
+/// <summary>
+/// Renders the scene on the CPU, mirroring Camera, TryGetIntersection, GetShadow, ShadeHit & Trace of shaders/raytracing.comp.
+/// Rays are traced in packets of FloatN::Width horizontally neighbouring pixels, image tiles are
+/// distributed over a work stealing thread pool. Packets walk the hierarchies together, a node is entered if any lane hits it.
+/// It serves as fallback for machines without a Vulkan device & as reference to validate GPU output against.
+/// </summary>
+
+class CpuRenderer
+{
+public:
+	// instances has to be built over meshes, lights need their cdf, see UpdateLightCdf.
+	CpuRenderer(const std::vector<Planee>& planes, const std::vector<Sphere>& spheres, std::vector<Mesh> meshes,
+		const InstanceSet& instances, const std::vector<Light>& lights, uint32_t width, uint32_t height);
+
+	// Renders one frame & adds it to the previous ones, pixels receives the average as width * height tightly packed RGBA8 values.
+	void Render(ThreadPool& pool, uint8_t* pixels);
+	// Takes over the transforms & refitted hierarchy after instances moved, which restarts accumulation.
+	void UpdateInstances(const InstanceSet& instances);
+	// Starts over from the next frame, with adaptive sampling in every tile.
+	void ResetAccumulation();
+	// Samples per pixel each Render call adds & where they draw their dimensions from, restarts accumulation.
+	void SetSampler(SamplerType type, uint32_t samplesPerPixel);
+	// Bounces per path, brightness in shadow without a sampler, the distance closer hits are ignored below & the bounces before
+	// Russian roulette, like the MaxBounces, SHADOW, Epsilon & RouletteDepth constants of the shader. Restarts accumulation.
+	void SetShading(uint32_t maxBounces, float shadow, float epsilon, uint32_t rouletteDepth);
+	// A-trous iterations run over the accumulated image after every frame, like the denoise pass of the shader. 0 turns it off.
+	void SetDenoise(uint32_t iterations);
+	// Blend every frame into the reprojected history of the ones before, like the temporal pass of the shader.
+	void SetTemporal(bool enabled);
+	// Camera of the next Render call, the one before is where motion vectors point back to. Restarts accumulation if it moved.
+	void SetCamera(const CameraPose& pose);
+	// Stop sampling tiles once their relative error falls below threshold, like the converge pass of the shader. 0 turns it off.
+	// Tiles are TileSize pixels wide here, one workgroup on the GPU.
+	void SetAdaptive(float threshold);
+	// Trace 1 of every phases pixels per frame & reconstruct the others, like the reconstruct pass of the shader. 1 traces every
+	// pixel, packets then hold every 2nd pixel of a row. Restarts accumulation.
+	void SetInterleave(uint32_t phases);
+	// Trace the pixels at originX, originY of an imageWidth x imageHeight image the camera spans, i.e. one tile of a poster,
+	// like tileOrigin & imageSize in the shader. Restarts accumulation.
+	void SetView(uint32_t originX, uint32_t originY, uint32_t imageWidth, uint32_t imageHeight);
+	uint32_t GetSampleCount() const { return sampleCount; }
+	// Tiles the next Render call traces with adaptive sampling, & the samples all Render calls traced so far.
+	uint32_t GetActiveTiles() const;
+	uint64_t GetTracedSamples() const { return tracedSamples; }
+	// Paths of all Render calls so far.
+	const PathStats& GetPathStats() const { return pathStats; }
+
+	// Nodes of the sphere hierarchy followed by the ones of all meshes, laid out like the Bvh buffer of the shader.
+	const std::vector<BvhNode>& GetNodes() const { return nodes; }
+	uint32_t GetSphereBvhDepth() const { return sphereBvhDepth; }
+	// Spheres in the order of the hierarchy leaves, laid out like the Spheres, Planes & Materials buffers of the shader.
+	const PrimitiveBuffers& GetPrimitives() const { return primitives; }
+
+	static const uint32_t TileSize = 16;
+
+private:
+	// Mirrors Hit in the shader, per lane.
+	struct HitN
+	{
+		FloatN distance;
+		FloatN id;
+		FloatN kind;
+		FloatN instance;
+	};
+
+	// Mirrors GBufferTexel in the shader.
+	struct GBufferTexel
+	{
+		Vector3 normal;
+		float depth;
+		Vector3 albedo;
+		int32_t material;
+	};
+
+	// The G-buffer surface of each lane's path so far, see StoreGBuffer in the shader.
+	struct SurfaceN
+	{
+		Vector3N normal;
+		FloatN depth;
+		Vector3N albedo;
+		FloatN material;
+		// First hit of the camera ray & its instance (-1 for none), where motion vectors start, see StoreMotion in the shader.
+		Vector3N point;
+		FloatN instance;
+
+		void Store(MaskN lanes, const Vector3N& n, FloatN d, const Vector3N& a, FloatN m)
+		{
+			normal = Select(lanes, n, normal);
+			depth = Select(lanes, d, depth);
+			albedo = Select(lanes, a, albedo);
+			material = Select(lanes, m, material);
+		}
+	};
+
+	// Mirror the vec4s of the MotionVectors & TemporalHistory buffers in the shader.
+	struct MotionTexel
+	{
+		float x, y;
+		float depth;
+		float previousDepth;
+	};
+
+	struct HistoryTexel
+	{
+		Vector3 color;
+		float frames;
+	};
+
+	// Per lane permutation & shear of the watertight triangle test, see GetRayShear in the shader.
+	struct RayShearN;
+
+	PrimitiveBuffers primitives;
+	std::vector<BvhNode> nodes;
+	uint32_t sphereBvhDepth;
+
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshInfo> meshes;
+	std::vector<MeshInstance> instances;
+	// Object to world of the instances & how they moved with the last UpdateInstances, see InstanceSet::GetMotion.
+	std::vector<Matrix4> transforms;
+	std::vector<Matrix4> instanceMotion;
+	std::vector<BvhNode> instanceNodes;
+	std::vector<Light> lights;
+
+	uint32_t width, height;
+	// Where the traced pixels lie in the image the camera spans, see SetView.
+	uint32_t viewX = 0, viewY = 0;
+	uint32_t imageWidth, imageHeight;
+
+	// Sum of all samples since the last reset & their number as 4 floats per pixel, like the accumulation image of the shader.
+	std::vector<float> accumulation;
+	uint32_t sampleCount = 0;
+	uint64_t tracedSamples = 0;
+
+	Sampler sampler{ SamplerNone };
+	int maxBounces = 4;
+	float shadow = 0.35f;
+	float epsilon = 0.0001f;
+	int rouletteDepth = 3;
+	uint32_t samplesPerPixel = 1;
+
+	// Tiles count their paths on their own & add them up here once they're done.
+	PathStats pathStats;
+	std::mutex pathStatsMutex;
+
+	// Written by the sample traced last, plus the demodulated radiance of the iterations in between, two images to ping-pong.
+	uint32_t denoiseIterations = 0;
+	std::vector<GBufferTexel> gbuffer;
+	std::vector<Vector3> denoiseColors;
+
+	// Temporal reprojection keeps the G-buffer, motion vectors & history of the frame before in a second half.
+	bool temporal = false;
+	uint32_t frame = 0;
+	CameraPose camera;
+	CameraPose previousCamera;
+	std::vector<MotionTexel> motionVectors;
+	std::vector<HistoryTexel> history;
+
+	// Sum of the squared sample luminance per pixel & whether each tile is still above the threshold, see PixelMoments &
+	// AdaptiveTiles in the shader. Bytes rather than bools, tiles write theirs in parallel.
+	float adaptiveThreshold = 0.0f;
+	std::vector<float> moments;
+	std::vector<uint8_t> tileActive;
+
+	// Phases of interleaved rendering, see InterleavedPixel in the shader.
+	uint32_t interleave = 1;
+
+	bool GBufferOutput() const { return denoiseIterations > 0 || temporal; }
+	void AllocateFilterBuffers();
+	size_t FrameHalf(bool previous) const;
+
+	uint32_t TileCount() const;
+	void RenderTile(uint32_t tile, uint8_t* pixels);
+	// Relative error averaged over the pixels of a tile, see PixelError & Converge in the shader.
+	float TileError(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+	// Blends the samples of a tile into the reprojected history & writes its pixels.
+	void TemporalTile(uint32_t tile, uint8_t* pixels);
+	Vector3 TemporalCurrent(uint32_t x, uint32_t y) const;
+	bool TemporalMatch(size_t tapIndex, const GBufferTexel& surface, const MotionTexel& motion) const;
+	// Continuous pixel position of a point as seen by pose, see ProjectToPixel in the shader.
+	void ProjectToPixel(const Vector3& point, const CameraPose& pose, float& x, float& y) const;
+	// One a-trous iteration over a tile, the last one writes the pixels.
+	void DenoiseTile(uint32_t tile, uint32_t iteration, uint8_t* pixels);
+	Vector3 DenoiseInput(size_t index, uint32_t iteration) const;
+	// Pixels between the lanes of a packet.
+	uint32_t PixelStride() const { return interleave > 1 ? 2 : 1; }
+	// See InterleavePhase, TracedThisFrame & HasInterleavedHistory in the shader.
+	uint32_t InterleavePhase(uint32_t x, uint32_t y) const;
+	bool TracedThisFrame(int x, int y) const;
+	bool HasInterleavedHistory(uint32_t x, uint32_t y) const;
+	// Fills in the pixels of a tile the frame didn't trace.
+	void ReconstructTile(uint32_t tile, uint8_t* pixels);
+
+	Vector3N Camera(FloatN x, FloatN y) const;
+	void TryGetIntersection(const Vector3N& origin, const Vector3N& direction, MaskN active, HitN& hit, MaskN& found) const;
+	void IntersectBvh(const Vector3N& origin, const Vector3N& direction, MaskN active, int32_t root, int kind, int instance,
+		FloatN skip, HitN& hit) const;
+	void IntersectInstances(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN skipInstance, FloatN skip,
+		HitN& hit) const;
+	FloatN TriangleIntersection(const Vector3N& origin, const RayShearN& shear, int32_t triangle) const;
+	// Any hit counterparts of the traversals above for shadow rays, which return the lanes that hit something before maxDist.
+	MaskN OccludedBvh(const Vector3N& origin, const Vector3N& direction, MaskN active, int32_t root, int kind, FloatN skip,
+		FloatN maxDist) const;
+	MaskN OccludedInstances(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN skipInstance, FloatN skip,
+		FloatN maxDist) const;
+	MaskN Occluded(const Vector3N& origin, const Vector3N& direction, MaskN active, const HitN& surface, FloatN maxDist) const;
+	// Closest light in front of maxDist per lane & its radiance if the lane sees its emitting side.
+	void HitLights(const Vector3N& origin, const Vector3N& direction, MaskN active, FloatN maxDist, MaskN& hit, Vector3N& emission) const;
+	// One light picked by power & a point on it per lane, see SampleLights in the shader.
+	void SampleLights(const Vector3N& hitPoint, MaskN active, uint32_t x, uint32_t y, uint32_t index, int bounce,
+		MaskN& sampled, Vector3N& direction, FloatN& distance, Vector3N& radiance) const;
+	FloatN GetShadow(const Vector3N& origin, const Vector3N& direction, MaskN active, const HitN& surface, FloatN maxDist) const;
+	// Dimension pair of sample index for the pixels of a packet starting at (x, y), PixelStride apart. Drawn for their place
+	// in the image, see SetView.
+	void Sample2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension, FloatN& u, FloatN& v) const;
+	Vector3N Trace(Vector3N origin, Vector3N direction, MaskN active, uint32_t x, uint32_t y, uint32_t index, PathStats& stats,
+		SurfaceN* surface) const;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+/// <summary>
+/// A thin wrapper around SIMD float registers, used to trace ray packets on the CPU.
+/// Builds with AVX enabled get 8 lanes, any other x86-64 build gets 4 SSE lanes.
+/// Other architectures fall back to plain 4 element arrays.
+/// </summary>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define VKRT_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VKRT_SIMD_SSE
+#else
+#include <cmath>
+#define VKRT_SIMD_SCALAR
+#endif
+
+#include <cstdint>
+
+
+#if defined(VKRT_SIMD_AVX)
+
+struct FloatN
+{
+	static const int Width = 8;
+	__m256 v;
+
+	FloatN() {}
+	FloatN(__m256 v) : v(v) {}
+	FloatN(float f) : v(_mm256_set1_ps(f)) {}
+
+	static FloatN Load(const float* p) { return _mm256_loadu_ps(p); }
+	void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+struct MaskN
+{
+	__m256 v;
+
+	MaskN() {}
+	MaskN(__m256 v) : v(v) {}
+
+	// Bit i is set if lane i is set.
+	int Bits() const { return _mm256_movemask_ps(v); }
+};
+
+inline FloatN operator+(FloatN a, FloatN b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a, FloatN b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatN operator*(FloatN a, FloatN b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatN operator/(FloatN a, FloatN b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatN Sqrt(FloatN a) { return _mm256_sqrt_ps(a.v); }
+inline FloatN Min(FloatN a, FloatN b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatN Max(FloatN a, FloatN b) { return _mm256_max_ps(a.v, b.v); }
+inline FloatN Abs(FloatN a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+inline MaskN operator<(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline MaskN operator<=(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline MaskN operator>(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline MaskN operator>=(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline MaskN operator==(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline MaskN operator!=(FloatN a, FloatN b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+
+inline MaskN operator&(MaskN a, MaskN b) { return _mm256_and_ps(a.v, b.v); }
+inline MaskN operator|(MaskN a, MaskN b) { return _mm256_or_ps(a.v, b.v); }
+// a & ~b
+inline MaskN AndNot(MaskN a, MaskN b) { return _mm256_andnot_ps(b.v, a.v); }
+inline MaskN MaskNone() { return _mm256_setzero_ps(); }
+inline MaskN MaskAll() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+
+// Picks a where mask is set, b otherwise.
+inline FloatN Select(MaskN mask, FloatN a, FloatN b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+#elif defined(VKRT_SIMD_SSE)
+
+struct FloatN
+{
+	static const int Width = 4;
+	__m128 v;
+
+	FloatN() {}
+	FloatN(__m128 v) : v(v) {}
+	FloatN(float f) : v(_mm_set1_ps(f)) {}
+
+	static FloatN Load(const float* p) { return _mm_loadu_ps(p); }
+	void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+struct MaskN
+{
+	__m128 v;
+
+	MaskN() {}
+	MaskN(__m128 v) : v(v) {}
+
+	// Bit i is set if lane i is set.
+	int Bits() const { return _mm_movemask_ps(v); }
+};
+
+inline FloatN operator+(FloatN a, FloatN b) { return _mm_add_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a, FloatN b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatN operator*(FloatN a, FloatN b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatN operator/(FloatN a, FloatN b) { return _mm_div_ps(a.v, b.v); }
+inline FloatN Sqrt(FloatN a) { return _mm_sqrt_ps(a.v); }
+inline FloatN Min(FloatN a, FloatN b) { return _mm_min_ps(a.v, b.v); }
+inline FloatN Max(FloatN a, FloatN b) { return _mm_max_ps(a.v, b.v); }
+inline FloatN Abs(FloatN a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+inline MaskN operator<(FloatN a, FloatN b) { return _mm_cmplt_ps(a.v, b.v); }
+inline MaskN operator<=(FloatN a, FloatN b) { return _mm_cmple_ps(a.v, b.v); }
+inline MaskN operator>(FloatN a, FloatN b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline MaskN operator>=(FloatN a, FloatN b) { return _mm_cmpge_ps(a.v, b.v); }
+inline MaskN operator==(FloatN a, FloatN b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline MaskN operator!=(FloatN a, FloatN b) { return _mm_cmpneq_ps(a.v, b.v); }
+
+inline MaskN operator&(MaskN a, MaskN b) { return _mm_and_ps(a.v, b.v); }
+inline MaskN operator|(MaskN a, MaskN b) { return _mm_or_ps(a.v, b.v); }
+// a & ~b
+inline MaskN AndNot(MaskN a, MaskN b) { return _mm_andnot_ps(b.v, a.v); }
+inline MaskN MaskNone() { return _mm_setzero_ps(); }
+inline MaskN MaskAll() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+
+// Picks a where mask is set, b otherwise.
+inline FloatN Select(MaskN mask, FloatN a, FloatN b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+
+#else
+
+struct FloatN
+{
+	static const int Width = 4;
+	float v[Width];
+
+	FloatN() {}
+	FloatN(float f) { for (int i = 0; i < Width; i++) v[i] = f; }
+
+	static FloatN Load(const float* p) { FloatN r; for (int i = 0; i < Width; i++) r.v[i] = p[i]; return r; }
+	void Store(float* p) const { for (int i = 0; i < Width; i++) p[i] = v[i]; }
+};
+
+struct MaskN
+{
+	bool v[FloatN::Width];
+
+	// Bit i is set if lane i is set.
+	int Bits() const { int r = 0; for (int i = 0; i < FloatN::Width; i++) r |= v[i] ? (1 << i) : 0; return r; }
+};
+
+#define VKRT_SIMD_BINARY(name, T, expr) \
+	inline T name(FloatN a, FloatN b) { T r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = (expr); return r; }
+
+VKRT_SIMD_BINARY(operator+, FloatN, a.v[i] + b.v[i])
+VKRT_SIMD_BINARY(operator-, FloatN, a.v[i] - b.v[i])
+VKRT_SIMD_BINARY(operator*, FloatN, a.v[i] * b.v[i])
+VKRT_SIMD_BINARY(operator/, FloatN, a.v[i] / b.v[i])
+VKRT_SIMD_BINARY(Min, FloatN, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+VKRT_SIMD_BINARY(Max, FloatN, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+VKRT_SIMD_BINARY(operator<, MaskN, a.v[i] < b.v[i])
+VKRT_SIMD_BINARY(operator<=, MaskN, a.v[i] <= b.v[i])
+VKRT_SIMD_BINARY(operator>, MaskN, a.v[i] > b.v[i])
+VKRT_SIMD_BINARY(operator>=, MaskN, a.v[i] >= b.v[i])
+VKRT_SIMD_BINARY(operator==, MaskN, a.v[i] == b.v[i])
+VKRT_SIMD_BINARY(operator!=, MaskN, a.v[i] != b.v[i])
+#undef VKRT_SIMD_BINARY
+
+inline FloatN Sqrt(FloatN a) { FloatN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline FloatN Abs(FloatN a) { FloatN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+
+inline MaskN operator&(MaskN a, MaskN b) { MaskN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = a.v[i] && b.v[i]; return r; }
+inline MaskN operator|(MaskN a, MaskN b) { MaskN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = a.v[i] || b.v[i]; return r; }
+// a & ~b
+inline MaskN AndNot(MaskN a, MaskN b) { MaskN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = a.v[i] && !b.v[i]; return r; }
+inline MaskN MaskNone() { MaskN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = false; return r; }
+inline MaskN MaskAll() { MaskN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = true; return r; }
+
+// Picks a where mask is set, b otherwise.
+inline FloatN Select(MaskN mask, FloatN a, FloatN b) { FloatN r; for (int i = 0; i < FloatN::Width; i++) r.v[i] = mask.v[i] ? a.v[i] : b.v[i]; return r; }
+
+#endif
+
+
+inline bool Any(MaskN mask) { return mask.Bits() != 0; }
+inline bool None(MaskN mask) { return mask.Bits() == 0; }
+inline FloatN Clamp(FloatN a, FloatN lo, FloatN hi) { return Min(Max(a, lo), hi); }
+
+
+/// <summary>
+/// A packet of 3 component vectors in SoA layout.
+/// </summary>
+
+struct Vector3N
+{
+	FloatN x, y, z;
+
+	Vector3N() {}
+	Vector3N(FloatN x, FloatN y, FloatN z) : x(x), y(y), z(z) {}
+	Vector3N(float x, float y, float z) : x(x), y(y), z(z) {}
+};
+
+inline Vector3N operator+(const Vector3N& a, const Vector3N& b) { return Vector3N(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vector3N operator-(const Vector3N& a, const Vector3N& b) { return Vector3N(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vector3N operator*(const Vector3N& a, FloatN b) { return Vector3N(a.x * b, a.y * b, a.z * b); }
+inline Vector3N operator*(const Vector3N& a, const Vector3N& b) { return Vector3N(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline Vector3N operator/(const Vector3N& a, FloatN b) { return Vector3N(a.x / b, a.y / b, a.z / b); }
+inline FloatN Dot(const Vector3N& a, const Vector3N& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vector3N Normalize(const Vector3N& a) { return a / Sqrt(Dot(a, a)); }
+inline Vector3N Select(MaskN mask, const Vector3N& a, const Vector3N& b)
+{
+	return Vector3N(Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z));
+}
@@ -0,0 +1,124 @@
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	if (threadCount == 0)
+		threadCount = 1;
+
+	for (unsigned i = 0; i < threadCount; i++)
+		queues.emplace_back(new TaskQueue());
+
+	for (unsigned i = 0; i < threadCount; i++)
+		threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeWorkers.notify_all();
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void ThreadPool::Run(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+	if (taskCount == 0)
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Workers still leaving the previous job must not pick up tasks of this one.
+	jobFinished.wait(lock, [this] { return activeWorkers == 0; });
+
+	// Hand out contiguous ranges, so each worker starts with spatially coherent tiles.
+	auto workerCount = static_cast<uint32_t>(queues.size());
+	for (uint32_t w = 0; w < workerCount; w++)
+	{
+		uint32_t begin = uint64_t(taskCount) * w / workerCount;
+		uint32_t end = uint64_t(taskCount) * (w + 1) / workerCount;
+
+		std::lock_guard<std::mutex> queueLock(queues[w]->mutex);
+		for (uint32_t i = begin; i < end; i++)
+			queues[w]->tasks.push_back(i);
+	}
+
+	job = &task;
+	remaining = taskCount;
+	generation++;
+	wakeWorkers.notify_all();
+
+	jobFinished.wait(lock, [this] { return remaining == 0 && activeWorkers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::WorkerLoop(unsigned index)
+{
+	uint64_t seenGeneration = 0;
+
+	while (true)
+	{
+		const std::function<void(uint32_t)>* currentJob;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping)
+				return;
+
+			seenGeneration = generation;
+			currentJob = job;
+
+			// Woke up too late, the job is already finished.
+			if (currentJob == nullptr)
+				continue;
+
+			activeWorkers++;
+		}
+
+		uint32_t task;
+		while (TryPop(index, task))
+		{
+			(*currentJob)(task);
+			--remaining;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		jobFinished.notify_all();
+	}
+}
+
+bool ThreadPool::TryPop(unsigned index, uint32_t& task)
+{
+	{
+		auto& own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	// Steal from the back of the other workers' deques, the tiles they would process last.
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		auto& victim = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// A fixed size pool of worker threads with one task deque per worker.
+/// Each worker starts on a contiguous range of tasks (i.e. neighbouring tiles) & steals from
+/// the back of the other deques once its own deque runs dry, so uneven tiles don't leave cores idle.
+/// </summary>
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Calls task(i) for every i in [0, taskCount) on the workers & blocks until all calls returned.
+	void Run(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+	unsigned ThreadCount() const { return static_cast<unsigned>(threads.size()); }
+
+private:
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::deque<uint32_t> tasks;
+	};
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wakeWorkers;
+	std::condition_variable jobFinished;
+
+	const std::function<void(uint32_t)>* job = nullptr;
+	uint64_t generation = 0;
+	std::atomic<uint32_t> remaining{ 0 };
+	// Workers currently holding a pointer to job, guarded by mutex.
+	unsigned activeWorkers = 0;
+	bool stopping = false;
+
+	void WorkerLoop(unsigned index);
+	bool TryPop(unsigned index, uint32_t& task);
+};
@@ -0,0 +1,145 @@
+#include "GpuTimer.h"
+#include "VulkanInitializers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+
+GpuTimer::GpuTimer(const VKDeleter<VkDevice>& device) : device(device) {}
+
+void GpuTimer::Create(VkPhysicalDevice physicalDevice, uint32_t queueFamily, const std::vector<std::string>& names)
+{
+	stageNames = names;
+	samples.assign(names.size(), {});
+	nextSample.assign(names.size(), 0);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	uint32_t validBits = families[queueFamily].timestampValidBits;
+	if (validBits == 0)
+		return;
+	validBitsMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	nanosecondsPerTick = properties.limits.timestampPeriod;
+
+	auto info = Initializers::QueryPoolCreateInfo(VK_QUERY_TYPE_TIMESTAMP, uint32_t(names.size()) + 1);
+
+	auto result = vkCreateQueryPool(device, &info, nullptr, queryPool.Replace());
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timestamp Query Pool !");
+}
+
+void GpuTimer::Reset(VkCommandBuffer buffer)
+{
+	if (!Enabled())
+		return;
+
+	timestampCount = 0;
+	vkCmdResetQueryPool(buffer, queryPool, 0, uint32_t(stageNames.size()) + 1);
+}
+
+void GpuTimer::WriteTimestamp(VkCommandBuffer buffer, uint32_t index, VkPipelineStageFlags stage)
+{
+	if (!Enabled())
+		return;
+
+	vkCmdWriteTimestamp(buffer, VkPipelineStageFlagBits(stage), queryPool, index);
+	timestampCount = std::max(timestampCount, index + 1);
+}
+
+void GpuTimer::Collect()
+{
+	lastMs = 0.0;
+	if (!Enabled() || timestampCount < 2)
+		return;
+
+	std::vector<uint64_t> timestamps(timestampCount);
+	auto result = vkGetQueryPoolResults(device, queryPool, 0, timestampCount, timestamps.size() * sizeof(uint64_t),
+		timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	if (result != VK_SUCCESS)
+		return;
+
+	for (uint32_t i = 0; i + 1 < timestampCount; i++)
+	{
+		uint64_t ticks = ((timestamps[i + 1] & validBitsMask) - (timestamps[i] & validBitsMask)) & validBitsMask;
+		AddSample(i, ticks * nanosecondsPerTick * 1e-6);
+		lastMs += ticks * nanosecondsPerTick * 1e-6;
+	}
+}
+
+void GpuTimer::AddSample(uint32_t stage, double ms)
+{
+	auto& stageSamples = samples[stage];
+	if (stageSamples.size() < MaxSamples)
+		stageSamples.push_back(ms);
+	else
+		stageSamples[nextSample[stage]] = ms;
+
+	nextSample[stage] = (nextSample[stage] + 1) % MaxSamples;
+}
+
+void GpuTimer::ClearSamples()
+{
+	for (auto& stageSamples : samples)
+		stageSamples.clear();
+	nextSample.assign(nextSample.size(), 0);
+}
+
+std::vector<StageTiming> GpuTimer::GetStageTimings() const
+{
+	std::vector<StageTiming> timings;
+
+	for (size_t i = 0; i < stageNames.size(); i++)
+	{
+		StageTiming timing;
+		timing.name = stageNames[i];
+		timing.samples = samples[i].size();
+
+		if (!samples[i].empty())
+		{
+			auto sorted = samples[i];
+			std::sort(sorted.begin(), sorted.end());
+
+			double sum = 0.0;
+			for (double sample : sorted)
+				sum += sample;
+
+			size_t p99Index = size_t(std::ceil(0.99 * sorted.size())) - 1;
+
+			timing.minMs = sorted.front();
+			timing.avgMs = sum / sorted.size();
+			timing.p99Ms = sorted[p99Index];
+		}
+
+		timings.push_back(timing);
+	}
+
+	return timings;
+}
+
+void GpuTimer::WriteJson(const std::string& path, const std::string& deviceName) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open timings file " + path + " !");
+
+	file << "{\n\t\"device\": \"" << deviceName << "\",\n\t\"stages\": [\n";
+
+	auto timings = GetStageTimings();
+	for (size_t i = 0; i < timings.size(); i++)
+	{
+		const auto& t = timings[i];
+		file << "\t\t{ \"name\": \"" << t.name << "\", \"samples\": " << t.samples
+			<< ", \"min_ms\": " << t.minMs << ", \"avg_ms\": " << t.avgMs << ", \"p99_ms\": " << t.p99Ms << " }"
+			<< (i + 1 < timings.size() ? ",\n" : "\n");
+	}
+
+	file << "\t]\n}\n";
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "VulkanPlatform.h"
+#include "VkDeleter.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Measures the GPU time of consecutive stages of a command buffer with a timestamp query pool.
+/// Timestamp i marks the end of stage i - 1 & the beginning of stage i.
+/// Stages that can't be timed on the GPU (i.e. presentation) may be fed with CPU measured samples instead.
+/// </summary>
+
+struct StageTiming
+{
+	std::string name;
+	uint64_t samples = 0;
+	double minMs = 0.0;
+	double avgMs = 0.0;
+	double p99Ms = 0.0;
+};
+
+class GpuTimer
+{
+public:
+	explicit GpuTimer(const VKDeleter<VkDevice>& device);
+
+	// Creates the query pool for stageNames.size() + 1 timestamps. Timing is disabled if the queue family can't write timestamps.
+	void Create(VkPhysicalDevice physicalDevice, uint32_t queueFamily, const std::vector<std::string>& stageNames);
+	bool Enabled() const { return queryPool != VK_NULL_HANDLE; }
+
+	// Records the reset of all queries, has to precede the first timestamp of a command buffer.
+	void Reset(VkCommandBuffer buffer);
+	void WriteTimestamp(VkCommandBuffer buffer, uint32_t index, VkPipelineStageFlags stage);
+
+	// Reads back the timestamps of the last submission, only call this once its fence has been signaled.
+	void Collect();
+	// Time from the first to the last timestamp of the last collected submission, 0 if none could be read.
+	double GetLastMs() const { return lastMs; }
+	void AddSample(uint32_t stage, double ms);
+	// Forgets all samples, i.e. between two runs that are reported separately.
+	void ClearSamples();
+
+	std::vector<StageTiming> GetStageTimings() const;
+	void WriteJson(const std::string& path, const std::string& deviceName) const;
+
+	// Only the latest samples per stage are kept, so long interactive sessions don't grow without bound.
+	static const size_t MaxSamples = 8192;
+
+private:
+	const VKDeleter<VkDevice>& device;
+	VKDeleter<VkQueryPool> queryPool{ device, vkDestroyQueryPool };
+
+	std::vector<std::string> stageNames;
+	std::vector<std::vector<double>> samples;
+	std::vector<size_t> nextSample;
+
+	// Number of timestamps written by the last recorded command buffer.
+	uint32_t timestampCount = 0;
+	double nanosecondsPerTick = 1.0;
+	uint64_t validBitsMask = ~0ULL;
+	double lastMs = 0.0;
+};
@@ -0,0 +1,88 @@
+#include "ImageWriter.h"
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+
+void WritePPM(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels, bool swapRedBlue)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open output image " + path + " !");
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	// Convert one scanline at a time, so we never need a second copy of the whole image.
+	std::vector<uint8_t> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* src = pixels + size_t(y) * width * 4;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = src[x * 4 + (swapRedBlue ? 2 : 0)];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + (swapRedBlue ? 0 : 2)];
+		}
+
+		file.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+
+	if (!file.good())
+		throw std::runtime_error("Failed to write output image " + path + " !");
+}
+
+
+static std::vector<uint8_t> ReadPPM(const std::string& path, uint32_t& width, uint32_t& height)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open image " + path + " !");
+
+	std::string magic;
+	uint32_t maxValue;
+	file >> magic >> width >> height >> maxValue;
+	if (magic != "P6" || maxValue != 255)
+		throw std::runtime_error(path + " is no 8 bit binary PPM !");
+
+	// Exactly one whitespace separates the header from the pixel data.
+	file.get();
+
+	std::vector<uint8_t> pixels(size_t(width) * height * 3);
+	file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+	if (!file.good())
+		throw std::runtime_error("Failed to read image " + path + " !");
+
+	return pixels;
+}
+
+ImageDifference ComparePPM(const std::string& path, const std::string& referencePath)
+{
+	uint32_t width, height, refWidth, refHeight;
+	auto pixels = ReadPPM(path, width, height);
+	auto reference = ReadPPM(referencePath, refWidth, refHeight);
+	if (width != refWidth || height != refHeight)
+		throw std::runtime_error("Can't compare " + path + " against " + referencePath + ", the image sizes differ !");
+
+	ImageDifference result;
+	result.pixelCount = uint64_t(width) * height;
+
+	uint64_t sum = 0;
+	for (size_t i = 0; i < pixels.size(); i += 3)
+	{
+		uint32_t pixelMax = 0;
+		for (size_t c = 0; c < 3; c++)
+		{
+			uint32_t diff = std::abs(int(pixels[i + c]) - int(reference[i + c]));
+			pixelMax = diff > pixelMax ? diff : pixelMax;
+			sum += diff;
+		}
+
+		if (pixelMax > 0)
+			result.differingPixels++;
+		result.maxDifference = pixelMax > result.maxDifference ? pixelMax : result.maxDifference;
+	}
+
+	result.meanDifference = double(sum) / double(pixels.size());
+	return result;
+}
\ No newline at end of file
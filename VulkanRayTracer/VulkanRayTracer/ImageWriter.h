@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// Writes rendered images to disk & compares them against reference images.
+/// </summary>
+
+// Writes a tightly packed 8 bit RGBA (or BGRA, if swapRedBlue is set) image as binary PPM. Alpha is dropped.
+void WritePPM(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels, bool swapRedBlue);
+
+
+struct ImageDifference
+{
+	uint64_t pixelCount = 0;
+	uint64_t differingPixels = 0;
+	// Per channel, in 8 bit steps.
+	uint32_t maxDifference = 0;
+	double meanDifference = 0.0;
+};
+
+// Compares two binary PPM images of the same size.
+ImageDifference ComparePPM(const std::string& path, const std::string& referencePath);
\ No newline at end of file
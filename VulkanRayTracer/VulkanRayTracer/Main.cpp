@@ -1,16 +1,26 @@
 #include <iostream>
+#include <cstring>
 #include "Application.h"
 
 /// <summary>
 /// Runs & exits the application.
 /// </summary>
 
-int main()
+int main(int argc, char* argv[])
 {
-	Application app;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
+		{
+			PrintUsage(argv[0]);
+			return EXIT_SUCCESS;
+		}
+	}
 
 	try
 	{
+		Application app(ParseRenderSettings(argc, argv));
+
 		app.Run();
 	}
 	catch (const std::runtime_error& e)
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+/// <summary>
+/// How long paths got & why they ended, to see what Russian roulette saves on a scene.
+/// The shader counts finished paths in the PathStatistics buffer with --path-stats, the CPU renderer always counts them.
+/// Segments are the closest hit rays of a path, the camera ray included, shadow rays aren't counted.
+/// </summary>
+
+// Layout of the PathStatistics buffer, cleared after every frame so 32 bits don't overflow.
+struct PathCounters
+{
+	uint32_t paths;
+	uint32_t segments;
+	uint32_t roulette;
+	uint32_t maxDepth;
+};
+
+struct PathStats
+{
+	uint64_t paths = 0;
+	uint64_t segments = 0;
+	// Paths Russian roulette ended & ones that ran out of bounces.
+	uint64_t roulette = 0;
+	uint64_t maxDepth = 0;
+
+	void Add(const PathCounters& counters)
+	{
+		paths += counters.paths;
+		segments += counters.segments;
+		roulette += counters.roulette;
+		maxDepth += counters.maxDepth;
+	}
+
+	void Add(const PathStats& other)
+	{
+		paths += other.paths;
+		segments += other.segments;
+		roulette += other.roulette;
+		maxDepth += other.maxDepth;
+	}
+
+	double AverageLength() const { return paths ? double(segments) / double(paths) : 0.0; }
+
+	void Print(uint32_t maxBounces) const
+	{
+		double share = paths ? 100.0 / double(paths) : 0.0;
+		fprintf(stdout, "Paths: %llu traced, %.3f segments on average (at most %u), %.1f%% ended by roulette, %.1f%% out of bounces\n",
+			(unsigned long long)paths, AverageLength(), maxBounces, roulette * share, maxDepth * share);
+	}
+};
@@ -0,0 +1,145 @@
+#include "PipelineCacheFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+
+static const char Magic[8] = { 'V', 'K', 'R', 'T', 'P', 'C', '0', '1' };
+
+PipelineCacheFile::PipelineCacheFile(const std::string& path, const VkPhysicalDeviceProperties& properties) : path(path)
+{
+	memset(&expected, 0, sizeof(expected));
+	memcpy(expected.magic, Magic, sizeof(Magic));
+	expected.vendorID = properties.vendorID;
+	expected.deviceID = properties.deviceID;
+	expected.driverVersion = properties.driverVersion;
+	memcpy(expected.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+std::vector<char> PipelineCacheFile::Load(std::string& reason) const
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		reason = "no cache file";
+		return {};
+	}
+
+	FileHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+	{
+		reason = "not a pipeline cache file";
+		return {};
+	}
+
+	if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+		memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		reason = "written for another device";
+		return {};
+	}
+
+	if (header.driverVersion != expected.driverVersion)
+	{
+		reason = "written by another driver version";
+		return {};
+	}
+
+	// A truncated file would otherwise allocate whatever its header claims.
+	auto dataStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	if (file.tellg() - dataStart != std::streamoff(header.dataSize))
+	{
+		reason = "damaged";
+		return {};
+	}
+	file.seekg(dataStart);
+
+	std::vector<char> data(header.dataSize);
+	if (!file.read(data.data(), data.size()) || Checksum(data) != header.checksum)
+	{
+		reason = "damaged";
+		return {};
+	}
+
+	if (!HasValidCacheHeader(data))
+	{
+		reason = "cache header doesn't match the device";
+		return {};
+	}
+
+	return data;
+}
+
+bool PipelineCacheFile::Store(const std::vector<char>& data) const
+{
+	FileHeader header = expected;
+	header.dataSize = uint32_t(data.size());
+	header.checksum = Checksum(data);
+
+	// Unique per process, several renderers may share one cache file.
+	std::random_device random;
+	std::string temporaryPath = path + "." + std::to_string(random()) + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		file.flush();
+		if (!file.good())
+		{
+			file.close();
+			remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	// rename replaces the old file atomically on POSIX systems.
+	bool renamed = rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed)
+		remove(temporaryPath.c_str());
+
+	return renamed;
+}
+
+// 64 bit FNV-1a, enough to catch truncated or partly overwritten files.
+uint64_t PipelineCacheFile::Checksum(const std::vector<char>& data)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : data)
+	{
+		hash ^= uint8_t(c);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// The header every VkPipelineCache starts with, see VK_PIPELINE_CACHE_HEADER_VERSION_ONE.
+bool PipelineCacheFile::HasValidCacheHeader(const std::vector<char>& data) const
+{
+	const size_t HeaderSize = 16 + VK_UUID_SIZE;
+	if (data.size() < HeaderSize)
+		return false;
+
+	uint32_t fields[4];
+	memcpy(fields, data.data(), sizeof(fields));
+
+	return fields[0] >= HeaderSize && fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		fields[2] == expected.vendorID && fields[3] == expected.deviceID &&
+		memcmp(data.data() + 16, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "VulkanPlatform.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Keeps the data of a VkPipelineCache on disk between runs, so a restart doesn't compile the shader again.
+/// The file starts with the vendor, device, driver version & pipeline cache UUID it was written for plus a checksum of the data.
+/// Data of another device or driver, a damaged file or a cache header the driver wouldn't accept is dropped, the run then starts cold.
+/// </summary>
+
+class PipelineCacheFile
+{
+public:
+	PipelineCacheFile(const std::string& path, const VkPhysicalDeviceProperties& properties);
+
+	// The cache data for this device & driver, empty if there is none. reason tells why a file was rejected.
+	std::vector<char> Load(std::string& reason) const;
+	// Writes a temporary file next to the cache & renames it over the old one, so readers never see half a cache.
+	bool Store(const std::vector<char>& data) const;
+
+private:
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint32_t dataSize;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t checksum;
+	};
+
+	std::string path;
+	FileHeader expected;
+
+	static uint64_t Checksum(const std::vector<char>& data);
+	bool HasValidCacheHeader(const std::vector<char>& data) const;
+};
@@ -0,0 +1,96 @@
+#include "Poster.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace
+{
+	// Share of the budget a dispatch is planned for, tiles differ in cost.
+	const double BudgetHeadroom = 0.8;
+}
+
+
+PosterWriter::PosterWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight)
+	: path(path), file(path, std::ios::binary), width(width), height(height), tileWidth(tileWidth), tileHeight(tileHeight),
+	band(size_t(width) * std::min(tileHeight, height) * 3)
+{
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open output image " + path + " !");
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+}
+
+uint32_t PosterWriter::GetTileCount() const
+{
+	return ((width + tileWidth - 1) / tileWidth) * ((height + tileHeight - 1) / tileHeight);
+}
+
+PosterTile PosterWriter::GetTile(uint32_t index) const
+{
+	uint32_t tilesX = (width + tileWidth - 1) / tileWidth;
+	uint32_t x = (index % tilesX) * tileWidth;
+	uint32_t y = (index / tilesX) * tileHeight;
+	return { x, y, std::min(tileWidth, width - x), std::min(tileHeight, height - y) };
+}
+
+void PosterWriter::AddTile(const uint8_t* pixels, uint32_t rowPitch, bool swapRedBlue)
+{
+	if (nextTile >= GetTileCount())
+		throw std::runtime_error("All tiles of " + path + " were written already !");
+
+	PosterTile tile = GetTile(nextTile++);
+	for (uint32_t y = 0; y < tile.height; y++)
+	{
+		const uint8_t* src = pixels + size_t(y) * rowPitch * 4;
+		uint8_t* dst = band.data() + (size_t(y) * width + tile.x) * 3;
+		for (uint32_t x = 0; x < tile.width; x++)
+		{
+			dst[x * 3 + 0] = src[x * 4 + (swapRedBlue ? 2 : 0)];
+			dst[x * 3 + 1] = src[x * 4 + 1];
+			dst[x * 3 + 2] = src[x * 4 + (swapRedBlue ? 0 : 2)];
+		}
+	}
+
+	// The last tile of its row completes the band.
+	if (tile.x + tile.width < width)
+		return;
+
+	file.write(reinterpret_cast<const char*>(band.data()), std::streamsize(size_t(width) * tile.height * 3));
+	if (!file.good())
+		throw std::runtime_error("Failed to write output image " + path + " !");
+}
+
+void PosterWriter::Finish()
+{
+	if (nextTile != GetTileCount())
+		throw std::runtime_error("Output image " + path + " is missing tiles !");
+
+	file.close();
+	if (file.fail())
+		throw std::runtime_error("Failed to write output image " + path + " !");
+}
+
+
+DispatchBudget::DispatchBudget(double budgetMs, uint32_t maxSamples) : budgetMs(budgetMs), maxSamples(maxSamples),
+	samples(budgetMs > 0.0 ? 1 : maxSamples) {}
+
+uint32_t DispatchBudget::Next(uint32_t remaining) const
+{
+	return std::min(samples, remaining);
+}
+
+void DispatchBudget::Update(uint32_t dispatched, double ms)
+{
+	longestMs = std::max(longestMs, ms);
+	if (budgetMs <= 0.0 || dispatched == 0 || ms <= 0.0)
+		return;
+
+	if (dispatched == 1 && ms > budgetMs)
+		overBudget = true;
+
+	// At most twice as many samples as planned before, the time per sample only holds roughly for the next tiles. The last
+	// dispatch of a tile may have taken fewer.
+	double fitting = std::floor(BudgetHeadroom * budgetMs * dispatched / ms);
+	samples = uint32_t(std::min(std::max(fitting, 1.0), double(std::min(2 * samples, maxSamples))));
+}
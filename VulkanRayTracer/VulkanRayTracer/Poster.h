@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Offline rendering of images larger than the compute image, i.e. prints past maxImageDimension2D & device memory. The image
+/// is traced tile by tile, PosterWriter collects finished tiles & streams them to disk in scanline order, DispatchBudget
+/// splits the samples of a tile over dispatches short enough for the driver watchdog.
+/// </summary>
+
+// Pixels of the poster one tile covers.
+struct PosterTile
+{
+	uint32_t x, y;
+	uint32_t width, height;
+};
+
+
+class PosterWriter
+{
+public:
+	// Opens path & writes the header of a width x height binary PPM. Tiles are tileWidth x tileHeight, the ones along the
+	// right & bottom edge smaller.
+	PosterWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight);
+
+	uint32_t GetTileCount() const;
+	// Tiles go row by row, left to right, which is the order AddTile takes them in.
+	PosterTile GetTile(uint32_t index) const;
+	// Takes the pixels of the next tile as 8 bit RGBA (or BGRA, if swapRedBlue is set) rows of rowPitch pixels. Once the last
+	// tile of a row of tiles is in, their band of scanlines is appended to the file, so only one band is ever held.
+	void AddTile(const uint8_t* pixels, uint32_t rowPitch, bool swapRedBlue);
+	// Throws unless every tile was added & written.
+	void Finish();
+
+	size_t GetBandBytes() const { return band.size(); }
+
+private:
+	std::string path;
+	std::ofstream file;
+	uint32_t width, height;
+	uint32_t tileWidth, tileHeight;
+	uint32_t nextTile = 0;
+	// RGB scanlines of the current row of tiles, as they go to the file.
+	std::vector<uint8_t> band;
+};
+
+
+class DispatchBudget
+{
+public:
+	// Dispatches of at most maxSamples samples per pixel. A budget of 0 always takes maxSamples, otherwise the first dispatch
+	// takes 1 sample & later ones as many as the time per sample measured so far fits into budgetMs.
+	DispatchBudget(double budgetMs, uint32_t maxSamples);
+
+	// Samples per pixel of the next dispatch, at most the remaining ones of the tile.
+	uint32_t Next(uint32_t remaining) const;
+	// Feeds the time a dispatch of dispatched samples took.
+	void Update(uint32_t dispatched, double ms);
+
+	// Whether a dispatch of a single sample already took longer than the budget, only smaller tiles help then.
+	bool OverBudget() const { return overBudget; }
+	double GetLongestMs() const { return longestMs; }
+
+private:
+	double budgetMs;
+	uint32_t maxSamples;
+	uint32_t samples;
+	bool overBudget = false;
+	double longestMs = 0.0;
+};
@@ -5,12 +5,13 @@
 
 bool QueueFamilyIndices::IsComplete()
 {
-	return presentFamily >= 0 && computeFamily >= 0;
+	return (presentFamily >= 0 || !requiresPresent) && computeFamily >= 0;
 }
 
 QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface)
 {
 	QueueFamilyIndices indices;
+	indices.requiresPresent = surface != VK_NULL_HANDLE;
 
 	uint32_t queueFamilyCount = 0;
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
@@ -30,11 +31,14 @@ QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surfa
 		if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
 			indices.computeFamily = i;
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (indices.requiresPresent)
+		{
+			VkBool32 presentSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-		if (presentSupport)
-			indices.presentFamily = i;
+			if (presentSupport)
+				indices.presentFamily = i;
+		}
 
 		if (indices.IsComplete())
 			break;
@@ -1,6 +1,5 @@
 #pragma once
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
+#include "VulkanPlatform.h"
 
 /// <summary>
 /// This structure finds & holds the required queue families.
@@ -16,7 +15,11 @@ struct QueueFamilyIndices
 	int presentFamily = -1;
 	int computeFamily = -1;
 
+	// Headless rendering has no surface to present to, so no present family is needed.
+	bool requiresPresent = true;
+
 	bool IsComplete();
 };
 
+// Pass VK_NULL_HANDLE as surface to only look for a compute family.
 QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "RenderScale.h"
+#include <algorithm>
+#include <cmath>
+#include "ShaderConstants.h"
+
+
+namespace
+{
+	const float ScaleStep = 0.05f;
+	// Weight of the latest frame in the smoothed time, single slow frames (i.e. shader reloads) don't drop the scale.
+	const double Smoothing = 0.2;
+
+	struct Texel
+	{
+		float rgb[3];
+
+		float Luminance() const { return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2]; }
+	};
+
+	Texel Tap(const uint8_t* source, uint32_t width, uint32_t height, int x, int y)
+	{
+		x = std::min(std::max(x, 0), int(width) - 1);
+		y = std::min(std::max(y, 0), int(height) - 1);
+
+		const uint8_t* pixel = source + (size_t(y) * width + x) * 4;
+		return { { pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f } };
+	}
+}
+
+
+uint32_t ScaledSize(uint32_t size, float scale)
+{
+	return std::max(1u, std::min(size, uint32_t(std::lround(size * scale))));
+}
+
+void UpscaleImage(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* pixels, uint32_t width, uint32_t height,
+	UpscaleFilter filter)
+{
+	float scaleX = float(sourceWidth) / float(width);
+	float scaleY = float(sourceHeight) / float(height);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			// Pixel centers of both images line up, the nearest source taps are at the floor of the position & one past it.
+			float positionX = (x + 0.5f) * scaleX - 0.5f;
+			float positionY = (y + 0.5f) * scaleY - 0.5f;
+			int cornerX = int(std::floor(positionX));
+			int cornerY = int(std::floor(positionY));
+			float fractionX = positionX - cornerX;
+			float fractionY = positionY - cornerY;
+
+			Texel bilinear = {};
+			for (int i = 0; i < 4; i++)
+			{
+				Texel tap = Tap(source, sourceWidth, sourceHeight, cornerX + i % 2, cornerY + i / 2);
+				float weight = ((i % 2 == 1) ? fractionX : 1.0f - fractionX) * ((i / 2 == 1) ? fractionY : 1.0f - fractionY);
+				for (int c = 0; c < 3; c++)
+					bilinear.rgb[c] += tap.rgb[c] * weight;
+			}
+
+			Texel color = bilinear;
+			if (filter == UpscaleEdge)
+			{
+				float sum[3] = {};
+				float weightSum = 0.0f;
+				for (int j = -1; j <= 2; j++)
+				{
+					for (int i = -1; i <= 2; i++)
+					{
+						Texel tap = Tap(source, sourceWidth, sourceHeight, cornerX + i, cornerY + j);
+						float distanceX = i - fractionX;
+						float distanceY = j - fractionY;
+						float difference = tap.Luminance() - bilinear.Luminance();
+						float weight = std::exp(-(distanceX * distanceX + distanceY * distanceY) / (2.0f * UpscaleSpatialSigma * UpscaleSpatialSigma)
+							- difference * difference / (2.0f * UpscaleRangeSigma * UpscaleRangeSigma));
+
+						for (int c = 0; c < 3; c++)
+							sum[c] += tap.rgb[c] * weight;
+						weightSum += weight;
+					}
+				}
+
+				// The nearest taps always have a weight.
+				for (int c = 0; c < 3; c++)
+					color.rgb[c] = sum[c] / weightSum;
+			}
+
+			uint8_t* pixel = pixels + (size_t(y) * width + x) * 4;
+			for (int c = 0; c < 3; c++)
+				pixel[c] = uint8_t(std::min(std::max(color.rgb[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+			pixel[3] = 255;
+		}
+	}
+}
+
+
+RenderScaleGovernor::RenderScaleGovernor(float targetMs, float minScale, float scale) : targetMs(targetMs), minScale(minScale), scale(scale) {}
+
+bool RenderScaleGovernor::Update(double frameMs)
+{
+	if (frameMs <= 0.0)
+		return false;
+
+	frames++;
+	averageMs = (frames == 1) ? frameMs : averageMs + Smoothing * (frameMs - averageMs);
+	if (frames < SettleFrames)
+		return false;
+
+	// Frame time goes with the pixels traced, so with the square of the scale.
+	float ideal = scale * float(std::sqrt(targetMs / averageMs));
+	ideal = std::min(std::max(ideal, minScale), 1.0f);
+	if (std::abs(ideal - scale) < ScaleStep)
+		return false;
+
+	scale = std::min(std::max(std::round(ideal / ScaleStep) * ScaleStep, minScale), 1.0f);
+	frames = 0;
+	changes++;
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+/// <summary>
+/// Dynamic resolution: frames are traced at a fraction of the output size & stretched over it by the upscale pass of
+/// shaders/raytracing.comp. RenderScaleGovernor picks that fraction from the GPU time of the frames before, UpscaleImage
+/// is the CPU counterpart of the upscale pass.
+/// </summary>
+
+// Smallest scale --render-scale & RenderScaleGovernor go down to.
+const float MinRenderScale = 0.25f;
+
+// Keep in sync with the Upscale* #defines of the shader.
+enum UpscaleFilter : int32_t
+{
+	UpscaleBilinear,
+	// Bilateral over 4x4 samples: taps far from the bilinear estimate count less, so noise is smoothed but edges aren't.
+	UpscaleEdge
+};
+
+// Pixels traced per row & column at scale, at least one of each.
+uint32_t ScaledSize(uint32_t size, float scale);
+
+// Stretches sourceWidth x sourceHeight tightly packed RGBA8 pixels over width x height ones, like the upscale pass.
+void UpscaleImage(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* pixels, uint32_t width, uint32_t height,
+	UpscaleFilter filter);
+
+
+class RenderScaleGovernor
+{
+public:
+	// Scales go from minScale up to 1 (the output size) in steps of 0.05.
+	RenderScaleGovernor(float targetMs, float minScale, float scale);
+
+	// Feeds the time of the frame traced at the current scale, returns whether the scale changed. Every change restarts the
+	// accumulation, so the scale only moves once the smoothed time left the target by more than a step.
+	bool Update(double frameMs);
+
+	float GetScale() const { return scale; }
+	double GetAverageMs() const { return averageMs; }
+	uint32_t GetChanges() const { return changes; }
+
+	// Frames measured at a new scale before it may change again.
+	static const uint32_t SettleFrames = 4;
+
+private:
+	float targetMs;
+	float minScale;
+	float scale;
+	double averageMs = 0.0;
+	uint32_t frames = 0;
+	uint32_t changes = 0;
+};
@@ -0,0 +1,307 @@
+#include "RenderSettings.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+
+static uint32_t ParseUInt(const std::string& option, const char* value)
+{
+	try
+	{
+		auto result = std::stoul(value);
+		if (result == 0)
+			throw std::invalid_argument(value);
+
+		return static_cast<uint32_t>(result);
+	}
+	catch (const std::logic_error&)
+	{
+		throw std::runtime_error("Option " + option + " expects a positive integer, got '" + value + "' !");
+	}
+}
+
+static float ParseFloat(const std::string& option, const char* value)
+{
+	try
+	{
+		size_t length = 0;
+		float result = std::stof(value, &length);
+		if (value[length] != '\0')
+			throw std::invalid_argument(value);
+
+		return result;
+	}
+	catch (const std::logic_error&)
+	{
+		throw std::runtime_error("Option " + option + " expects a number, got '" + value + "' !");
+	}
+}
+
+RenderSettings ParseRenderSettings(int argc, char* argv[])
+{
+	RenderSettings settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		// Fetches the value of options like "--frames 16".
+		auto NextValue = [&]() -> const char*
+		{
+			if (i + 1 >= argc)
+				throw std::runtime_error("Option " + arg + " expects a value !");
+			return argv[++i];
+		};
+
+		if (arg == "--headless")
+			settings.headless = true;
+		else if (arg == "--frames")
+			settings.frames = ParseUInt(arg, NextValue());
+		else if (arg == "--output" || arg == "-o")
+			settings.outputPath = NextValue();
+		else if (arg == "--cpu")
+			settings.cpu = true;
+		else if (arg == "--threads")
+			settings.threads = ParseUInt(arg, NextValue());
+		else if (arg == "--cpu-scaling")
+			settings.cpu = settings.cpuScaling = true;
+		else if (arg == "--mesh")
+			settings.meshPaths.push_back(NextValue());
+		else if (arg == "--instances")
+			settings.meshInstances = ParseUInt(arg, NextValue());
+		else if (arg == "--animate")
+			settings.animate = true;
+		else if (arg == "--orbit")
+			settings.orbit = true;
+		else if (arg == "--spheres")
+			settings.extraSpheres = ParseUInt(arg, NextValue());
+		else if (arg == "--lights")
+			settings.extraLights = ParseUInt(arg, NextValue());
+		else if (arg == "--bvh-scaling")
+			settings.cpu = settings.bvhScaling = true;
+		else if (arg == "--compare")
+			settings.comparePath = NextValue();
+		else if (arg == "--compare-tolerance")
+			settings.compareTolerance = ParseFloat(arg, NextValue());
+		else if (arg == "--timings")
+			settings.timingsPath = NextValue();
+		else if (arg == "--workgroup")
+		{
+			// i.e. "--workgroup 8x8"
+			std::string value = NextValue();
+			auto separator = value.find('x');
+			if (separator == std::string::npos)
+				throw std::runtime_error("Option " + arg + " expects <x>x<y>, got '" + value + "' !");
+
+			settings.workgroupX = ParseUInt(arg, value.substr(0, separator).c_str());
+			settings.workgroupY = ParseUInt(arg, value.substr(separator + 1).c_str());
+		}
+		else if (arg == "--sampler")
+		{
+			std::string value = NextValue();
+			if (value == "none")
+				settings.sampler = SamplerNone;
+			else if (value == "random")
+				settings.sampler = SamplerRandom;
+			else if (value == "sobol")
+				settings.sampler = SamplerSobol;
+			else if (value == "bluenoise")
+				settings.sampler = SamplerBlueNoise;
+			else
+				throw std::runtime_error("Option " + arg + " expects none, random, sobol or bluenoise, got '" + value + "' !");
+		}
+		else if (arg == "--spp")
+			settings.samplesPerPixel = ParseUInt(arg, NextValue());
+		else if (arg == "--wavefront")
+			settings.wavefront = true;
+		else if (arg == "--sort-rays")
+			settings.sortRays = true;
+		else if (arg == "--sort-compare")
+			settings.sortRays = settings.sortCompare = true;
+		else if (arg == "--bounces")
+			settings.maxBounces = ParseUInt(arg, NextValue());
+		else if (arg == "--shadow")
+			settings.shadow = ParseFloat(arg, NextValue());
+		else if (arg == "--epsilon")
+			settings.epsilon = ParseFloat(arg, NextValue());
+		else if (arg == "--roulette")
+			settings.rouletteDepth = ParseUInt(arg, NextValue());
+		else if (arg == "--no-roulette")
+			settings.rouletteDepth = UINT32_MAX;
+		else if (arg == "--path-stats")
+			settings.pathStats = true;
+		else if (arg == "--denoise")
+			settings.denoiseIterations = ParseUInt(arg, NextValue());
+		else if (arg == "--temporal")
+			settings.temporal = true;
+		else if (arg == "--adaptive")
+			settings.adaptiveThreshold = ParseFloat(arg, NextValue());
+		else if (arg == "--render-scale")
+			settings.renderScale = ParseFloat(arg, NextValue());
+		else if (arg == "--target-ms")
+			settings.targetMs = ParseFloat(arg, NextValue());
+		else if (arg == "--upscale")
+		{
+			std::string value = NextValue();
+			if (value == "bilinear")
+				settings.upscaleFilter = UpscaleBilinear;
+			else if (value == "edge")
+				settings.upscaleFilter = UpscaleEdge;
+			else
+				throw std::runtime_error("Option " + arg + " expects bilinear or edge, got '" + value + "' !");
+		}
+		else if (arg == "--interleave")
+			settings.interleave = ParseUInt(arg, NextValue());
+		else if (arg == "--poster")
+		{
+			// i.e. "--poster 16384x8192"
+			std::string value = NextValue();
+			auto separator = value.find('x');
+			if (separator == std::string::npos)
+				throw std::runtime_error("Option " + arg + " expects <width>x<height>, got '" + value + "' !");
+
+			settings.posterWidth = ParseUInt(arg, value.substr(0, separator).c_str());
+			settings.posterHeight = ParseUInt(arg, value.substr(separator + 1).c_str());
+		}
+		else if (arg == "--poster-tile")
+			settings.posterTile = ParseUInt(arg, NextValue());
+		else if (arg == "--dispatch-ms")
+			settings.dispatchMs = ParseFloat(arg, NextValue());
+		else if (arg == "--shared-staging")
+			settings.sharedStaging = true;
+		else if (arg == "--shared-budget")
+		{
+			settings.sharedStaging = true;
+			settings.sharedBudget = ParseUInt(arg, NextValue());
+		}
+		else if (arg == "--retune")
+			settings.retune = true;
+		else if (arg == "--shader")
+			settings.shaderPath = NextValue();
+		else if (arg == "--shader-cache")
+			settings.shaderCachePath = NextValue();
+		else if (arg == "--optimize-shader")
+			settings.optimizeShader = true;
+		else if (arg == "--watch-shader")
+			settings.watchShader = true;
+		else if (arg == "--pipeline-cache")
+			settings.pipelineCachePath = NextValue();
+		else if (arg == "--no-pipeline-cache")
+			settings.pipelineCachePath.clear();
+		else
+			throw std::runtime_error("Unknown option '" + arg + "' ! Run with --help to list all options.");
+	}
+
+	if (settings.meshInstances > 0 && settings.meshPaths.empty())
+		throw std::runtime_error("Option --instances needs at least one --mesh !");
+	if (settings.sortRays && !settings.wavefront)
+		throw std::runtime_error("Ray sorting needs --wavefront !");
+	if (settings.shadow < 0.0f || settings.shadow > 1.0f)
+		throw std::runtime_error("Option --shadow expects a value between 0 and 1 !");
+	if (settings.epsilon <= 0.0f)
+		throw std::runtime_error("Option --epsilon expects a positive value !");
+	// Past maxBounces paths end anyway.
+	settings.rouletteDepth = std::min(settings.rouletteDepth, settings.maxBounces);
+	// The 8th iteration already spans 1021 pixels.
+	if (settings.denoiseIterations > 8)
+		throw std::runtime_error("Option --denoise expects at most 8 iterations !");
+	if (settings.adaptiveThreshold < 0.0f)
+		throw std::runtime_error("Option --adaptive expects a positive error threshold !");
+	// The tile list drives the dispatch of the megakernel, the wavefront passes queue rays instead of tiles.
+	if (settings.adaptiveThreshold > 0.0f && settings.wavefront)
+		throw std::runtime_error("Option --adaptive needs the megakernel, it can't be combined with --wavefront !");
+	// The temporal history restarts every frame, there is no running estimate to converge.
+	if (settings.adaptiveThreshold > 0.0f && settings.temporal)
+		throw std::runtime_error("Option --adaptive can't be combined with --temporal !");
+	if (settings.renderScale < MinRenderScale || settings.renderScale > 1.0f)
+		throw std::runtime_error("Option --render-scale expects a value between 0.25 and 1 !");
+	if (settings.targetMs < 0.0f)
+		throw std::runtime_error("Option --target-ms expects a positive frame time !");
+	// The governor follows GPU timestamps, the CPU renderer keeps a fixed --render-scale.
+	if (settings.targetMs > 0.0f && settings.cpu)
+		throw std::runtime_error("Option --target-ms can't be combined with --cpu !");
+	if (settings.interleave != 1 && settings.interleave != 2 && settings.interleave != 4)
+		throw std::runtime_error("Option --interleave expects 1, 2 or 4 !");
+	// The megakernel picks the pixels of a phase, the wavefront queues & the adaptive tile list hold every pixel. Temporal
+	// reprojection & the denoiser read the G-buffer of every pixel, which the others didn't write this frame.
+	if (settings.interleave > 1 && (settings.wavefront || settings.adaptiveThreshold > 0.0f))
+		throw std::runtime_error("Option --interleave needs the megakernel over every pixel, it can't be combined with --wavefront or --adaptive !");
+	if (settings.interleave > 1 && (settings.temporal || settings.denoiseIterations > 0))
+		throw std::runtime_error("Option --interleave can't be combined with --temporal or --denoise !");
+	bool poster = settings.posterWidth > 0;
+	if (poster && !settings.headless && !settings.cpu)
+		throw std::runtime_error("Option --poster needs --headless or --cpu !");
+	if ((settings.posterTile > 0 || settings.dispatchMs != 0.0f) && !poster)
+		throw std::runtime_error("Options --poster-tile & --dispatch-ms need --poster !");
+	if (settings.dispatchMs < 0.0f)
+		throw std::runtime_error("Option --dispatch-ms expects a positive time !");
+	// There is no driver watchdog to stay below.
+	if (settings.dispatchMs > 0.0f && settings.cpu)
+		throw std::runtime_error("Option --dispatch-ms can't be combined with --cpu !");
+	// Every tile is a still frame of its own. The filters would need the pixels of the tiles around, scaling & interleaving
+	// the whole image.
+	if (poster && (settings.temporal || settings.denoiseIterations > 0 || settings.adaptiveThreshold > 0.0f))
+		throw std::runtime_error("Option --poster can't be combined with --temporal, --denoise or --adaptive !");
+	if (poster && (settings.renderScale < 1.0f || settings.targetMs > 0.0f || settings.interleave > 1))
+		throw std::runtime_error("Option --poster can't be combined with --render-scale, --target-ms or --interleave !");
+	if (poster && (settings.animate || settings.orbit || settings.sortCompare))
+		throw std::runtime_error("Option --poster can't be combined with --animate, --orbit or --sort-compare !");
+	if (settings.sortCompare && !settings.headless)
+		throw std::runtime_error("Option --sort-compare needs --headless !");
+	if (settings.compareTolerance >= 0.0f && settings.comparePath.empty())
+		throw std::runtime_error("Option --compare-tolerance needs --compare !");
+
+	return settings;
+}
+
+void PrintUsage(const char* executable)
+{
+	std::cout << "usage: " << executable << " [options]" << std::endl
+		<< "\t--headless           Render offscreen, without window & swap chain." << std::endl
+		<< "\t--frames <n>         Number of frames to render in headless mode (default: 1)." << std::endl
+		<< "\t--output, -o <file>  Where the last headless frame is written to, as binary PPM (default: render.ppm)." << std::endl
+		<< "\t--cpu                Render on the CPU, no Vulkan device required." << std::endl
+		<< "\t--threads <n>        Worker threads of the CPU renderer (default: one per hardware thread)." << std::endl
+		<< "\t--cpu-scaling        Report CPU render times for 1 up to --threads workers." << std::endl
+		<< "\t--mesh <file.obj>    Add a triangle mesh to the scene, may be repeated." << std::endl
+		<< "\t--instances <n>      Scatter n instances of the meshes through the room, sharing their geometry." << std::endl
+		<< "\t--animate            Spin the mesh instances every frame." << std::endl
+		<< "\t--orbit              Sway the camera through the room every frame." << std::endl
+		<< "\t--spheres <n>        Add n random spheres to the scene." << std::endl
+		<< "\t--lights <n>         Add n small sphere & point lights, together as bright as the ceiling light." << std::endl
+		<< "\t--bvh-scaling        Report BVH build & CPU render times for 10 up to 1M spheres." << std::endl
+		<< "\t--compare <file>     Compare the written image against a reference PPM, i.e. GPU against CPU output." << std::endl
+		<< "\t--compare-tolerance <mean>  Fail if the mean difference per channel of --compare is above this (i.e. 0.05)." << std::endl
+		<< "\t--timings <file>     Write min/avg/p99 GPU time per stage as JSON on exit." << std::endl
+		<< "\t--sampler <name>     Samples of antialiasing, soft shadows & diffuse bounces: none, random, sobol or bluenoise (default: sobol)." << std::endl
+		<< "\t--spp <n>            Samples per pixel each frame adds (default: 1)." << std::endl
+		<< "\t--wavefront          Trace in wavefront passes over ray queues instead of one invocation per path." << std::endl
+		<< "\t--sort-rays          Sort secondary & shadow rays of the wavefront passes by material, direction & origin." << std::endl
+		<< "\t--sort-compare       Render the headless frames without & with ray sorting and report both throughputs." << std::endl
+		<< "\t--bounces <n>        Bounces per path (default: 4)." << std::endl
+		<< "\t--shadow <f>         Brightness of shadowed surfaces with --sampler none, 0 to 1 (default: 0.35)." << std::endl
+		<< "\t--epsilon <f>        Offset of secondary rays from the surface they leave, GPU only (default: 0.0001)." << std::endl
+		<< "\t--roulette <n>       Bounces before Russian roulette may end a path by its throughput (default: 3)." << std::endl
+		<< "\t--no-roulette        Trace every path up to --bounces." << std::endl
+		<< "\t--path-stats         Print the average path length & how paths ended on exit." << std::endl
+		<< "\t--denoise <n>        Run n edge-aware a-trous iterations over every frame, guided by normals, depth & albedo." << std::endl
+		<< "\t--temporal           Reproject the history of earlier frames instead of accumulating, for moving cameras & instances." << std::endl
+		<< "\t--adaptive <f>       Only sample tiles whose relative error is still above f (i.e. 0.02), stop once all converged." << std::endl
+		<< "\t--render-scale <f>   Trace frames at this fraction of the output size, 0.25 to 1, & upscale them (default: 1)." << std::endl
+		<< "\t--target-ms <ms>     Adjust the render scale every few frames to keep the GPU frame time at ms, starting at --render-scale." << std::endl
+		<< "\t--upscale <name>     Filter stretching scaled frames over the output: bilinear or edge (default: edge)." << std::endl
+		<< "\t--interleave <n>     Trace 1 of every n pixels per frame, 2 (checkerboard) or 4, & reconstruct the rest (default: 1)." << std::endl
+		<< "\t--poster <w>x<h>     Render a w x h image tile by tile, --frames x --spp samples each, & stream it to --output." << std::endl
+		<< "\t--poster-tile <n>    Side of the poster tiles (default: the window size)." << std::endl
+		<< "\t--dispatch-ms <ms>   Split the samples of a poster tile into dispatches of at most ms each, GPU only (default: --spp each)." << std::endl
+		<< "\t--shared-staging     Stage planes, the top of the sphere BVH & the spheres in workgroup shared memory, as far as they fit." << std::endl
+		<< "\t--shared-budget <n>  Bytes of shared memory staging may use (default: the device limit), implies --shared-staging." << std::endl
+		<< "\t--workgroup <x>x<y>  Use this local size for the ray tracing shader instead of tuning it." << std::endl
+		<< "\t--retune             Time all workgroup sizes again, even if one is cached for this device & driver." << std::endl
+		<< "\t--shader <file>      GLSL source of the ray tracing shader, compiled at startup (default: shaders/raytracing.comp)." << std::endl
+		<< "\t--shader-cache <dir> Where compiled SPIR-V is cached by a hash of source & options (default: shader_cache)." << std::endl
+		<< "\t--optimize-shader    Run the spirv-opt performance passes over the compiled shader." << std::endl
+		<< "\t--watch-shader       Recompile the shader whenever its source changes & swap it in while rendering." << std::endl
+		<< "\t--pipeline-cache <file>  Where compiled pipelines are kept between runs (default: pipeline_cache.bin)." << std::endl
+		<< "\t--no-pipeline-cache  Compile all pipelines from scratch & don't write the cache." << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RenderScale.h"
+#include "Sampler.h"
+
+/// <summary>
+/// Holds the startup options of the application, usually parsed from the command line.
+/// </summary>
+
+struct RenderSettings
+{
+	// Render without a window & swap chain and write the final frame to outputPath.
+	bool headless = false;
+	uint32_t frames = 1;
+	std::string outputPath = "render.ppm";
+
+	// Render on the CPU instead, with threads workers (0 = one per hardware thread).
+	bool cpu = false;
+	uint32_t threads = 0;
+	// Print render times for 1 up to threads workers before rendering.
+	bool cpuScaling = false;
+
+	// OBJ meshes added to the scene, each one scaled to stand on the floor of the room.
+	std::vector<std::string> meshPaths;
+	// Scatter this many instances of the meshes through the room instead, each with its own transform & material.
+	uint32_t meshInstances = 0;
+	// Spin the instances every frame, which refits the instance hierarchy & uploads the instances again.
+	bool animate = false;
+	// Sway the camera through the room every frame, see CameraPose::Orbit.
+	bool orbit = false;
+
+	// Add this many random spheres to the scene, i.e. to measure how rendering scales with scene size.
+	uint32_t extraSpheres = 0;
+	// Add this many small sphere & point lights, together as bright as the ceiling light.
+	uint32_t extraLights = 0;
+	// Print BVH build & CPU render times for 10 up to 1M spheres.
+	bool bvhScaling = false;
+
+	// Compare the written image against this reference image (i.e. CPU against GPU output).
+	std::string comparePath;
+	// Fail when the mean difference per channel is above this, negative to only report it.
+	float compareTolerance = -1.0f;
+
+	// Write the per stage GPU timings as JSON on exit, i.e. for benchmarks & CI.
+	std::string timingsPath;
+
+	// Where antialiasing, soft shadows & diffuse bounces draw their random numbers from.
+	SamplerType sampler = SamplerSobol;
+	// Samples per pixel each frame (or dispatch) adds, fewer frames of more work each.
+	uint32_t samplesPerPixel = 1;
+
+	// Trace with separate generate, extend, shade & connect passes over ray queues instead of one thread per path.
+	bool wavefront = false;
+	// Sort secondary & shadow rays by material, direction & origin before the wavefront passes intersect them.
+	bool sortRays = false;
+	// Render the headless frames without ray sorting first & report the throughput of both runs.
+	bool sortCompare = false;
+
+	// Bounces per path, brightness in shadow (--sampler none only) & the offset of secondary rays, baked into the shader as
+	// specialization constants.
+	uint32_t maxBounces = 4;
+	float shadow = 0.35f;
+	float epsilon = 0.0001f;
+	// Bounces every path takes before Russian roulette may end it, as many as maxBounces turn it off.
+	uint32_t rouletteDepth = 3;
+	// Count path lengths & print them on exit, the GPU pays with atomics for it.
+	bool pathStats = false;
+	// A-trous iterations of the edge-aware denoiser run after every frame, 0 = show the raw samples.
+	uint32_t denoiseIterations = 0;
+	// Blend every frame into the history of the ones before, reprojected by motion vectors, instead of accumulating until
+	// anything moves.
+	bool temporal = false;
+	// Stop sampling tiles once their estimated relative error falls below this, 0 = sample every pixel every frame.
+	// The headless render ends early once every tile converged.
+	float adaptiveThreshold = 0.0f;
+	// Trace frames at this fraction of the output size & upscale them (MinRenderScale to 1). With a targetMs it's only the
+	// scale the governor starts at, which then follows the GPU frame time, 0 = keep the scale.
+	float renderScale = 1.0f;
+	float targetMs = 0.0f;
+	UpscaleFilter upscaleFilter = UpscaleEdge;
+	// Trace 1 of every 2 (checkerboard) or 4 (2x2 blocks) pixels per frame & reconstruct the others, 1 = trace every pixel.
+	uint32_t interleave = 1;
+
+	// Render a posterWidth x posterHeight image tile by tile instead & stream it to outputPath, 0 = one frame of the window
+	// size. Every tile takes frames * samplesPerPixel samples, in dispatches of up to dispatchMs each (0 = samplesPerPixel
+	// each). Tiles are posterTile pixels square, 0 = the size of the compute image.
+	uint32_t posterWidth = 0;
+	uint32_t posterHeight = 0;
+	uint32_t posterTile = 0;
+	float dispatchMs = 0.0f;
+
+	// Stage planes, the top levels of the sphere hierarchy & the spheres in workgroup shared memory, as far as they fit.
+	bool sharedStaging = false;
+	// Shared memory staging may use, 0 = what the device offers (maxComputeSharedMemorySize).
+	uint32_t sharedBudget = 0;
+
+	// Force the local size of the ray tracing shader (0 = tune at startup, or reuse the cached result).
+	uint32_t workgroupX = 0;
+	uint32_t workgroupY = 0;
+	// Ignore the cached workgroup size & tune again.
+	bool retune = false;
+	std::string workgroupCachePath = "workgroup_cache.txt";
+
+	// The ray tracing shader is compiled from this source at startup, the SPIR-V is cached in shaderCachePath by a hash
+	// of the source & compiler options.
+#ifdef VKRT_SHADER_SOURCE
+	std::string shaderPath = VKRT_SHADER_SOURCE;
+#else
+	std::string shaderPath = "shaders/raytracing.comp";
+#endif
+	std::string shaderCachePath = "shader_cache";
+	// Run spirv-opt over the compiled shader.
+	bool optimizeShader = false;
+	// Compile edits of the source in the background & swap in the new pipelines while rendering.
+	bool watchShader = false;
+
+	// Compiled pipelines are kept here between runs, empty to always start cold.
+	std::string pipelineCachePath = "pipeline_cache.bin";
+};
+
+RenderSettings ParseRenderSettings(int argc, char* argv[]);
+void PrintUsage(const char* executable);
\ No newline at end of file
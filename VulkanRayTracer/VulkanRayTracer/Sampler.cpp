@@ -0,0 +1,235 @@
+#include "Sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+namespace
+{
+	// Keep these in sync with the sampler functions of shaders/raytracing.comp.
+	uint32_t Hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	uint32_t ReverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return x;
+	}
+
+	// Second Sobol dimension as 0.32 fixed point, the first one is ReverseBits(index).
+	// The shader loops over the bits of the index, here the directions of each of its bytes are combined up front.
+	struct Sobol1Table
+	{
+		uint32_t bytes[4][256];
+
+		Sobol1Table()
+		{
+			uint32_t directions[32];
+			directions[0] = 0x80000000u;
+			for (int i = 1; i < 32; i++)
+				directions[i] = directions[i - 1] ^ (directions[i - 1] >> 1);
+
+			for (int byte = 0; byte < 4; byte++)
+			{
+				for (uint32_t value = 0; value < 256; value++)
+				{
+					uint32_t result = 0;
+					for (int bit = 0; bit < 8; bit++)
+					{
+						if (value & (1u << bit))
+							result ^= directions[byte * 8 + bit];
+					}
+					bytes[byte][value] = result;
+				}
+			}
+		}
+	};
+
+	uint32_t Sobol1(uint32_t index)
+	{
+		static const Sobol1Table table;
+		return table.bytes[0][index & 0xff] ^ table.bytes[1][(index >> 8) & 0xff] ^ table.bytes[2][(index >> 16) & 0xff] ^ table.bytes[3][index >> 24];
+	}
+
+	// Flips every bit depending on the bits above it only, which keeps the stratification of Sobol points.
+	uint32_t OwenScramble(uint32_t x, uint32_t seed)
+	{
+		x = ReverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return ReverseBits(x);
+	}
+
+	// The upper 24 bits, which a float holds exactly, so results stay below 1.
+	float ToUnit(uint32_t x)
+	{
+		return float(x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// The R2 sequence as 0.32 fixed point, wrapping multiplications keep it exact for any sample index.
+	const uint32_t R2X = 3242174889u;
+	const uint32_t R2Y = 2447445414u;
+}
+
+
+Sampler::Sampler(SamplerType type) : type(type)
+{
+	if (type == SamplerBlueNoise)
+		blueNoise = GenerateBlueNoise(BlueNoiseSize);
+}
+
+void Sampler::Get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension, float& u, float& v) const
+{
+	if (type == SamplerBlueNoise)
+	{
+		// Each dimension pair reads the mask at its own offset.
+		uint32_t offset = Hash(dimension);
+		uint32_t mask = BlueNoiseSize - 1;
+		float a = blueNoise[((y + (offset >> 6)) & mask) * BlueNoiseSize + ((x + offset) & mask)];
+		float b = blueNoise[((y + (offset >> 18)) & mask) * BlueNoiseSize + ((x + (offset >> 12)) & mask)];
+
+		u = a + ToUnit(index * R2X);
+		v = b + ToUnit(index * R2Y);
+		u -= std::floor(u);
+		v -= std::floor(v);
+		return;
+	}
+
+	uint32_t seed = Hash(x ^ Hash(y ^ Hash(dimension)));
+
+	if (type == SamplerRandom)
+	{
+		uint32_t hash = Hash(seed ^ Hash(index));
+		u = ToUnit(hash);
+		v = ToUnit(Hash(hash));
+		return;
+	}
+
+	uint32_t shuffled = OwenScramble(index, seed);
+
+	u = ToUnit(OwenScramble(ReverseBits(shuffled), Hash(seed + 1)));
+	v = ToUnit(OwenScramble(Sobol1(shuffled), Hash(seed + 2)));
+}
+
+std::vector<float> Sampler::GenerateBlueNoise(uint32_t size)
+{
+	const uint32_t count = size * size;
+	const float sigma = 1.5f;
+
+	// Energy a set pixel adds to the others by toroidal offset, clusters have high energy & voids low one.
+	std::vector<float> kernel(count);
+	for (uint32_t dy = 0; dy < size; dy++)
+	{
+		for (uint32_t dx = 0; dx < size; dx++)
+		{
+			float x = float(std::min(dx, size - dx));
+			float y = float(std::min(dy, size - dy));
+			kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2 * sigma * sigma));
+		}
+	}
+
+	std::vector<uint8_t> pattern(count, 0);
+	std::vector<float> energy(count, 0.0f);
+
+	auto Toggle = [&](uint32_t pixel)
+	{
+		float sign = pattern[pixel] ? -1.0f : 1.0f;
+		pattern[pixel] ^= 1;
+
+		uint32_t px = pixel % size, py = pixel / size;
+		for (uint32_t y = 0; y < size; y++)
+		{
+			const float* row = &kernel[((y + size - py) % size) * size];
+			for (uint32_t x = 0; x < size; x++)
+				energy[y * size + x] += sign * row[(x + size - px) % size];
+		}
+	};
+
+	auto TightestCluster = [&]()
+	{
+		uint32_t best = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (pattern[i] && (!pattern[best] || energy[i] > energy[best]))
+				best = i;
+		}
+		return best;
+	};
+
+	auto LargestVoid = [&]()
+	{
+		uint32_t best = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (!pattern[i] && (pattern[best] || energy[i] < energy[best]))
+				best = i;
+		}
+		return best;
+	};
+
+	// Random initial pattern of a tenth of the pixels, spread out by moving the tightest cluster into the largest void until that stops changing anything.
+	std::mt19937 random(1337);
+	uint32_t ones = std::max(count / 10, 1u);
+	for (uint32_t set = 0; set < ones;)
+	{
+		uint32_t pixel = random() % count;
+		if (!pattern[pixel])
+		{
+			Toggle(pixel);
+			set++;
+		}
+	}
+
+	while (true)
+	{
+		uint32_t cluster = TightestCluster();
+		Toggle(cluster);
+		uint32_t hole = LargestVoid();
+		Toggle(hole);
+
+		if (hole == cluster)
+			break;
+	}
+
+	std::vector<uint32_t> rank(count);
+
+	// Ranks below the initial pattern: take its tightest clusters away one by one.
+	auto initialPattern = pattern;
+	auto initialEnergy = energy;
+	for (uint32_t r = ones; r-- > 0;)
+	{
+		uint32_t cluster = TightestCluster();
+		Toggle(cluster);
+		rank[cluster] = r;
+	}
+
+	// Ranks above it: fill the largest void until no pixel is left.
+	pattern.swap(initialPattern);
+	energy.swap(initialEnergy);
+	for (uint32_t r = ones; r < count; r++)
+	{
+		uint32_t hole = LargestVoid();
+		Toggle(hole);
+		rank[hole] = r;
+	}
+
+	std::vector<float> mask(count);
+	for (uint32_t i = 0; i < count; i++)
+		mask[i] = float(rank[i]) / float(count);
+
+	return mask;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Sample sequences for antialiasing, soft shadows & diffuse bounces, mirroring the sampler of shaders/raytracing.comp.
+/// Every sample draws pairs of dimensions: pixel jitter first, then light position, bounce direction & Russian roulette per bounce.
+/// Sobol points are Owen scrambled & shuffled per pixel & dimension pair, see "Practical Hash-based Owen Scrambling" (Burley 2020).
+/// Random hashes pixel, sample index & dimension into white noise.
+/// Blue noise tiles a void & cluster mask over the image & rotates it by the R2 sequence from sample to sample.
+/// </summary>
+
+// Keep in sync with the Sampler* #defines of the shader.
+enum SamplerType : int32_t
+{
+	// One fixed ray per pixel towards the center of the light, like before samplers existed.
+	SamplerNone,
+	// White noise, the baseline the others should beat.
+	SamplerRandom,
+	SamplerSobol,
+	SamplerBlueNoise
+};
+
+// Dimension pairs of a sample.
+inline uint32_t PixelDimension() { return 0; }
+inline uint32_t LightDimension(uint32_t bounce) { return 1 + 3 * bounce; }
+inline uint32_t BounceDimension(uint32_t bounce) { return 2 + 3 * bounce; }
+// Only the first dimension of the pair decides.
+inline uint32_t RouletteDimension(uint32_t bounce) { return 3 + 3 * bounce; }
+
+class Sampler
+{
+public:
+	// Width & height of the tiled blue noise mask.
+	static const uint32_t BlueNoiseSize = 64;
+
+	explicit Sampler(SamplerType type);
+
+	// Two dimensions in [0, 1) of sample index of pixel (x, y).
+	void Get2D(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension, float& u, float& v) const;
+
+	SamplerType GetType() const { return type; }
+	bool IsStochastic() const { return type != SamplerNone; }
+
+	// BlueNoiseSize * BlueNoiseSize values in [0, 1), row by row, as uploaded to the shader.
+	const std::vector<float>& GetBlueNoise() const { return blueNoise; }
+
+	// Void & cluster dither mask, every rank appears once. Deterministic, so the CPU & GPU renderers tile the same mask.
+	static std::vector<float> GenerateBlueNoise(uint32_t size);
+
+private:
+	SamplerType type;
+	std::vector<float> blueNoise;
+};
@@ -0,0 +1,301 @@
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+
+
+Bvh::Bounds::Bounds() : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+void Bvh::Bounds::Grow(const Vector3& point)
+{
+	min = Vector3(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+	max = Vector3(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+
+void Bvh::Bounds::Grow(const Bounds& bounds)
+{
+	// Empty bounds (i.e. of an empty bin) are inverted & must not grow anything.
+	if (bounds.min.x > bounds.max.x)
+		return;
+
+	Grow(bounds.min);
+	Grow(bounds.max);
+}
+
+float Bvh::Bounds::Area() const
+{
+	Vector3 extent = max - min;
+	if (extent.x < 0)
+		return 0;
+
+	return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+
+Bvh::Bvh(std::vector<Sphere>& spheres)
+{
+	uint32_t count = uint32_t(spheres.size());
+
+	primitiveBounds.resize(count);
+	centroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const auto& s = spheres[i];
+		Vector3 extent(s.radius, s.radius, s.radius);
+		primitiveBounds[i].Grow(s.position - extent);
+		primitiveBounds[i].Grow(s.position + extent);
+		centroids[i] = s.position;
+	}
+
+	Build();
+
+	std::vector<Sphere> ordered;
+	ordered.reserve(count);
+	for (uint32_t index : indices)
+		ordered.push_back(spheres[index]);
+	spheres.swap(ordered);
+
+	indices.clear();
+}
+
+Bvh::Bvh(Mesh& mesh)
+{
+	uint32_t count = mesh.TriangleCount();
+
+	primitiveBounds.resize(count);
+	centroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const auto& a = mesh.positions[mesh.indices[3 * i]];
+		const auto& b = mesh.positions[mesh.indices[3 * i + 1]];
+		const auto& c = mesh.positions[mesh.indices[3 * i + 2]];
+
+		primitiveBounds[i].Grow(a);
+		primitiveBounds[i].Grow(b);
+		primitiveBounds[i].Grow(c);
+		centroids[i] = (a + b + c) / 3;
+	}
+
+	Build();
+
+	std::vector<uint32_t> ordered;
+	ordered.reserve(mesh.indices.size());
+	for (uint32_t index : indices)
+		ordered.insert(ordered.end(), mesh.indices.begin() + 3 * index, mesh.indices.begin() + 3 * index + 3);
+	mesh.indices.swap(ordered);
+
+	indices.clear();
+}
+
+Bvh::Bvh(const std::vector<Bounds>& bounds)
+{
+	primitiveBounds = bounds;
+
+	centroids.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		centroids[i] = (bounds[i].min + bounds[i].max) / 2;
+
+	Build();
+}
+
+void Bvh::Refit(std::vector<BvhNode>& nodes, const std::vector<Bounds>& bounds)
+{
+	// Children are always stored behind their parent.
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		auto& node = nodes[i];
+
+		Bounds refitted;
+		if (node.count > 0)
+		{
+			for (int32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; p++)
+				refitted.Grow(bounds[p]);
+		}
+		else if (node.leftOrFirst > 0)
+		{
+			const auto& left = nodes[node.leftOrFirst];
+			const auto& right = nodes[node.leftOrFirst + 1];
+			refitted.Grow(left.boundsMin);
+			refitted.Grow(left.boundsMax);
+			refitted.Grow(right.boundsMin);
+			refitted.Grow(right.boundsMax);
+		}
+
+		node.boundsMin = refitted.min;
+		node.boundsMax = refitted.max;
+	}
+}
+
+std::vector<BvhNode> Bvh::BreadthFirst(const std::vector<BvhNode>& nodes)
+{
+	// The root of an empty hierarchy looks like an inner node.
+	if (nodes.size() <= 1)
+		return nodes;
+
+	// Children are appended as a pair whenever their parent comes up, their own children still point into nodes until then.
+	std::vector<BvhNode> ordered;
+	ordered.reserve(nodes.size());
+	ordered.push_back(nodes[0]);
+
+	for (size_t i = 0; i < ordered.size(); i++)
+	{
+		if (ordered[i].count > 0)
+			continue;
+
+		int32_t left = ordered[i].leftOrFirst;
+		ordered[i].leftOrFirst = int32_t(ordered.size());
+		ordered.push_back(nodes[left]);
+		ordered.push_back(nodes[left + 1]);
+	}
+
+	return ordered;
+}
+
+void Bvh::Build()
+{
+	uint32_t count = uint32_t(centroids.size());
+
+	indices.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+		indices[i] = i;
+
+	// A full binary tree with leaves of at least one primitive has at most 2n - 1 nodes.
+	nodes.reserve(std::max(1u, 2 * count));
+	nodes.push_back(BvhNode());
+
+	// An empty scene keeps a root with inverted bounds, which no ray can hit.
+	if (count == 0)
+	{
+		Bounds empty;
+		nodes[0] = { empty.min, 0, empty.max, 0 };
+		return;
+	}
+
+	Subdivide(0, 0, count, 1);
+
+	primitiveBounds.clear();
+	primitiveBounds.shrink_to_fit();
+	centroids.clear();
+	centroids.shrink_to_fit();
+}
+
+void Bvh::MakeLeaf(uint32_t node, uint32_t first, uint32_t count)
+{
+	nodes[node].leftOrFirst = int32_t(first);
+	nodes[node].count = int32_t(count);
+}
+
+void Bvh::Subdivide(uint32_t node, uint32_t first, uint32_t count, uint32_t level)
+{
+	depth = std::max(depth, level);
+
+	Bounds bounds, centroidBounds;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		bounds.Grow(primitiveBounds[indices[i]]);
+		centroidBounds.Grow(centroids[indices[i]]);
+	}
+
+	nodes[node].boundsMin = bounds.min;
+	nodes[node].boundsMax = bounds.max;
+
+	if (count == 1 || level >= MaxDepth)
+	{
+		MakeLeaf(node, first, count);
+		return;
+	}
+
+	// Find the cheapest of the BinCount - 1 split planes along each axis.
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+
+	const float* centroidMin = &centroidBounds.min.x;
+	const float* centroidMax = &centroidBounds.max.x;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0)
+			continue;
+
+		Bounds binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		float scale = BinCount / extent;
+
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			uint32_t index = indices[i];
+			float centroid = (&centroids[index].x)[axis];
+			uint32_t bin = std::min(BinCount - 1, uint32_t((centroid - centroidMin[axis]) * scale));
+
+			binBounds[bin].Grow(primitiveBounds[index]);
+			binCounts[bin]++;
+		}
+
+		// Sweep from the right to get the area & count of every right side, then from the left to evaluate each split.
+		float rightAreas[BinCount];
+		uint32_t rightCounts[BinCount];
+		Bounds right;
+		uint32_t rightCount = 0;
+		for (uint32_t bin = BinCount - 1; bin > 0; bin--)
+		{
+			right.Grow(binBounds[bin]);
+			rightCount += binCounts[bin];
+			rightAreas[bin] = right.Area();
+			rightCounts[bin] = rightCount;
+		}
+
+		Bounds left;
+		uint32_t leftCount = 0;
+		for (uint32_t split = 1; split < BinCount; split++)
+		{
+			left.Grow(binBounds[split - 1]);
+			leftCount += binCounts[split - 1];
+
+			if (leftCount == 0 || rightCounts[split] == 0)
+				continue;
+
+			float cost = left.Area() * leftCount + rightAreas[split] * rightCounts[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// Traversal is assumed to cost as much as one primitive intersection.
+	float leafCost = float(count);
+	float splitCost = 1.0f + bestCost / bounds.Area();
+
+	// Without a plane between the centroids (i.e. stacked spheres or instances placed at one point) the range is halved at
+	// its median index, otherwise traversal would loop over all of it in one leaf.
+	bool medianSplit = bestAxis < 0 && count > MaxLeafSize;
+	if (!medianSplit && (bestAxis < 0 || (count <= MaxLeafSize && leafCost <= splitCost)))
+	{
+		MakeLeaf(node, first, count);
+		return;
+	}
+
+	uint32_t leftCount = count / 2;
+	if (!medianSplit)
+	{
+		float scale = BinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](uint32_t index)
+		{
+			float centroid = (&centroids[index].x)[bestAxis];
+			return std::min(BinCount - 1, uint32_t((centroid - centroidMin[bestAxis]) * scale)) < bestSplit;
+		});
+		leftCount = uint32_t(middle - indices.begin()) - first;
+	}
+
+	uint32_t leftChild = uint32_t(nodes.size());
+	nodes.push_back(BvhNode());
+	nodes.push_back(BvhNode());
+	nodes[node].leftOrFirst = int32_t(leftChild);
+	nodes[node].count = 0;
+
+	Subdivide(leftChild, first, leftCount, level + 1);
+	Subdivide(leftChild + 1, first + leftCount, count - leftCount, level + 1);
+}
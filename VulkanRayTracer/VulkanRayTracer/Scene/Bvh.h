@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+#include "Sphere.h"
+#include "Vector3.h"
+
+/// <summary>
+/// A bounding volume hierarchy over the spheres of the scene, the triangles of a mesh or the instances of the scene, built with a binned surface area heuristic.
+/// The nodes are laid out to be uploaded as is, see BvhNode in shaders/raytracing.comp.
+/// </summary>
+
+struct BvhNode
+{
+	Vector3 boundsMin;
+	// Index of the left child for inner nodes (the right one follows it), first primitive for leaves.
+	int32_t leftOrFirst;
+	Vector3 boundsMax;
+	// Number of primitives of a leaf, 0 for inner nodes.
+	int32_t count;
+};
+
+class Bvh
+{
+public:
+	struct Bounds
+	{
+		Vector3 min, max;
+
+		Bounds();
+		void Grow(const Vector3& point);
+		void Grow(const Bounds& bounds);
+		float Area() const;
+	};
+
+	// Builds the hierarchy & reorders spheres, so that every leaf references a contiguous range of them.
+	explicit Bvh(std::vector<Sphere>& spheres);
+	// Same for the triangles of the mesh, the vertices stay untouched.
+	explicit Bvh(Mesh& mesh);
+	// Builds over arbitrary primitives, leaves reference them in the order of GetPrimitiveOrder.
+	explicit Bvh(const std::vector<Bounds>& bounds);
+
+	const std::vector<BvhNode>& GetNodes() const { return nodes; }
+	uint32_t GetDepth() const { return depth; }
+	const std::vector<uint32_t>& GetPrimitiveOrder() const { return indices; }
+
+	// Recomputes the bounds of all nodes bottom up after primitives moved, the topology stays as it is.
+	// Much cheaper than a rebuild, but the hierarchy gets worse the further primitives move.
+	// bounds holds the primitives in leaf order.
+	static void Refit(std::vector<BvhNode>& nodes, const std::vector<Bounds>& bounds);
+	// The same hierarchy with its nodes in breadth first order, so that the top levels come first. Leaves keep their primitives.
+	static std::vector<BvhNode> BreadthFirst(const std::vector<BvhNode>& nodes);
+
+	// The traversal stack in the shader holds MaxDepth entries, deeper nodes are turned into leaves.
+	static const uint32_t MaxDepth = 32;
+	static const uint32_t BinCount = 16;
+	static const uint32_t MaxLeafSize = 4;
+
+private:
+	std::vector<BvhNode> nodes;
+	uint32_t depth = 0;
+
+	std::vector<Bounds> primitiveBounds;
+	std::vector<Vector3> centroids;
+	std::vector<uint32_t> indices;
+
+	// Builds over primitiveBounds & centroids, indices ends up holding the primitive order of the leaves.
+	void Build();
+	void Subdivide(uint32_t node, uint32_t first, uint32_t count, uint32_t level);
+	void MakeLeaf(uint32_t node, uint32_t first, uint32_t count);
+};
@@ -0,0 +1,14 @@
+#include "Camera.h"
+#include <math.h>
+
+
+CameraPose CameraPose::Orbit(uint32_t frame)
+{
+	float angle = 0.04f * float(frame);
+
+	// Left & right across the room while stepping back, turned towards its middle.
+	CameraPose pose;
+	pose.position = Vector3(0.6f * sinf(angle), 0.0f, -0.1f - 0.2f * (1.0f - cosf(angle)));
+	pose.yaw = 0.12f * sinf(angle);
+	return pose;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Vector3.h"
+
+/// <summary>
+/// Where the camera stands & how far it is turned around the vertical axis. Its image plane is 0.9 in front of the eye,
+/// see Camera & PrimaryRay in shaders/raytracing.comp, the default pose is the view of the room the renderers always had.
+/// </summary>
+
+struct CameraPose
+{
+	Vector3 position = Vector3(0.0f, 0.0f, -0.1f);
+	// Radians, turns like Matrix4::RotationY.
+	float yaw = 0.0f;
+
+	// Sways through the room with a fixed step per frame, so moving CPU & GPU renders stay comparable.
+	static CameraPose Orbit(uint32_t frame);
+};
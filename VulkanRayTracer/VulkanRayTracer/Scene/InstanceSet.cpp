@@ -0,0 +1,98 @@
+#include "InstanceSet.h"
+
+
+void InstanceSet::Add(int32_t mesh, const Matrix4& objectToWorld)
+{
+	MeshInstance instance = {};
+	instance.worldToObject = objectToWorld.InverseAffine();
+	instance.mesh = mesh;
+	instance.overrideMaterial = 0;
+
+	instances.push_back(instance);
+	transforms.push_back(objectToWorld);
+}
+
+void InstanceSet::Add(int32_t mesh, const Matrix4& objectToWorld, const Material& mat)
+{
+	Add(mesh, objectToWorld);
+	instances.back().overrideMaterial = 1;
+	instances.back().mat = mat;
+}
+
+void InstanceSet::Build(const std::vector<Mesh>& meshes)
+{
+	meshBounds.resize(meshes.size());
+	for (uint32_t i = 0; i < uint32_t(meshes.size()); i++)
+		meshes[i].GetBounds(meshBounds[i].min, meshBounds[i].max);
+
+	std::vector<Bvh::Bounds> bounds(instances.size());
+	for (uint32_t i = 0; i < Count(); i++)
+		bounds[i] = GetWorldBounds(i);
+
+	Bvh bvh(bounds);
+	nodes = bvh.GetNodes();
+
+	std::vector<MeshInstance> orderedInstances;
+	std::vector<Matrix4> orderedTransforms;
+	orderedInstances.reserve(instances.size());
+	orderedTransforms.reserve(transforms.size());
+	for (uint32_t index : bvh.GetPrimitiveOrder())
+	{
+		orderedInstances.push_back(instances[index]);
+		orderedTransforms.push_back(transforms[index]);
+	}
+	instances.swap(orderedInstances);
+	transforms.swap(orderedTransforms);
+}
+
+void InstanceSet::SetTransform(uint32_t instance, const Matrix4& objectToWorld)
+{
+	transforms[instance] = objectToWorld;
+	instances[instance].worldToObject = objectToWorld.InverseAffine();
+}
+
+void InstanceSet::Rotate(uint32_t instance, float radians)
+{
+	const auto& bounds = meshBounds[instances[instance].mesh];
+	Vector3 center = transforms[instance].TransformPoint((bounds.min + bounds.max) / 2);
+
+	SetTransform(instance, Matrix4::Translation(center) * Matrix4::RotationY(radians) * Matrix4::Translation(center * -1.0f)
+		* transforms[instance]);
+}
+
+std::vector<Matrix4> InstanceSet::GetMotion(const std::vector<Matrix4>& previous) const
+{
+	std::vector<Matrix4> motion(instances.size());
+	for (uint32_t i = 0; i < Count(); i++)
+		motion[i] = previous[i] * instances[i].worldToObject;
+	return motion;
+}
+
+void InstanceSet::Refit()
+{
+	std::vector<Bvh::Bounds> bounds(instances.size());
+	for (uint32_t i = 0; i < Count(); i++)
+		bounds[i] = GetWorldBounds(i);
+
+	Bvh::Refit(nodes, bounds);
+}
+
+Bvh::Bounds InstanceSet::GetWorldBounds(uint32_t instance) const
+{
+	const auto& local = meshBounds[instances[instance].mesh];
+	const auto& transform = transforms[instance];
+
+	// Bounds of all eight transformed corners, instances of empty meshes stay empty.
+	Bvh::Bounds world;
+	if (local.min.x > local.max.x)
+		return world;
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		Vector3 point((corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y,
+			(corner & 4) ? local.max.z : local.min.z);
+		world.Grow(transform.TransformPoint(point));
+	}
+
+	return world;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "Material.h"
+#include "Matrix4.h"
+#include "Mesh.h"
+
+/// <summary>
+/// Places meshes in the scene. Each instance references the shared geometry & hierarchy of a mesh with its own transform &
+/// optionally its own material, the instances get a hierarchy over their world space bounds on top.
+/// Memory thereby grows with the unique geometry, a copy of a mesh only costs one MeshInstance.
+/// </summary>
+
+class InstanceSet
+{
+public:
+	// The instance is shaded with the material of its mesh.
+	void Add(int32_t mesh, const Matrix4& objectToWorld);
+	void Add(int32_t mesh, const Matrix4& objectToWorld, const Material& mat);
+
+	// Builds the top level hierarchy & reorders the instances to match its leaves, instance indices change.
+	void Build(const std::vector<Mesh>& meshes);
+
+	// Moves an instance, the hierarchy only follows with the next Refit.
+	void SetTransform(uint32_t instance, const Matrix4& objectToWorld);
+	const Matrix4& GetTransform(uint32_t instance) const { return transforms[instance]; }
+	const std::vector<Matrix4>& GetTransforms() const { return transforms; }
+	// Per instance, moves points from where it is now to where the transforms of an earlier GetTransforms had it.
+	std::vector<Matrix4> GetMotion(const std::vector<Matrix4>& previous) const;
+	// Spins an instance around the vertical axis through the center of its bounds.
+	void Rotate(uint32_t instance, float radians);
+	void Refit();
+
+	uint32_t Count() const { return uint32_t(instances.size()); }
+	const std::vector<MeshInstance>& GetInstances() const { return instances; }
+	const std::vector<BvhNode>& GetNodes() const { return nodes; }
+
+private:
+	std::vector<MeshInstance> instances;
+	// Object to world, the inverse of MeshInstance::worldToObject.
+	std::vector<Matrix4> transforms;
+	std::vector<BvhNode> nodes;
+
+	// Object space bounds of every mesh.
+	std::vector<Bvh::Bounds> meshBounds;
+
+	Bvh::Bounds GetWorldBounds(uint32_t instance) const;
+};
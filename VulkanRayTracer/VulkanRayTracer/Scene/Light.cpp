@@ -0,0 +1,194 @@
+#include "Light.h"
+#include <algorithm>
+#include <math.h>
+
+
+namespace
+{
+	const float PI = 3.141592f;
+
+	float Luminance(const Vector3& color)
+	{
+		return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+	}
+
+	// Orthonormal basis around normal, see SampleDiffuse.
+	void Basis(const Vector3& normal, Vector3& tangent, Vector3& bitangent)
+	{
+		float s = (normal.z >= 0) ? 1.0f : -1.0f;
+		float a = -1.0f / (s + normal.z);
+		float b = normal.x * normal.y * a;
+		tangent = Vector3(1.0f + s * normal.x * normal.x * a, s * b, -s * normal.x);
+		bitangent = Vector3(b, s + normal.y * normal.y * a, -normal.y);
+	}
+}
+
+
+Light Light::Rectangle(const Vector3& corner, const Vector3& u, const Vector3& v, const Vector3& emission)
+{
+	Light light = {};
+	light.type = LightRectangle;
+	light.position = corner;
+	light.u = u;
+	light.v = v;
+	light.emission = emission;
+	return light;
+}
+
+Light Light::Sphere(const Vector3& center, float radius, const Vector3& emission)
+{
+	Light light = {};
+	light.type = LightSphere;
+	light.position = center;
+	light.radius = radius;
+	light.emission = emission;
+	return light;
+}
+
+Light Light::Point(const Vector3& position, const Vector3& intensity)
+{
+	Light light = {};
+	light.type = LightPoint;
+	light.position = position;
+	light.emission = intensity;
+	return light;
+}
+
+float Light::Power() const
+{
+	if (type == LightRectangle)
+		return Luminance(emission) * Vector3::Cross(u, v).Magnitude() * PI;
+	if (type == LightSphere)
+		return Luminance(emission) * 4.0f * PI * radius * radius * PI;
+
+	return Luminance(emission) * 4.0f * PI;
+}
+
+bool Light::Sample(const Vector3& point, float su, float sv, LightSample& sample) const
+{
+	if (type == LightRectangle)
+	{
+		Vector3 normal = Vector3::Cross(u, v);
+		float area = normal.Magnitude();
+		normal = normal / area;
+
+		Vector3 toLight = position + u * su + v * sv - point;
+		sample.distance = toLight.Magnitude();
+		sample.direction = toLight / sample.distance;
+
+		float cosLight = -Vector3::Dot(normal, sample.direction);
+		if (cosLight <= 0.0f)
+			return false;
+
+		// The area density 1 / area is d^2 / (cos * area) per solid angle.
+		sample.radiance = emission * (cosLight * area / (sample.distance * sample.distance));
+		return true;
+	}
+
+	if (type == LightSphere)
+	{
+		// Uniform directions in the cone the sphere covers.
+		Vector3 toCenter = position - point;
+		float centerDistance = toCenter.Magnitude();
+		if (centerDistance <= radius)
+			return false;
+
+		Vector3 w = toCenter / centerDistance;
+		float sinMax2 = radius * radius / (centerDistance * centerDistance);
+		float cosMax = sqrt(std::max(0.0f, 1.0f - sinMax2));
+		float cosTheta = 1.0f - su * (1.0f - cosMax);
+		float sinTheta = sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+		float phi = 2.0f * PI * sv;
+
+		Vector3 tangent, bitangent;
+		Basis(w, tangent, bitangent);
+		sample.direction = tangent * (sinTheta * cos(phi)) + bitangent * (sinTheta * sin(phi)) + w * cosTheta;
+		sample.distance = centerDistance * cosTheta - sqrt(std::max(0.0f, radius * radius - centerDistance * centerDistance * sinTheta * sinTheta));
+		sample.radiance = emission * (2.0f * PI * (1.0f - cosMax));
+		return true;
+	}
+
+	Vector3 toLight = position - point;
+	sample.distance = toLight.Magnitude();
+	sample.direction = toLight / sample.distance;
+	sample.radiance = emission / (sample.distance * sample.distance);
+	return true;
+}
+
+float Light::Intersect(const Vector3& origin, const Vector3& direction, bool& front) const
+{
+	front = false;
+
+	if (type == LightRectangle)
+	{
+		Vector3 normal = Vector3::Cross(u, v);
+		float denom = Vector3::Dot(normal, direction);
+		if (denom == 0.0f)
+			return -1.0f;
+
+		float t = Vector3::Dot(normal, position - origin) / denom;
+		Vector3 local = origin + direction * t - position;
+		float a = Vector3::Dot(local, u) / Vector3::Dot(u, u);
+		float b = Vector3::Dot(local, v) / Vector3::Dot(v, v);
+		if (a < 0.0f || a > 1.0f || b < 0.0f || b > 1.0f)
+			return -1.0f;
+
+		front = denom < 0.0f;
+		return t;
+	}
+
+	if (type == LightSphere)
+	{
+		Vector3 offset = origin - position;
+		float b = Vector3::Dot(offset, direction);
+		float c = Vector3::Dot(offset, offset) - radius * radius;
+		float discriminant = b * b - c;
+		if (discriminant < 0.0f)
+			return -1.0f;
+
+		float root = sqrt(discriminant);
+		front = true;
+		return (-b - root > 0.0f) ? -b - root : -b + root;
+	}
+
+	// Points can't be hit.
+	return -1.0f;
+}
+
+
+void UpdateLightCdf(std::vector<Light>& lights)
+{
+	float total = 0.0f;
+	for (const auto& light : lights)
+		total += light.Power();
+
+	float sum = 0.0f;
+	for (auto& light : lights)
+	{
+		sum += light.Power();
+		light.cdf = total > 0.0f ? sum / total : float(&light - lights.data() + 1) / lights.size();
+	}
+
+	// Rounding must not leave a gap below 1.
+	if (!lights.empty())
+		lights.back().cdf = 1.0f;
+}
+
+int PickLight(const std::vector<Light>& lights, float& u, float& pdf)
+{
+	// First light whose cdf lies above u, see PickLight in the shader.
+	int first = 0, last = int(lights.size()) - 1;
+	while (first < last)
+	{
+		int middle = (first + last) / 2;
+		if (lights[middle].cdf <= u)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	float previous = first > 0 ? lights[first - 1].cdf : 0.0f;
+	pdf = lights[first].cdf - previous;
+	u = std::min((u - previous) / pdf, 0.99999994f);
+	return first;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Vector3.h"
+
+/// <summary>
+/// An emitter the renderers sample directly at every diffuse hit (next event estimation), laid out like the Lights buffer of the shader.
+/// Rectangles emit from their front, the side cross(u, v) points to, spheres from their whole surface & points in all directions.
+/// Lights aren't part of the scene hierarchies: rays end where they hit one, but they don't block shadow rays.
+/// </summary>
+
+enum LightType
+{
+	LightRectangle = 0,
+	LightSphere = 1,
+	LightPoint = 2
+};
+
+// A point on a light as seen from a shading point.
+struct LightSample
+{
+	Vector3 direction;
+	float distance;
+	// Emitted radiance divided by the solid angle density of the sample (intensity / distance^2 for points).
+	Vector3 radiance;
+};
+
+struct Light
+{
+	// Corner of rectangles, center of spheres & points.
+	Vector3 position;
+	int32_t type;
+	// Edges of rectangles.
+	Vector3 u;
+	float radius;
+	Vector3 v;
+	// Power of this & all previous lights over the total power, see UpdateLightCdf.
+	float cdf;
+	// Radiance of area lights, intensity of points.
+	Vector3 emission;
+	float pad;
+
+	static Light Rectangle(const Vector3& corner, const Vector3& u, const Vector3& v, const Vector3& emission);
+	static Light Sphere(const Vector3& center, float radius, const Vector3& emission);
+	static Light Point(const Vector3& position, const Vector3& intensity);
+
+	float Power() const;
+
+	// Point on the light for u & v in [0, 1), false if the light can't reach point (i.e. the back of a rectangle).
+	bool Sample(const Vector3& point, float u, float v, LightSample& sample) const;
+	// Distance along the ray to the surface of the light, negative if it misses. front tells if the ray sees the emitting side.
+	float Intersect(const Vector3& origin, const Vector3& direction, bool& front) const;
+};
+
+// Fills in the cdf of all lights, so they are picked proportional to their power.
+void UpdateLightCdf(std::vector<Light>& lights);
+// Index of the light u falls on & the chance of picking it. u is rescaled to [0, 1) within that light, so it can place the sample.
+int PickLight(const std::vector<Light>& lights, float& u, float& pdf);
@@ -0,0 +1,107 @@
+#include "Matrix4.h"
+#include <math.h>
+
+
+Matrix4::Matrix4()
+{
+	for (int i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+
+#pragma region Factories
+Matrix4 Matrix4::Translation(const Vector3 &offset)
+{
+	Matrix4 result;
+	result.m[12] = offset.x;
+	result.m[13] = offset.y;
+	result.m[14] = offset.z;
+	return result;
+}
+
+Matrix4 Matrix4::Scale(float scale)
+{
+	Matrix4 result;
+	result.m[0] = result.m[5] = result.m[10] = scale;
+	return result;
+}
+
+Matrix4 Matrix4::RotationY(float radians)
+{
+	Matrix4 result;
+	float c = cosf(radians);
+	float s = sinf(radians);
+
+	result.m[0] = c;
+	result.m[2] = -s;
+	result.m[8] = s;
+	result.m[10] = c;
+	return result;
+}
+#pragma endregion
+
+
+#pragma region Operations
+Matrix4 Matrix4::operator*(const Matrix4 &rhs) const
+{
+	Matrix4 result;
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			float sum = 0;
+			for (int k = 0; k < 4; k++)
+				sum += m[k * 4 + r] * rhs.m[c * 4 + k];
+			result.m[c * 4 + r] = sum;
+		}
+	}
+	return result;
+}
+
+Vector3 Matrix4::TransformPoint(const Vector3 &p) const
+{
+	return TransformVector(p) + Vector3(m[12], m[13], m[14]);
+}
+
+Vector3 Matrix4::TransformVector(const Vector3 &v) const
+{
+	return Vector3(m[0] * v.x + m[4] * v.y + m[8] * v.z,
+		m[1] * v.x + m[5] * v.y + m[9] * v.z,
+		m[2] * v.x + m[6] * v.y + m[10] * v.z);
+}
+
+Vector3 Matrix4::TransformNormal(const Vector3 &n) const
+{
+	return Vector3(m[0] * n.x + m[1] * n.y + m[2] * n.z,
+		m[4] * n.x + m[5] * n.y + m[6] * n.z,
+		m[8] * n.x + m[9] * n.y + m[10] * n.z);
+}
+
+Matrix4 Matrix4::InverseAffine() const
+{
+	// Inverse of the upper 3x3 through its adjugate.
+	float a = m[0], b = m[4], c = m[8];
+	float d = m[1], e = m[5], f = m[9];
+	float g = m[2], h = m[6], i = m[10];
+
+	float det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+	float inv = 1.0f / det;
+
+	Matrix4 result;
+	result.m[0] = (e * i - f * h) * inv;
+	result.m[4] = (c * h - b * i) * inv;
+	result.m[8] = (b * f - c * e) * inv;
+	result.m[1] = (f * g - d * i) * inv;
+	result.m[5] = (a * i - c * g) * inv;
+	result.m[9] = (c * d - a * f) * inv;
+	result.m[2] = (d * h - e * g) * inv;
+	result.m[6] = (b * g - a * h) * inv;
+	result.m[10] = (a * e - b * d) * inv;
+
+	Vector3 translation = result.TransformVector(Vector3(m[12], m[13], m[14]));
+	result.m[12] = -translation.x;
+	result.m[13] = -translation.y;
+	result.m[14] = -translation.z;
+	return result;
+}
+#pragma endregion
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Vector3.h"
+
+/// <summary>
+/// A 4x4 float matrix for affine transforms, stored column major like a mat4 in GLSL.
+/// </summary>
+
+struct Matrix4
+{
+	// Element of column c & row r at m[c * 4 + r].
+	float m[16];
+
+	// Identity
+	Matrix4();
+
+	static Matrix4 Translation(const Vector3 &offset);
+	static Matrix4 Scale(float scale);
+	static Matrix4 RotationY(float radians);
+
+	Matrix4 operator * (const Matrix4 &rhs) const;
+
+	Vector3 TransformPoint(const Vector3 &point) const;
+	Vector3 TransformVector(const Vector3 &vector) const;
+	// Multiplies with the transposed upper 3x3, which maps object space normals to world space for a world to object matrix.
+	Vector3 TransformNormal(const Vector3 &normal) const;
+
+	// Inverse of a rotation, scale & translation.
+	Matrix4 InverseAffine() const;
+};
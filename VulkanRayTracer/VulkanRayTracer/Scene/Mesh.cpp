@@ -0,0 +1,66 @@
+#include "Mesh.h"
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+
+
+void Mesh::GetBounds(Vector3& min, Vector3& max) const
+{
+	min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+	max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const auto& p : positions)
+	{
+		min = Vector3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+		max = Vector3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+	}
+}
+
+Matrix4 Mesh::FitInto(Vector3 center, float floor, float size, float yaw) const
+{
+	if (positions.empty())
+		return Matrix4();
+
+	Vector3 min, max;
+	GetBounds(min, max);
+
+	Vector3 extent = max - min;
+	float largest = std::max(extent.x, std::max(extent.y, extent.z));
+	float scale = largest > 0 ? size / largest : 1.0f;
+
+	// Center horizontally, put the lowest point onto the floor.
+	Vector3 pivot((min.x + max.x) / 2, min.y, (min.z + max.z) / 2);
+	Vector3 target(center.x, floor, center.z);
+
+	return Matrix4::Translation(target) * Matrix4::RotationY(yaw) * Matrix4::Scale(scale) * Matrix4::Translation(pivot * -1.0f);
+}
+
+
+MeshBuffers::MeshBuffers(std::vector<Mesh>& sceneMeshes, int32_t firstNode)
+{
+	for (auto& mesh : sceneMeshes)
+	{
+		Bvh bvh(mesh);
+
+		int32_t nodeOffset = firstNode + int32_t(nodes.size());
+		int32_t triangleOffset = int32_t(indices.size() / 3);
+		uint32_t vertexOffset = uint32_t(vertices.size());
+
+		MeshInfo info = {};
+		info.rootNode = nodeOffset;
+		info.triangleCount = int32_t(mesh.TriangleCount());
+		info.mat = mesh.mat;
+		meshes.push_back(info);
+
+		for (auto node : bvh.GetNodes())
+		{
+			node.leftOrFirst += node.count > 0 ? triangleOffset : nodeOffset;
+			nodes.push_back(node);
+		}
+
+		for (uint32_t index : mesh.indices)
+			indices.push_back(vertexOffset + index);
+
+		for (const auto& position : mesh.positions)
+			vertices.push_back({ position, 1.0f });
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Material.h"
+#include "Matrix4.h"
+#include "Vector3.h"
+
+struct BvhNode;
+
+/// <summary>
+/// An indexed triangle mesh, i.e. loaded from an OBJ file.
+/// </summary>
+
+struct Mesh
+{
+	std::vector<Vector3> positions;
+	// Three vertex indices per triangle.
+	std::vector<uint32_t> indices;
+
+	Material mat;
+
+	uint32_t TriangleCount() const { return uint32_t(indices.size() / 3); }
+
+	void GetBounds(Vector3& min, Vector3& max) const;
+
+	// Object to world transform, which scales & moves the mesh so that its bounds fit into a box of size edge length,
+	// standing on floor around center, turned by yaw around the vertical axis.
+	Matrix4 FitInto(Vector3 center, float floor, float size, float yaw = 0.0f) const;
+};
+
+// Padded to 16 bytes, like a vec4 in the shader.
+struct MeshVertex
+{
+	Vector3 position;
+	float pad;
+};
+
+// Per mesh entry of the Meshes buffer in shaders/raytracing.comp.
+struct MeshInfo
+{
+	int32_t rootNode;
+	int32_t triangleCount;
+	int32_t pad[2];
+
+	Material mat;
+};
+
+// Per instance entry of the Instances buffer in shaders/raytracing.comp.
+struct MeshInstance
+{
+	// Moves rays into the space the mesh & its hierarchy were built in.
+	Matrix4 worldToObject;
+	int32_t mesh;
+	// Non zero to shade the instance with mat instead of the material of its mesh.
+	int32_t overrideMaterial;
+	int32_t pad[2];
+
+	Material mat;
+};
+
+/// <summary>
+/// All meshes of the scene concatenated into the buffers the shader & the CPU renderer trace.
+/// Every mesh gets its own BVH, node, triangle & vertex indices are global, so the hierarchies can be walked without offsets.
+/// Node indices start at firstNode, which lets the nodes follow the sphere hierarchy in one buffer.
+/// </summary>
+
+struct MeshBuffers
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<BvhNode> nodes;
+	std::vector<MeshInfo> meshes;
+
+	// Builds the BVH of every mesh, which reorders its triangles.
+	MeshBuffers(std::vector<Mesh>& meshes, int32_t firstNode);
+};
@@ -0,0 +1,210 @@
+#include "ObjLoader.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+
+namespace
+{
+	const size_t ChunkSize = 1 << 20;
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+	inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			p++;
+		return p;
+	}
+
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			p++;
+		return p < end ? p + 1 : end;
+	}
+
+	// Locale independent & much faster than strtof, precise enough for vertex positions.
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		static const double Powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		double mantissa = 0.0;
+		while (p < end && IsDigit(*p))
+			mantissa = mantissa * 10.0 + (*p++ - '0');
+
+		int exponent = 0;
+		if (p < end && *p == '.')
+		{
+			p++;
+			while (p < end && IsDigit(*p))
+			{
+				mantissa = mantissa * 10.0 + (*p++ - '0');
+				exponent--;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = *p++ == '-';
+
+			int e = 0;
+			while (p < end && IsDigit(*p))
+				e = e * 10 + (*p++ - '0');
+			exponent += negativeExponent ? -e : e;
+		}
+
+		double scale = 1.0;
+		for (int e = exponent < 0 ? -exponent : exponent; e > 0; e -= 18)
+			scale *= Powers[e > 18 ? 18 : e];
+
+		double result = exponent < 0 ? mantissa / scale : mantissa * scale;
+		value = float(negative ? -result : result);
+		return p;
+	}
+
+	const char* ParseInt(const char* p, const char* end, int64_t& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		value = 0;
+		while (p < end && IsDigit(*p))
+			value = value * 10 + (*p++ - '0');
+
+		if (negative)
+			value = -value;
+		return p;
+	}
+
+	class ObjParser
+	{
+	public:
+		explicit ObjParser(Mesh& mesh) : mesh(mesh) {}
+
+		// Parses all complete lines in [p, end).
+		void Parse(const char* p, const char* end)
+		{
+			while (p < end)
+			{
+				p = SkipSpaces(p, end);
+
+				if (end - p > 1 && p[0] == 'v' && IsSpace(p[1]))
+					p = ParseVertex(p + 2, end);
+				else if (end - p > 1 && p[0] == 'f' && IsSpace(p[1]))
+					p = ParseFace(p + 2, end);
+
+				p = SkipLine(p, end);
+			}
+		}
+
+	private:
+		Mesh& mesh;
+		// Reused for every face, so it only allocates for the largest polygon.
+		std::vector<uint32_t> polygon;
+
+		const char* ParseVertex(const char* p, const char* end)
+		{
+			Vector3 position;
+			p = ParseFloat(SkipSpaces(p, end), end, position.x);
+			p = ParseFloat(SkipSpaces(p, end), end, position.y);
+			p = ParseFloat(SkipSpaces(p, end), end, position.z);
+
+			mesh.positions.push_back(position);
+			return p;
+		}
+
+		const char* ParseFace(const char* p, const char* end)
+		{
+			polygon.clear();
+
+			while (true)
+			{
+				p = SkipSpaces(p, end);
+				if (p >= end || !(IsDigit(*p) || *p == '-'))
+					break;
+
+				int64_t index;
+				p = ParseInt(p, end, index);
+
+				// Texture coordinate & normal indices ("v/vt/vn") aren't needed.
+				while (p < end && !IsSpace(*p) && *p != '\n' && *p != '\r')
+					p++;
+
+				// OBJ indices start at 1, negative ones are relative to the latest vertex.
+				int64_t vertexCount = int64_t(mesh.positions.size());
+				int64_t resolved = index < 0 ? vertexCount + index : index - 1;
+				if (resolved < 0 || resolved >= vertexCount)
+					throw std::runtime_error("OBJ face references vertex " + std::to_string(index) + ", which doesn't exist !");
+
+				polygon.push_back(uint32_t(resolved));
+			}
+
+			for (size_t i = 2; i < polygon.size(); i++)
+			{
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i - 1]);
+				mesh.indices.push_back(polygon[i]);
+			}
+
+			return p;
+		}
+	};
+}
+
+
+Mesh LoadObj(const std::string& path)
+{
+	std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path.c_str(), "rb"), fclose);
+	if (!file)
+		throw std::runtime_error("Failed to open mesh " + path + " !");
+
+	Mesh mesh;
+	ObjParser parser(mesh);
+
+	// Lines crossing a chunk boundary are moved to the front & completed by the next read.
+	std::vector<char> buffer(ChunkSize);
+	size_t carried = 0;
+
+	while (true)
+	{
+		size_t read = fread(buffer.data() + carried, 1, ChunkSize - carried, file.get());
+		size_t size = carried + read;
+
+		if (read == 0)
+		{
+			parser.Parse(buffer.data(), buffer.data() + size);
+			break;
+		}
+
+		size_t complete = size;
+		while (complete > 0 && buffer[complete - 1] != '\n')
+			complete--;
+
+		if (complete == 0)
+		{
+			if (size == ChunkSize)
+				throw std::runtime_error("Line in mesh " + path + " exceeds the parser's chunk size !");
+			carried = size;
+			continue;
+		}
+
+		parser.Parse(buffer.data(), buffer.data() + complete);
+
+		carried = size - complete;
+		memmove(buffer.data(), buffer.data() + complete, carried);
+	}
+
+	return mesh;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "Mesh.h"
+
+/// <summary>
+/// Loads the triangles of Wavefront OBJ files. Only positions ("v") & faces ("f") are read, polygons are triangulated as fans.
+/// The file is parsed in place from fixed size chunks, no memory is allocated per line, so multi million triangle meshes load quickly.
+/// </summary>
+
+Mesh LoadObj(const std::string& path);
@@ -0,0 +1,31 @@
+#include "PrimitiveBuffers.h"
+
+
+PrimitiveBuffers::PrimitiveBuffers(const std::vector<Planee>& scenePlanes, const std::vector<Sphere>& sceneSpheres)
+{
+	planes.reserve(scenePlanes.size());
+	spheres.reserve(sceneSpheres.size());
+	materials.reserve(scenePlanes.size() + sceneSpheres.size());
+
+	for (const auto& plane : scenePlanes)
+	{
+		planes.push_back({ plane.normal, plane.distance });
+		materials.push_back(plane.mat);
+	}
+
+	for (const auto& sphere : sceneSpheres)
+	{
+		spheres.push_back({ sphere.position, sphere.radius });
+		materials.push_back(sphere.mat);
+	}
+}
+
+size_t PrimitiveBuffers::GeometryBytes() const
+{
+	return (spheres.size() + planes.size()) * sizeof(PrimitiveGeometry);
+}
+
+size_t PrimitiveBuffers::InterleavedBytes() const
+{
+	return spheres.size() * sizeof(Sphere) + planes.size() * sizeof(Planee);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Material.h"
+#include "Planee.h"
+#include "Sphere.h"
+#include "Vector3.h"
+
+// Padded to 16 bytes, like a vec4 in the shader: position & radius of a sphere, or normal & distance of a plane.
+struct PrimitiveGeometry
+{
+	Vector3 xyz;
+	float w;
+};
+
+/// <summary>
+/// Spheres & planes split into the buffers the shader & the CPU renderer trace.
+/// Intersection tests only walk the packed geometry, 16 bytes per primitive, the materials are read for the closest hit only.
+/// Materials of the planes come first, the ones of the spheres follow, see SphereMaterial.
+/// </summary>
+
+struct PrimitiveBuffers
+{
+	std::vector<PrimitiveGeometry> spheres;
+	std::vector<PrimitiveGeometry> planes;
+	std::vector<Material> materials;
+
+	PrimitiveBuffers() = default;
+	// Keeps the order of planes & spheres, so ids of the hierarchy stay valid.
+	PrimitiveBuffers(const std::vector<Planee>& planes, const std::vector<Sphere>& spheres);
+
+	uint32_t SphereMaterial(uint32_t sphere) const { return uint32_t(planes.size()) + sphere; }
+
+	// Bytes intersection tests read from, & the ones of the interleaved Sphere & Planee structs for comparison.
+	size_t GeometryBytes() const;
+	size_t InterleavedBytes() const;
+};
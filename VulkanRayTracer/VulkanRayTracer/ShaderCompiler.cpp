@@ -0,0 +1,219 @@
+#include "ShaderCompiler.h"
+#include "ShaderConstants.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifdef VKRT_WITH_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+
+// Paths CMake found, the tools are looked up on the PATH otherwise.
+#ifndef VKRT_GLSLANG_VALIDATOR
+#define VKRT_GLSLANG_VALIDATOR "glslangValidator"
+#endif
+#ifndef VKRT_SPIRV_OPT
+#define VKRT_SPIRV_OPT "spirv-opt"
+#endif
+
+
+namespace
+{
+	bool ReadFile(const std::string& path, std::string& content)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		content = stream.str();
+		return true;
+	}
+
+	bool WriteFile(const std::string& path, const std::vector<char>& data)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), data.size());
+		return file.good();
+	}
+
+	// 64 bit FNV-1a.
+	uint64_t Hash(const std::string& data, uint64_t hash = 14695981039346656037ull)
+	{
+		for (char c : data)
+		{
+			hash ^= uint8_t(c);
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+#ifndef VKRT_WITH_SHADERC
+	bool Run(std::string command)
+	{
+#ifdef _WIN32
+		// cmd.exe strips the outer quotes of a command that starts with one.
+		command = "\"" + command + "\"";
+#endif
+		return system(command.c_str()) == 0;
+	}
+#endif
+
+	// The tuning constants of ShaderConstants.h, which the shader expects as macro definitions.
+	struct ShaderDefine
+	{
+		const char* name;
+		const char* value;
+	};
+
+#define VKRT_SHADER_DEFINE(name, value) { #name, #value },
+	const ShaderDefine ShaderDefines[] = { VKRT_SHADER_CONSTANTS(VKRT_SHADER_DEFINE) };
+#undef VKRT_SHADER_DEFINE
+
+	// -D options of glslangValidator, also part of the cache key.
+	std::string DefineOptions()
+	{
+		std::string options;
+		for (const auto& define : ShaderDefines)
+			options += std::string(" -D") + define.name + "=" + define.value;
+
+		return options;
+	}
+
+	std::string TemporaryPath(const std::string& directory, const char* extension)
+	{
+		std::random_device random;
+		return directory + "/" + std::to_string(random()) + extension;
+	}
+}
+
+
+ShaderCompiler::ShaderCompiler(const std::string& cacheDirectory, bool optimize) : cacheDirectory(cacheDirectory), optimize(optimize) {}
+
+CompiledShader ShaderCompiler::Compile(const std::string& sourcePath) const
+{
+	CompiledShader result;
+
+	std::string source;
+	if (!ReadFile(sourcePath, source))
+	{
+		result.log = "Failed to open " + sourcePath;
+		return result;
+	}
+
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)Hash(source, Hash(GetCompilerKey())));
+	std::string cachePath = cacheDirectory + "/" + key + ".spv";
+
+	std::string cached;
+	if (ReadFile(cachePath, cached) && !cached.empty())
+	{
+		result.spirv.assign(cached.begin(), cached.end());
+		result.cached = true;
+		return result;
+	}
+
+#ifdef _WIN32
+	_mkdir(cacheDirectory.c_str());
+#else
+	mkdir(cacheDirectory.c_str(), 0755);
+#endif
+
+	if (!CompileSource(sourcePath, source, result))
+	{
+		result.spirv.clear();
+		return result;
+	}
+
+	// Written under a temporary name first, so other processes never load half a shader. Losing a race only means
+	// another process stored the same SPIR-V already.
+	auto temporaryPath = TemporaryPath(cacheDirectory, ".tmp");
+	if (WriteFile(temporaryPath, result.spirv) && rename(temporaryPath.c_str(), cachePath.c_str()) == 0)
+		return result;
+
+	remove(temporaryPath.c_str());
+	return result;
+}
+
+std::string ShaderCompiler::GetCompilerKey() const
+{
+#ifdef VKRT_WITH_SHADERC
+	unsigned int version, revision;
+	shaderc_get_spv_version(&version, &revision);
+	std::string key = "shaderc spv " + std::to_string(version) + "." + std::to_string(revision);
+#else
+	std::string key = std::string(VKRT_GLSLANG_VALIDATOR) + " -V --target-env vulkan1.0";
+	if (optimize)
+		key += std::string(" | ") + VKRT_SPIRV_OPT + " -O";
+#endif
+
+	return key + (optimize ? " optimized" : "") + DefineOptions();
+}
+
+#ifdef VKRT_WITH_SHADERC
+bool ShaderCompiler::CompileSource(const std::string& sourcePath, const std::string& source, CompiledShader& result) const
+{
+	auto compiler = shaderc_compiler_initialize();
+	auto options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	// Runs the spirv-opt performance passes.
+	if (optimize)
+		shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+	for (const auto& define : ShaderDefines)
+		shaderc_compile_options_add_macro_definition(options, define.name, strlen(define.name), define.value, strlen(define.value));
+
+	auto compiled = shaderc_compile_into_spv(compiler, source.data(), source.size(), shaderc_compute_shader, sourcePath.c_str(), "main", options);
+
+	bool success = shaderc_result_get_compilation_status(compiled) == shaderc_compilation_status_success;
+	if (success)
+	{
+		const char* bytes = shaderc_result_get_bytes(compiled);
+		result.spirv.assign(bytes, bytes + shaderc_result_get_length(compiled));
+	}
+	result.log = shaderc_result_get_error_message(compiled);
+
+	shaderc_result_release(compiled);
+	shaderc_compile_options_release(options);
+	shaderc_compiler_release(compiler);
+
+	return success;
+}
+#else
+bool ShaderCompiler::CompileSource(const std::string& sourcePath, const std::string&, CompiledShader& result) const
+{
+	auto outputPath = TemporaryPath(cacheDirectory, ".spv");
+	auto logPath = outputPath + ".log";
+
+	// glslangValidator picks the stage from the extension, -S comp allows any file name.
+	std::string command = std::string("\"") + VKRT_GLSLANG_VALIDATOR + "\" -V --target-env vulkan1.0" + DefineOptions() + " -S comp \"" + sourcePath +
+		"\" -o \"" + outputPath + "\" > \"" + logPath + "\" 2>&1";
+	bool success = Run(command);
+
+	if (success && optimize)
+	{
+		command = std::string("\"") + VKRT_SPIRV_OPT + "\" -O \"" + outputPath + "\" -o \"" + outputPath + "\" >> \"" + logPath + "\" 2>&1";
+		success = Run(command);
+	}
+
+	ReadFile(logPath, result.log);
+	std::string spirv;
+	if (success && ReadFile(outputPath, spirv))
+		result.spirv.assign(spirv.begin(), spirv.end());
+
+	remove(logPath.c_str());
+	remove(outputPath.c_str());
+
+	return success && !result.spirv.empty();
+}
+#endif
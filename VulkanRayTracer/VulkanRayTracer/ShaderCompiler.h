@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Compiles a GLSL compute shader to SPIR-V at runtime, through shaderc if the build found it (VKRT_WITH_SHADERC),
+/// otherwise through glslangValidator & spirv-opt on the command line.
+/// Results are cached on disk, keyed by a hash of the source, the compiler & its options, so unchanged shaders load instantly.
+/// </summary>
+
+struct CompiledShader
+{
+	std::vector<char> spirv;
+	bool cached = false;
+	// Compiler output, i.e. the errors if spirv is empty.
+	std::string log;
+};
+
+class ShaderCompiler
+{
+public:
+	ShaderCompiler(const std::string& cacheDirectory, bool optimize);
+
+	CompiledShader Compile(const std::string& sourcePath) const;
+
+private:
+	std::string cacheDirectory;
+	// Run the performance passes of spirv-opt over the result.
+	bool optimize;
+
+	// Which compiler & options produced the SPIR-V, part of the cache key.
+	std::string GetCompilerKey() const;
+	bool CompileSource(const std::string& sourcePath, const std::string& source, CompiledShader& result) const;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+/// <summary>
+/// Tuning constants of the filters in shaders/raytracing.comp that the CPU renderer & UpscaleImage mirror. They're only
+/// defined here: ShaderCompiler passes them to the shader as macro definitions, CMake does the same for the build time compile.
+/// </summary>
+
+// X(name, value) per constant, see the shader for what they do. CMake parses this list as well, so keep the values plain decimals.
+#define VKRT_SHADER_CONSTANTS(X) \
+	X(DenoiseColorSigma, 4.0) \
+	X(DenoiseNormalPower, 64.0) \
+	X(DenoiseDepthSigma, 0.05) \
+	X(DenoiseMaxRadiance, 4.0) \
+	X(TemporalMaxHistory, 32.0) \
+	X(TemporalClipGamma, 1.25) \
+	X(TemporalDepthTolerance, 0.05) \
+	X(TemporalNormalThreshold, 0.9) \
+	X(TemporalMaxRadiance, 4.0) \
+	X(AdaptiveMinSamples, 16.0) \
+	X(AdaptiveDarkBias, 0.1) \
+	X(AdaptiveMaxError, 16.0) \
+	X(UpscaleSpatialSigma, 0.75) \
+	X(UpscaleRangeSigma, 0.3)
+
+#define VKRT_DECLARE_SHADER_CONSTANT(name, value) const float name = float(value);
+VKRT_SHADER_CONSTANTS(VKRT_DECLARE_SHADER_CONSTANT)
+#undef VKRT_DECLARE_SHADER_CONSTANT
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <tuple>
+
+/// <summary>
+/// Values shaders/raytracing.comp is specialized on besides the local size & pass: shading constants & features of the scene.
+/// The driver constant folds them, i.e. drops the plane loops of a scene without planes or the mirror branch of one without mirrors.
+/// Application builds pipelines per variant on first use & keeps them, see Application::GetComputePipeline.
+/// </summary>
+
+struct ShaderVariant
+{
+	// constant_id 6 to 19 in the shader, keep the defaults in sync.
+	int32_t maxBounces = 4;
+	float shadow = 0.35f;
+	float epsilon = 0.0001f;
+	// Booleans are 32 bit wide specialization constants.
+	uint32_t hasPlanes = 1;
+	uint32_t hasDiffuse = 1;
+	uint32_t hasSpecular = 1;
+	int32_t rouletteDepth = 3;
+	uint32_t pathStats = 0;
+	// A-trous iterations, any makes the passes write the G-buffer the denoise pass reads.
+	int32_t denoiseIterations = 0;
+	// Reprojects the history of earlier frames, which also makes the passes write the G-buffer & motion vectors.
+	uint32_t temporal = 0;
+	// Relative error tiles stop being sampled at, any makes the megakernel trace the tiles of the indirect tile list only.
+	float adaptiveThreshold = 0.0f;
+	// Filter the upscale pass stretches a frame traced below the output size with, see UpscaleFilter.
+	int32_t upscaleFilter = 1;
+	// Phases of interleaved rendering, more than 1 makes the megakernel trace one of them per frame.
+	int32_t interleave = 1;
+	// Whether adaptiveThreshold is above 0, the shader can't derive it from the float.
+	uint32_t adaptive = 0;
+
+	bool operator<(const ShaderVariant& other) const
+	{
+		return std::tie(maxBounces, shadow, epsilon, hasPlanes, hasDiffuse, hasSpecular, rouletteDepth, pathStats, denoiseIterations, temporal, adaptiveThreshold,
+			upscaleFilter, interleave, adaptive)
+			< std::tie(other.maxBounces, other.shadow, other.epsilon, other.hasPlanes, other.hasDiffuse, other.hasSpecular,
+				other.rouletteDepth, other.pathStats, other.denoiseIterations, other.temporal,
+				other.adaptiveThreshold, other.upscaleFilter, other.interleave, other.adaptive);
+	}
+};
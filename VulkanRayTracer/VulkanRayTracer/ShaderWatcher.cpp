@@ -0,0 +1,78 @@
+#include "ShaderWatcher.h"
+
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+
+
+ShaderWatcher::ShaderWatcher(const ShaderCompiler& compiler, const std::string& sourcePath) : compiler(compiler), sourcePath(sourcePath)
+{
+	thread = std::thread(&ShaderWatcher::Watch, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	stopRequested.notify_one();
+	thread.join();
+}
+
+bool ShaderWatcher::TakeCompiled(std::vector<char>& spirv)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!hasCompiled)
+		return false;
+
+	spirv = std::move(compiled);
+	hasCompiled = false;
+	return true;
+}
+
+void ShaderWatcher::Watch()
+{
+	const auto Interval = std::chrono::milliseconds(250);
+
+	long long lastModified = GetModificationTime(sourcePath);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopRequested.wait_for(lock, Interval, [this] { return stop; }))
+	{
+		long long modified = GetModificationTime(sourcePath);
+		if (modified == lastModified)
+			continue;
+		lastModified = modified;
+
+		// Editors may still be writing the file, give them a moment.
+		if (stopRequested.wait_for(lock, Interval, [this] { return stop; }))
+			break;
+
+		lock.unlock();
+		auto begin = std::chrono::steady_clock::now();
+		auto result = compiler.Compile(sourcePath);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		lock.lock();
+
+		if (result.spirv.empty())
+		{
+			std::cerr << "Failed to compile " << sourcePath << ", keeping the running shader:" << std::endl << result.log << std::endl;
+			continue;
+		}
+
+		std::cout << "Compiled " << sourcePath << " in " << ms << " ms" << (result.cached ? " (cached)" : "") << std::endl;
+		compiled = std::move(result.spirv);
+		hasCompiled = true;
+	}
+}
+
+long long ShaderWatcher::GetModificationTime(const std::string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return 0;
+
+	// Modification times may only have a resolution of seconds, the size catches most edits within one.
+	return (long long)info.st_mtime * 1000003 + (long long)info.st_size;
+}
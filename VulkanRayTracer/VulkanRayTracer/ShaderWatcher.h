@@ -0,0 +1,41 @@
+#pragma once
+#include "ShaderCompiler.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Polls a shader source for changes on a background thread & compiles every new version there,
+/// so the frame loop only picks up finished SPIR-V through TakeCompiled & never waits for the compiler.
+/// </summary>
+
+class ShaderWatcher
+{
+public:
+	ShaderWatcher(const ShaderCompiler& compiler, const std::string& sourcePath);
+	~ShaderWatcher();
+
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	// Moves the SPIR-V of the latest successful compilation into spirv, false if there is none since the last call.
+	bool TakeCompiled(std::vector<char>& spirv);
+
+private:
+	ShaderCompiler compiler;
+	std::string sourcePath;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable stopRequested;
+	bool stop = false;
+
+	std::vector<char> compiled;
+	bool hasCompiled = false;
+
+	void Watch();
+	static long long GetModificationTime(const std::string& path);
+};
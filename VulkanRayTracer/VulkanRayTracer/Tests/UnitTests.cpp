@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "PipelineCacheFile.h"
+#include "Poster.h"
+#include "Scene/ObjLoader.h"
+
+/// <summary>
+/// Tests of the parts that run without a Vulkan device: poster tiling & streaming, the dispatch budget, pipeline cache
+/// file validation & the chunked OBJ parser. Files are written to the working directory. Run through ctest.
+/// </summary>
+
+namespace
+{
+	int failures = 0;
+
+	void Check(bool condition, const char* expression, const char* file, int line)
+	{
+		if (condition)
+			return;
+
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+		failures++;
+	}
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+	template <typename Function>
+	bool Throws(Function function)
+	{
+		try
+		{
+			function();
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	std::string ReadFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		return stream.str();
+	}
+
+	// Counts an exception escaping a test as a failure, so the tests after it still run.
+	void Run(const char* name, void (*test)())
+	{
+		try
+		{
+			test();
+		}
+		catch (const std::exception& e)
+		{
+			fprintf(stderr, "%s threw: %s\n", name, e.what());
+			failures++;
+		}
+	}
+
+	void WriteFile(const std::string& path, const std::string& content)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(content.data(), content.size());
+	}
+
+	// The color every pixel of the test poster gets, so misplaced tiles show up in the bytes.
+	void PosterColor(uint32_t x, uint32_t y, uint8_t rgb[3])
+	{
+		rgb[0] = uint8_t(x * 7 + 1);
+		rgb[1] = uint8_t(y * 13 + 2);
+		rgb[2] = uint8_t(x * y + 3);
+	}
+
+
+#pragma region Poster
+	void TestPosterTiles()
+	{
+		// 10x7 in 4x3 tiles: the last column is 2 wide, the last row 1 high.
+		PosterWriter writer("test_tiles.ppm", 10, 7, 4, 3);
+		CHECK(writer.GetTileCount() == 9);
+
+		PosterTile first = writer.GetTile(0);
+		CHECK(first.x == 0 && first.y == 0 && first.width == 4 && first.height == 3);
+		PosterTile right = writer.GetTile(2);
+		CHECK(right.x == 8 && right.y == 0 && right.width == 2 && right.height == 3);
+		PosterTile bottom = writer.GetTile(7);
+		CHECK(bottom.x == 4 && bottom.y == 6 && bottom.width == 4 && bottom.height == 1);
+		PosterTile corner = writer.GetTile(8);
+		CHECK(corner.x == 8 && corner.y == 6 && corner.width == 2 && corner.height == 1);
+
+		// One band of scanlines, as high as a tile.
+		CHECK(writer.GetBandBytes() == 10 * 3 * 3);
+
+		// A poster smaller than a tile is a single tile of its own size.
+		PosterWriter small("test_small.ppm", 3, 2, 4, 4);
+		CHECK(small.GetTileCount() == 1);
+		PosterTile only = small.GetTile(0);
+		CHECK(only.width == 3 && only.height == 2);
+		CHECK(small.GetBandBytes() == 3 * 2 * 3);
+	}
+
+	// Tiles are passed like the CPU renderer does: full tileWidth x tileHeight RGBA buffers, of which edge tiles only fill a part.
+	void WritePoster(const std::string& path, uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight, bool swapRedBlue)
+	{
+		PosterWriter writer(path, width, height, tileWidth, tileHeight);
+		std::vector<uint8_t> pixels(size_t(tileWidth) * tileHeight * 4);
+
+		for (uint32_t i = 0; i < writer.GetTileCount(); i++)
+		{
+			PosterTile tile = writer.GetTile(i);
+			if (tile.width > tileWidth || tile.height > tileHeight)
+				throw std::runtime_error("Tile " + std::to_string(i) + " is larger than the tile size !");
+
+			// Pixels past the edge of the poster have to be cropped.
+			std::fill(pixels.begin(), pixels.end(), uint8_t(0xEE));
+			for (uint32_t y = 0; y < tile.height; y++)
+			{
+				for (uint32_t x = 0; x < tile.width; x++)
+				{
+					uint8_t rgb[3];
+					PosterColor(tile.x + x, tile.y + y, rgb);
+					uint8_t* pixel = pixels.data() + (size_t(y) * tileWidth + x) * 4;
+					pixel[0] = swapRedBlue ? rgb[2] : rgb[0];
+					pixel[1] = rgb[1];
+					pixel[2] = swapRedBlue ? rgb[0] : rgb[2];
+					pixel[3] = 255;
+				}
+			}
+
+			writer.AddTile(pixels.data(), tileWidth, swapRedBlue);
+		}
+
+		writer.Finish();
+	}
+
+	std::string ExpectedPoster(uint32_t width, uint32_t height)
+	{
+		std::string expected = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint8_t rgb[3];
+				PosterColor(x, y, rgb);
+				expected.append(reinterpret_cast<const char*>(rgb), 3);
+			}
+		}
+
+		return expected;
+	}
+
+	void TestPosterOutput()
+	{
+		WritePoster("test_poster.ppm", 10, 7, 4, 3, false);
+		CHECK(ReadFile("test_poster.ppm") == ExpectedPoster(10, 7));
+
+		// BGRA compute images come out as RGB as well.
+		WritePoster("test_poster_bgra.ppm", 10, 7, 4, 3, true);
+		CHECK(ReadFile("test_poster_bgra.ppm") == ExpectedPoster(10, 7));
+
+		// Tiles that divide the poster evenly & a single tile.
+		WritePoster("test_poster_even.ppm", 8, 6, 4, 3, false);
+		CHECK(ReadFile("test_poster_even.ppm") == ExpectedPoster(8, 6));
+		WritePoster("test_poster_single.ppm", 5, 4, 5, 4, false);
+		CHECK(ReadFile("test_poster_single.ppm") == ExpectedPoster(5, 4));
+	}
+
+	void TestPosterErrors()
+	{
+		std::vector<uint8_t> pixels(4 * 4 * 4);
+
+		CHECK(Throws([&]
+		{
+			PosterWriter writer("test_missing.ppm", 8, 4, 4, 4);
+			writer.AddTile(pixels.data(), 4, false);
+			writer.Finish();
+		}));
+
+		CHECK(Throws([&]
+		{
+			PosterWriter writer("test_extra.ppm", 4, 4, 4, 4);
+			writer.AddTile(pixels.data(), 4, false);
+			writer.AddTile(pixels.data(), 4, false);
+		}));
+
+		CHECK(Throws([] { PosterWriter writer("missing_directory/test.ppm", 4, 4, 4, 4); }));
+	}
+
+	void TestDispatchBudget()
+	{
+		// 7 ms per sample in a 100 ms budget: doubling from 1 until 80 ms fit, which are 11 samples.
+		DispatchBudget budget(100.0, 64);
+		std::vector<uint32_t> dispatches;
+		for (uint32_t remaining = 64; remaining > 0;)
+		{
+			uint32_t samples = budget.Next(remaining);
+			budget.Update(samples, samples * 7.0);
+			dispatches.push_back(samples);
+			remaining -= samples;
+		}
+		CHECK((dispatches == std::vector<uint32_t>{ 1, 2, 4, 8, 11, 11, 11, 11, 5 }));
+		CHECK(!budget.OverBudget());
+		CHECK(budget.GetLongestMs() == 77.0);
+
+		// Never more than the tile has left or maxSamples.
+		DispatchBudget fast(100.0, 16);
+		for (int i = 0; i < 8; i++)
+			fast.Update(fast.Next(1000), 0.1);
+		CHECK(fast.Next(1000) == 16);
+		CHECK(fast.Next(3) == 3);
+
+		// Slower dispatches lower the count again, but never below 1.
+		DispatchBudget slow(10.0, 64);
+		slow.Update(1, 1.0);
+		CHECK(slow.Next(64) == 2);
+		slow.Update(2, 40.0);
+		CHECK(slow.Next(64) == 1);
+		CHECK(!slow.OverBudget());
+
+		// A single sample over the budget can't be split further.
+		DispatchBudget over(5.0, 64);
+		over.Update(1, 12.0);
+		CHECK(over.OverBudget());
+		CHECK(over.Next(10) == 1);
+
+		// Without a budget every dispatch takes all samples.
+		DispatchBudget unlimited(0.0, 16);
+		unlimited.Update(16, 1000.0);
+		CHECK(unlimited.Next(64) == 16);
+		CHECK(!unlimited.OverBudget());
+	}
+#pragma endregion
+
+
+#pragma region Pipeline cache
+	VkPhysicalDeviceProperties TestDevice()
+	{
+		VkPhysicalDeviceProperties properties = {};
+		properties.vendorID = 0x10DE;
+		properties.deviceID = 0x1234;
+		properties.driverVersion = 42;
+		for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+			properties.pipelineCacheUUID[i] = uint8_t(i * 3);
+
+		return properties;
+	}
+
+	// Cache data as a driver hands it out: the VK_PIPELINE_CACHE_HEADER_VERSION_ONE header & a payload.
+	std::vector<char> CacheData(const VkPhysicalDeviceProperties& properties, size_t payload)
+	{
+		std::vector<char> data(16 + VK_UUID_SIZE + payload);
+		uint32_t fields[4] = { uint32_t(16 + VK_UUID_SIZE), VK_PIPELINE_CACHE_HEADER_VERSION_ONE, properties.vendorID, properties.deviceID };
+		memcpy(data.data(), fields, sizeof(fields));
+		memcpy(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		for (size_t i = 16 + VK_UUID_SIZE; i < data.size(); i++)
+			data[i] = char(i * 31);
+
+		return data;
+	}
+
+	void TestPipelineCacheRoundTrip()
+	{
+		auto device = TestDevice();
+		PipelineCacheFile cache("test_pipeline_cache.bin", device);
+
+		auto data = CacheData(device, 1000);
+		CHECK(cache.Store(data));
+
+		std::string reason;
+		CHECK(cache.Load(reason) == data);
+
+		remove("test_no_pipeline_cache.bin");
+		PipelineCacheFile missing("test_no_pipeline_cache.bin", device);
+		CHECK(missing.Load(reason).empty() && reason == "no cache file");
+	}
+
+	void TestPipelineCacheRejects()
+	{
+		auto device = TestDevice();
+		PipelineCacheFile cache("test_pipeline_cache.bin", device);
+		CHECK(cache.Store(CacheData(device, 1000)));
+		std::string file = ReadFile("test_pipeline_cache.bin");
+
+		// Writes content over the cache file & returns why loading it failed, empty if it didn't.
+		auto reject = [&](const std::string& content)
+		{
+			WriteFile("test_pipeline_cache.bin", content);
+			std::string reason;
+			return cache.Load(reason).empty() ? reason : std::string();
+		};
+
+		// Cut off inside the file header & inside the data.
+		CHECK(reject(file.substr(0, 10)) == "not a pipeline cache file");
+		CHECK(reject(file.substr(0, file.size() - 1)) == "damaged");
+		CHECK(reject("") == "not a pipeline cache file");
+
+		// Another file format, i.e. the raw data of a VkPipelineCache without this file's header.
+		std::string foreign = file;
+		foreign[0] = 'X';
+		CHECK(reject(foreign) == "not a pipeline cache file");
+
+		// Same size, but a flipped byte in the data.
+		std::string corrupted = file;
+		corrupted[corrupted.size() - 1] ^= 1;
+		CHECK(reject(corrupted) == "damaged");
+
+		// Written on another device or driver.
+		auto otherDevice = device;
+		otherDevice.deviceID++;
+		CHECK(PipelineCacheFile("test_pipeline_cache.bin", otherDevice).Store(CacheData(otherDevice, 100)));
+		std::string reason;
+		CHECK(cache.Load(reason).empty() && reason == "written for another device");
+
+		auto otherUuid = device;
+		otherUuid.pipelineCacheUUID[VK_UUID_SIZE - 1]++;
+		CHECK(PipelineCacheFile("test_pipeline_cache.bin", otherUuid).Store(CacheData(otherUuid, 100)));
+		CHECK(cache.Load(reason).empty() && reason == "written for another device");
+
+		auto otherDriver = device;
+		otherDriver.driverVersion++;
+		CHECK(PipelineCacheFile("test_pipeline_cache.bin", otherDriver).Store(CacheData(otherDriver, 100)));
+		CHECK(cache.Load(reason).empty() && reason == "written by another driver version");
+
+		// The file header matches, but the cache data inside is for another device or too short for a cache header.
+		CHECK(cache.Store(CacheData(otherDevice, 100)));
+		CHECK(cache.Load(reason).empty() && reason == "cache header doesn't match the device");
+		CHECK(cache.Store(std::vector<char>(8, 0)));
+		CHECK(cache.Load(reason).empty() && reason == "cache header doesn't match the device");
+	}
+#pragma endregion
+
+
+#pragma region OBJ
+	// The size of the chunks LoadObj reads, see ChunkSize in Scene/ObjLoader.cpp.
+	const size_t ObjChunkSize = 1 << 20;
+
+	// Pads content with comment lines up to offset, so that the next line starts there.
+	void PadTo(std::string& content, size_t offset)
+	{
+		while (content.size() < offset)
+		{
+			size_t line = std::min<size_t>(offset - content.size(), 80);
+			content += (line == 1) ? std::string("\n") : "#" + std::string(line - 2, '-') + "\n";
+		}
+	}
+
+	void TestObjChunkBoundary()
+	{
+		std::string content = "v 0 0 0\nv 1 0 0\n";
+		// This vertex starts 5 bytes before the boundary, so its coordinates are split across two reads.
+		PadTo(content, ObjChunkSize - 5);
+		content += "v -1.25 2.5e1 3.125\n";
+		content += "f 1 2 3\n";
+
+		// The second read fills the chunk after the 5 carried bytes, so it ends at 2 * ObjChunkSize - 5 in the file. This face
+		// line crosses that boundary as well.
+		PadTo(content, 2 * ObjChunkSize - 5 - 4);
+		content += "f 3 2 1 -1\n";
+		content += "v 4 5 6\n";
+		WriteFile("test_chunks.obj", content);
+
+		Mesh mesh = LoadObj("test_chunks.obj");
+		CHECK(mesh.positions.size() == 4);
+		CHECK(mesh.positions.size() == 4 && mesh.positions[2].x == -1.25f && mesh.positions[2].y == 25.0f && mesh.positions[2].z == 3.125f);
+		CHECK(mesh.positions.size() == 4 && mesh.positions[3].x == 4.0f && mesh.positions[3].z == 6.0f);
+		// The quad is a fan of 2 triangles, -1 is the latest vertex when the face is read.
+		CHECK((mesh.indices == std::vector<uint32_t>{ 0, 1, 2, 2, 1, 0, 2, 0, 2 }));
+
+		// Every split of a vertex line over the boundary, up to the line break being the first byte of the next read & the line
+		// ending right at the boundary.
+		for (size_t before = 1; before <= 14; before++)
+		{
+			std::string split;
+			PadTo(split, ObjChunkSize - before);
+			split += "v 7.5 -8 9.25\n";
+			WriteFile("test_split.obj", split);
+
+			Mesh splitMesh = LoadObj("test_split.obj");
+			CHECK(splitMesh.positions.size() == 1 && splitMesh.positions[0].x == 7.5f && splitMesh.positions[0].y == -8.0f &&
+				splitMesh.positions[0].z == 9.25f);
+		}
+
+		// A file without a final line break still gets its last line parsed.
+		WriteFile("test_no_newline.obj", "v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 3");
+		Mesh last = LoadObj("test_no_newline.obj");
+		CHECK(last.indices.size() == 3);
+	}
+
+	void TestObjErrors()
+	{
+		// A single line longer than a chunk can't be carried into the next read.
+		WriteFile("test_long_line.obj", "# " + std::string(ObjChunkSize, 'x') + "\n");
+		CHECK(Throws([] { LoadObj("test_long_line.obj"); }));
+
+		WriteFile("test_bad_face.obj", "v 0 0 0\nf 1 2 3\n");
+		CHECK(Throws([] { LoadObj("test_bad_face.obj"); }));
+
+		CHECK(Throws([] { LoadObj("test_does_not_exist.obj"); }));
+	}
+#pragma endregion
+}
+
+
+int main()
+{
+	Run("TestPosterTiles", TestPosterTiles);
+	Run("TestPosterOutput", TestPosterOutput);
+	Run("TestPosterErrors", TestPosterErrors);
+	Run("TestDispatchBudget", TestDispatchBudget);
+	Run("TestPipelineCacheRoundTrip", TestPipelineCacheRoundTrip);
+	Run("TestPipelineCacheRejects", TestPipelineCacheRejects);
+	Run("TestObjChunkBoundary", TestObjChunkBoundary);
+	Run("TestObjErrors", TestObjErrors);
+
+	if (failures > 0)
+	{
+		fprintf(stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "All checks passed\n");
+	return EXIT_SUCCESS;
+}
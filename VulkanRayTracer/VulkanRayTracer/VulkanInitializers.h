@@ -1,6 +1,6 @@
 #pragma once
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
+#include "VulkanPlatform.h"
+#include <vector>
 
 /// <summary>
 /// Provides initializers for common Vulkan structures.
@@ -132,6 +132,16 @@ namespace Initializers
 		return result;
 	}
 
+	inline VkPushConstantRange PushConstantRange(VkShaderStageFlags stageFlags, uint32_t size, uint32_t offset = 0)
+	{
+		VkPushConstantRange result {};
+		result.stageFlags = stageFlags;
+		result.offset = offset;
+		result.size = size;
+
+		return result;
+	}
+
 	inline VkDescriptorSetAllocateInfo DescriptorSetAllocateInfo(VkDescriptorPool pool)
 	{
 		VkDescriptorSetAllocateInfo result {};
@@ -196,6 +206,27 @@ namespace Initializers
 		return result;
 	}
 
+	inline VkSpecializationMapEntry SpecializationMapEntry(uint32_t constantID, uint32_t offset, size_t size)
+	{
+		VkSpecializationMapEntry result {};
+		result.constantID = constantID;
+		result.offset = offset;
+		result.size = size;
+
+		return result;
+	}
+
+	inline VkSpecializationInfo SpecializationInfo(const std::vector<VkSpecializationMapEntry>& mapEntries, size_t dataSize, const void* data)
+	{
+		VkSpecializationInfo result {};
+		result.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+		result.pMapEntries = mapEntries.data();
+		result.dataSize = dataSize;
+		result.pData = data;
+
+		return result;
+	}
+
 	inline VkComputePipelineCreateInfo ComputePipelineCreateInfo()
 	{
 		VkComputePipelineCreateInfo result {};
@@ -204,6 +235,16 @@ namespace Initializers
 		return result;
 	}
 
+	inline VkPipelineCacheCreateInfo PipelineCacheCreateInfo(size_t initialDataSize, const void* initialData)
+	{
+		VkPipelineCacheCreateInfo result {};
+		result.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		result.initialDataSize = initialDataSize;
+		result.pInitialData = initialData;
+
+		return result;
+	}
+
 	inline VkShaderModuleCreateInfo ShaderModuleCreateInfo()
 	{
 		VkShaderModuleCreateInfo result {};
@@ -259,6 +300,16 @@ namespace Initializers
 		return result;
 	}
 
+	inline VkQueryPoolCreateInfo QueryPoolCreateInfo(VkQueryType queryType, uint32_t queryCount)
+	{
+		VkQueryPoolCreateInfo result {};
+		result.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		result.queryType = queryType;
+		result.queryCount = queryCount;
+
+		return result;
+	}
+
 	inline VkImageMemoryBarrier ImageMemoryBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
 	{
 		VkImageMemoryBarrier result {};
@@ -271,6 +322,42 @@ namespace Initializers
 	}
 
 
+	inline VkMemoryBarrier GlobalMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+	{
+		VkMemoryBarrier result {};
+		result.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		result.srcAccessMask = srcAccessMask;
+		result.dstAccessMask = dstAccessMask;
+
+		return result;
+	}
+
+	inline VkBufferMemoryBarrier BufferMemoryBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+	{
+		VkBufferMemoryBarrier result {};
+		result.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		result.srcAccessMask = srcAccessMask;
+		result.dstAccessMask = dstAccessMask;
+		result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		result.buffer = buffer;
+		result.offset = 0;
+		result.size = VK_WHOLE_SIZE;
+
+		return result;
+	}
+
+	inline VkSubmitInfo SubmitInfo(const VkCommandBuffer* commandBuffer)
+	{
+		VkSubmitInfo result {};
+		result.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		result.commandBufferCount = 1;
+		result.pCommandBuffers = commandBuffer;
+
+		return result;
+	}
+
+
 	inline VkBufferCreateInfo BufferCreateInfo(VkBufferUsageFlags flags, VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE)
 	{
 		VkBufferCreateInfo sphereInfo{};
@@ -0,0 +1,16 @@
+#pragma once
+
+/// <summary>
+/// Pulls in the Vulkan headers. Windowed builds get them through GLFW,
+/// headless-only builds (VKRT_NO_GLFW) include Vulkan directly.
+/// </summary>
+
+#ifdef VKRT_NO_GLFW
+#include <vulkan/vulkan.h>
+
+// Only ever used as an opaque pointer, windowed mode is unavailable in these builds.
+struct GLFWwindow;
+#else
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "WorkgroupTuner.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+WorkgroupTuner::WorkgroupTuner(const std::string& cachePath, const VkPhysicalDeviceProperties& properties) : cachePath(cachePath)
+{
+	std::ostringstream key;
+	key << std::hex << properties.vendorID << "-" << properties.deviceID << "-" << properties.driverVersion << "-";
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+	{
+		char byte[3];
+		snprintf(byte, sizeof(byte), "%02x", properties.pipelineCacheUUID[i]);
+		key << byte;
+	}
+
+	deviceKey = key.str();
+}
+
+std::vector<WorkgroupSize> WorkgroupTuner::GetCandidates(const VkPhysicalDeviceLimits& limits)
+{
+	const WorkgroupSize shapes[] = { { 4, 4 }, { 8, 4 }, { 8, 8 }, { 16, 8 }, { 16, 16 }, { 32, 1 }, { 32, 2 }, { 32, 4 }, { 64, 1 } };
+
+	std::vector<WorkgroupSize> candidates;
+	for (const auto& shape : shapes)
+	{
+		if (shape.x <= limits.maxComputeWorkGroupSize[0] && shape.y <= limits.maxComputeWorkGroupSize[1] &&
+			shape.x * shape.y <= limits.maxComputeWorkGroupInvocations)
+			candidates.push_back(shape);
+	}
+
+	return candidates;
+}
+
+bool WorkgroupTuner::LoadCached(WorkgroupSize& size) const
+{
+	std::ifstream file(cachePath);
+
+	// One "<device key> <x> <y>" entry per line.
+	std::string key;
+	uint32_t x, y;
+	while (file >> key >> x >> y)
+	{
+		if (key == deviceKey && x > 0 && y > 0)
+		{
+			size = { x, y };
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkgroupTuner::StoreCached(const WorkgroupSize& size) const
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(cachePath);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.compare(0, deviceKey.size() + 1, deviceKey + " ") != 0)
+				lines.push_back(line);
+		}
+	}
+
+	std::ofstream file(cachePath, std::ios::trunc);
+	if (!file.is_open())
+		return;
+
+	for (const auto& line : lines)
+		file << line << "\n";
+	file << deviceKey << " " << size.x << " " << size.y << "\n";
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "VulkanPlatform.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Candidate local sizes of the ray tracing shader & a small per device cache of the fastest one.
+/// Cache entries are keyed by vendor, device, driver version & pipeline cache UUID, so a driver update triggers a new tuning run.
+/// </summary>
+
+struct WorkgroupSize
+{
+	uint32_t x;
+	uint32_t y;
+};
+
+class WorkgroupTuner
+{
+public:
+	WorkgroupTuner(const std::string& cachePath, const VkPhysicalDeviceProperties& properties);
+
+	// All candidate shapes the device supports, see maxComputeWorkGroupSize & maxComputeWorkGroupInvocations.
+	static std::vector<WorkgroupSize> GetCandidates(const VkPhysicalDeviceLimits& limits);
+
+	// Number of workgroups needed to cover size invocations, the shader discards the ones past the edge.
+	static uint32_t GroupCount(uint32_t size, uint32_t localSize) { return (size + localSize - 1) / localSize; }
+
+	bool LoadCached(WorkgroupSize& size) const;
+	void StoreCached(const WorkgroupSize& size) const;
+
+private:
+	std::string cachePath;
+	std::string deviceKey;
+};
@@ -1,2 +0,0 @@
-C:/VulkanSDK/1.0.65.1/Bin/glslangValidator.exe -V raytracing.comp
-pause
\ No newline at end of file